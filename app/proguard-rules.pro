@@ -42,5 +42,12 @@
     onLoopEnd(...);
     onBufferEnd(...);
     onMoreData(...);
+    onMoreDataStaged(...);
     onCanWriteMoreData(...);
+    onPullDataNeeded(...);
 }
+-keep class org.nift4.gramophone.hificore.LoudnessScanner {
+    onTrackDone(...);
+    producerAt(...);
+}
+-keep interface org.nift4.gramophone.hificore.LoudnessScanner$PcmProducer { *; }
@@ -30,11 +30,19 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 	var boostGainChangedListener: (() -> Unit)? = null
 	var offloadEnabledChangedListener: (() -> Unit)? = null
 	private var gain = 1f
+	// gain reached at the end of the last buffer, to ramp from when it changes
+	private var appliedGain = 1f
+	@Volatile
+	private var gainChanged = false
 	private var kneeThresholdDb: Float? = null
 	private var tags: ReplayGainUtil.ReplayGainInfo? = null
 	override fun queueInput(inputBuffer: ByteBuffer) {
 		val frameCount = inputBuffer.remaining() / inputAudioFormat.bytesPerFrame
 		val outputBuffer = replaceOutputBuffer(frameCount * outputAudioFormat.bytesPerFrame)
+		if (gainChanged) {
+			gainChanged = false
+			computeGain(false)
+		}
 		if (inputBuffer.hasRemaining()) {
 			if (compressor != null) {
 				compressor!!.compress(
@@ -46,14 +54,23 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 				inputBuffer.position(inputBuffer.limit())
 				outputBuffer.position(frameCount * outputAudioFormat.bytesPerFrame)
 			} else {
-				if (gain == 1f) {
+				if (gain == 1f && appliedGain == 1f) {
 					outputBuffer.put(inputBuffer)
+				} else if (inputBuffer.isDirect && inputBuffer.position() == 0) {
+					// if the gain changed, ramp to it over this buffer
+					AdaptiveDynamicRangeCompression.applyGain(
+						inputAudioFormat.channelCount, floatArrayOf(appliedGain),
+						floatArrayOf(gain), inputBuffer, outputBuffer, frameCount
+					)
+					inputBuffer.position(inputBuffer.limit())
+					outputBuffer.position(frameCount * outputAudioFormat.bytesPerFrame)
 				} else {
 					while (inputBuffer.hasRemaining()) {
 						outputBuffer.putFloat(inputBuffer.getFloat() * gain)
 					}
 				}
 			}
+			appliedGain = gain
 		}
 		outputBuffer.flip()
 	}
@@ -76,16 +93,22 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 
 	@Synchronized
 	fun setMode(mode: ReplayGainUtil.Mode) {
+		if (this.mode != mode)
+			gainChanged = true
 		this.mode = mode
 	}
 
 	@Synchronized
 	fun setRgGain(rgGain: Int) {
+		if (this.rgGain != rgGain)
+			gainChanged = true
 		this.rgGain = rgGain
 	}
 
 	@Synchronized
 	fun setNonRgGain(nonRgGain: Int) {
+		if (this.nonRgGain != nonRgGain)
+			gainChanged = true
 		this.nonRgGain = nonRgGain
 	}
 
@@ -104,6 +127,8 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 
 	@Synchronized
 	fun setReduceGain(reduceGain: Boolean) {
+		if (this.reduceGain != reduceGain)
+			gainChanged = true
 		this.reduceGain = reduceGain
 	}
 
@@ -124,7 +149,8 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 		tags = ReplayGainUtil.parse(inputFormat)
 	}
 
-	private fun computeGain() {
+	// Without reinit, an existing compressor keeps its state and ramps to the new gain.
+	private fun computeGain(reinit: Boolean) {
 		val mode: ReplayGainUtil.Mode
 		val rgGain: Int
 		val nonRgGain: Int
@@ -140,13 +166,19 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 		this.gain = gain?.first ?: ReplayGainUtil.dbToAmpl(nonRgGain.toFloat())
 		this.kneeThresholdDb = gain?.second
 		if (kneeThresholdDb != null) {
+			if (compressor != null && !reinit)
+				return
 			if (compressor == null)
 				compressor = AdaptiveDynamicRangeCompression()
 			Log.w(TAG, "using dynamic range compression")
+			compressor!!.setGainRamp((inputAudioFormat.sampleRate *
+					ReplayGainUtil.GAIN_RAMP_TIME).toInt())
 			compressor!!.init(
 				inputAudioFormat.sampleRate,
 				ReplayGainUtil.TAU_ATTACK, ReplayGainUtil.TAU_RELEASE,
-				ReplayGainUtil.RATIO
+				ReplayGainUtil.RATIO,
+				if (inputAudioFormat.sampleRate > 48000)
+					ReplayGainUtil.DRC_BLOCK_SIZE_HIGH_RES else 1
 			)
 		} else {
 			onReset() // delete compressor
@@ -155,7 +187,9 @@ class ReplayGainAudioProcessor : BaseAudioProcessor() {
 
 	override fun onFlush(streamMetadata: AudioProcessor.StreamMetadata) {
 		waitingForFlush = false
-		computeGain()
+		gainChanged = false
+		computeGain(true)
+		appliedGain = gain
 	}
 
 	override fun onReset() {
@@ -110,6 +110,12 @@ sealed class ReplayGainUtil {
         const val RATIO = 2f
         const val TAU_ATTACK = 0.0014f
         const val TAU_RELEASE = 0.093f
+        // envelope update interval of the compressor (in frames) for sample rates above 48kHz,
+        // where per-frame updates are too expensive and a block is still far below TAU_ATTACK
+        const val DRC_BLOCK_SIZE_HIGH_RES = 16
+        // time (in seconds) over which the compressor moves to a new gain when the settings change
+        // during playback, long enough to not click and short enough to feel immediate
+        const val GAIN_RAMP_TIME = 0.02f
 
         private fun adjustVolume(bytes: ByteArray, sign: Boolean): Float {
             val peak = BigInteger(bytes)
@@ -12,6 +12,7 @@ android {
     defaultConfig {
         minSdk = 21
 
+        testInstrumentationRunner = "androidx.test.runner.AndroidJUnitRunner"
         consumerProguardFiles("consumer-rules.pro")
         externalNativeBuild {
             cmake {
@@ -66,4 +67,6 @@ dependencies {
     implementation(project(":misc:audiofxfwd"))
     // stub project that provides hidden SDK classes, which themselves depend on public SDK
     compileOnly(project(":misc:audiofxstub2"))
+    androidTestImplementation("androidx.test.ext:junit:1.3.0")
+    androidTestImplementation("androidx.test:runner:1.7.0")
 }
\ No newline at end of file
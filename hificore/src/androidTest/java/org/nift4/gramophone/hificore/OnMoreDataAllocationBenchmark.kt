@@ -0,0 +1,132 @@
+package org.nift4.gramophone.hificore
+
+import android.media.AudioAttributes
+import android.media.AudioManager
+import android.media.AudioMetadataReadMap
+import android.os.Build
+import android.os.Bundle
+import android.os.Debug
+import android.util.Log
+import androidx.test.ext.junit.runners.AndroidJUnit4
+import androidx.test.filters.LargeTest
+import androidx.test.platform.app.InstrumentationRegistry
+import org.junit.Assert.assertTrue
+import org.junit.Assume.assumeTrue
+import org.junit.Test
+import org.junit.runner.RunWith
+import java.nio.ByteBuffer
+import java.util.concurrent.atomic.AtomicLong
+
+/**
+ * Compares the garbage produced by [NativeTrack.Callback.onMoreData] with and without
+ * [NativeTrack.setStagedCallbacks], by playing silence through a callback track for a few seconds and
+ * reading the runtime's allocation counter. Other threads allocate into that counter too, so both
+ * modes are measured [REPETITIONS] times in turns, all numbers are reported through
+ * Instrumentation.sendStatus, and only a clear difference of the medians counts. Run on a real
+ * device:
+ * ```
+ * ./gradlew :hificore:connectedDebugAndroidTest
+ * ```
+ */
+@RunWith(AndroidJUnit4::class)
+@LargeTest
+class OnMoreDataAllocationBenchmark {
+	companion object {
+		private const val TAG = "OnMoreDataAllocBench"
+		private const val DURATION_MS = 3000L
+		private const val REPETITIONS = 5
+		// plain mode allocates at least a DirectByteBuffer per callback, which is larger than this
+		private const val MIN_SAVED_BYTES_PER_CALLBACK = 32.0
+	}
+
+	private data class Result(val callbacks: Long, val bytesAllocated: Long) {
+		val bytesPerCallback
+			get() = bytesAllocated.toDouble() / callbacks.coerceAtLeast(1)
+	}
+
+	private fun run(staged: Boolean): Result {
+		val context = InstrumentationRegistry.getInstrumentation().targetContext
+		val callbacks = AtomicLong(0)
+		val track = NativeTrack(
+			context, AudioAttributes.Builder().setUsage(AudioAttributes.USAGE_MEDIA).build(),
+			AudioManager.STREAM_MUSIC, 48000, 0x5U /* float */, 0x3U /* stereo */, null, 0,
+			context.getSystemService(AudioManager::class.java).generateAudioSessionId(), 1.0f, null, 0, 0L,
+			hasVideo = false,
+			smallBuf = false,
+			isStreaming = false,
+			offloadBufferSize = 0,
+			notificationFrames = 0,
+			doNotReconnect = false,
+			transferMode = NativeTrack.Companion.TransferMode.Callback,
+			contentId = null,
+			syncId = null,
+			encapsulationMode = NativeTrack.ENCAPSULATION_MODE_NONE,
+			sharedMem = null
+		)
+		try {
+			track.setVolume(0f)
+			track.setStagedCallbacks(staged)
+			track.cb = object : NativeTrack.Callback {
+				override fun onUnderrun() {}
+				override fun onMarker(markerPosition: Int) {}
+				override fun onNewPos(newPos: Int) {}
+				override fun onStreamEnd() {}
+				override fun onNewIAudioTrack() {}
+				override fun onNewTimestamp(timestampMs: Int, timeNanoSec: Long) {}
+				override fun onLoopEnd(loopsRemaining: Int) {}
+				override fun onBufferEnd() {}
+				override fun onMoreData(frameCount: Long, buffer: ByteBuffer): Long {
+					callbacks.incrementAndGet()
+					val size = buffer.remaining()
+					while (buffer.remaining() >= 8) buffer.putLong(0L)
+					while (buffer.hasRemaining()) buffer.put(0)
+					return size.toLong()
+				}
+				override fun onCanWriteMoreData(frameCount: Long, sizeBytes: Long) {}
+				override fun onRoutingChanged() {}
+				override fun onCodecFormatChanged(metadata: AudioMetadataReadMap?) {}
+			}
+			track.start()
+			// let the callback thread attach and the staging buffer settle before measuring
+			Thread.sleep(500)
+			val startCallbacks = callbacks.get()
+			val startBytes = Debug.getRuntimeStat("art.gc.bytes-allocated").toLong()
+			Thread.sleep(DURATION_MS)
+			val bytes = Debug.getRuntimeStat("art.gc.bytes-allocated").toLong() - startBytes
+			val result = Result(callbacks.get() - startCallbacks, bytes)
+			track.stop()
+			return result
+		} finally {
+			track.release()
+		}
+	}
+
+	private fun List<Result>.medianBytesPerCallback() =
+		map { it.bytesPerCallback }.sorted()[size / 2]
+
+	private fun List<Result>.describe() = joinToString { "${it.callbacks} callbacks, " +
+			"${it.bytesAllocated} bytes (%.1f per callback)".format(it.bytesPerCallback) }
+
+	@Test
+	fun stagedCallbacksAllocateLess() {
+		assumeTrue(Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) // getRuntimeStat
+		val plain = ArrayList<Result>()
+		val staged = ArrayList<Result>()
+		repeat(REPETITIONS) {
+			plain.add(run(false))
+			staged.add(run(true))
+		}
+		val plainMedian = plain.medianBytesPerCallback()
+		val stagedMedian = staged.medianBytesPerCallback()
+		val message = "median bytes per callback: plain %.1f, staged %.1f".format(plainMedian,
+			stagedMedian) + "; plain: ${plain.describe()}; staged: ${staged.describe()}"
+		Log.i(TAG, message)
+		InstrumentationRegistry.getInstrumentation().sendStatus(0, Bundle().apply {
+			putString("allocations", message)
+			putDouble("plainBytesPerCallback", plainMedian)
+			putDouble("stagedBytesPerCallback", stagedMedian)
+		})
+		assertTrue("no callbacks happened", (plain + staged).all { it.callbacks > 0 })
+		assertTrue(message, plainMedian - stagedMedian >= MIN_SAVED_BYTES_PER_CALLBACK)
+	}
+}
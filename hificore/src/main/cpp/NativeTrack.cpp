@@ -26,9 +26,28 @@
 #include <unistd.h>
 #include <cstdlib>
 #include <vector>
-#include <map>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <ctime>
 #include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <sys/resource.h>
 #include "helpers.h"
+#include "pcm_ring_buffer.h"
+#include "latency_histogram.h"
+#include "cpu_topology.h"
+#include "jni_cache.h"
+#include "struct_offsets.h"
+#include "compressor/dynamic_range_compression.h"
+#include "compressor/lookahead_limiter.h"
 #include "audio-legacy.h"
 
 extern void *libaudioclient_handle;
@@ -186,6 +205,102 @@ static ZN7android10AudioTrack12obtainBufferEPNS0_6BufferEiPj_t ZN7android10Audio
 typedef void(*ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE_t)(void* thisptr, android::AudioTrack::Buffer* buf);
 static ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE_t ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE = nullptr;
 
+// Snapshot of frequently polled track state, refreshed by a native thread and read from Kotlin
+// through a direct ByteBuffer without any JNI call. Protected by a seqlock: seq is odd while the
+// page is being written, and readers retry if it was odd or changed while they were reading.
+// Offsets are mirrored in NativeTrack.kt.
+struct status_page {
+    std::atomic<uint32_t> seq;
+    int32_t reserved;
+    int64_t updateTimeNs; // CLOCK_MONOTONIC
+    int64_t positionStatus;
+    int64_t position;
+    int64_t timestampStatus;
+    int64_t timestampPosition;
+    int64_t timestampNs;
+    int64_t underrunFrames;
+    int64_t pendingDurationMs; // -1 if unavailable
+    int64_t queuedBytes; // -1 without writer thread or pull mode
+    int64_t routedDeviceId;
+    int64_t died;
+};
+static_assert(sizeof(status_page) == 96);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+// threads which can be tuned with setThreadSchedulingInternal, must match NativeTrack.SchedThread
+#define SCHED_THREAD_CALLBACK 0 // the AudioTrackThread which calls MyCallback
+#define SCHED_THREAD_WRITER 1 // see writerLoop
+#define SCHED_THREAD_COUNT 2
+struct sched_request {
+    bool set;
+    int32_t fifoPriority; // 0 to stay SCHED_OTHER
+    int32_t nice; // used for SCHED_OTHER, and if SCHED_FIFO is not allowed
+    int32_t cluster; // CPU_CLUSTER_*
+
+    // Packed into one word, so that the callback thread can read it without taking a lock.
+    uint32_t pack() const {
+        return (set ? 1u : 0u) | (uint32_t) fifoPriority << 8 | (uint32_t) (nice + 20) << 16
+                | (uint32_t) cluster << 24;
+    }
+    static sched_request unpack(uint32_t packed) {
+        return {
+                .set = (packed & 1) != 0,
+                .fifoPriority = (int32_t) ((packed >> 8) & 0xff),
+                .nice = (int32_t) ((packed >> 16) & 0xff) - 20,
+                .cluster = (int32_t) ((packed >> 24) & 0xff),
+        };
+    }
+};
+
+// Sequence numbers of buffers handed out by obtainBufferInternal, which releaseBuffer needs back.
+// AudioTrack only has one buffer out at a time, so a few slots are plenty, and unlike a map they
+// never allocate on the audio path. Only used by the thread doing obtain/release.
+struct sequence_table {
+    static constexpr size_t kSlots = 4;
+    struct slot {
+        void* raw;
+        uint32_t sequence;
+    };
+    slot slots[kSlots] = {};
+    bool put(void* raw, uint32_t sequence) {
+        for (auto& slot : slots) {
+            if (slot.raw == nullptr) {
+                slot = { raw, sequence };
+                return true;
+            }
+        }
+        return false;
+    }
+    bool take(void* raw, uint32_t* sequence) {
+        for (auto& slot : slots) {
+            if (slot.raw == raw) {
+                *sequence = slot.sequence;
+                slot.raw = nullptr;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// DSP settings of pull mode. The callback thread reads whichever one track_holder::pullConfig
+// points to, and the setters fill the other one and swap, see publishPullConfig.
+struct pull_config {
+    float gain = 1.0f;
+    le_fx::AdaptiveDynamicRangeCompression* drc = nullptr;
+    float drcInputAmp = 1.0f;
+    float drcKneeThreshold = 0.0f;
+    float drcPostAmp = 1.0f;
+    le_fx::LookaheadLimiter* limiter = nullptr;
+};
+
+// histograms in track_holder::latencyStats, must match NativeTrack.LatencyStat
+#define LATENCY_STAT_MORE_DATA_INTERVAL 0 // time between EVENT_MORE_DATA callbacks
+#define LATENCY_STAT_MORE_DATA_JITTER 1 // distance of that from the audio duration of the last one
+#define LATENCY_STAT_WRITE 2 // time spent in write()
+#define LATENCY_STAT_OBTAIN 3 // time spent in obtainBuffer()
+#define LATENCY_STAT_COUNT 4
+
 class MyCallback;
 struct track_holder {
     explicit track_holder(JNIEnv* env) {
@@ -205,8 +320,385 @@ struct track_holder {
     bool deathEmulation = false;
     bool died = false;
     JavaVM* vm = nullptr;
-    std::map<void*, uint32_t> sequences = {};
+    sequence_table sequences = {};
+    int32_t transferMode = 0;
+    // writer thread, see startWriterThread
+    std::unique_ptr<PcmRingBuffer> ring = nullptr;
+    // ring, for the status thread, which may be started before it's created
+    std::atomic<PcmRingBuffer*> statusRing = nullptr;
+    size_t ringFrameSize = 0;
+    std::thread writer;
+    std::mutex writerLock; // held by the writer thread while it's draining, not while it's idle
+    std::condition_variable writerCond;
+    std::atomic<bool> writerQuit = false;
+    // see writeArray
+    std::mutex stagingLock;
+    std::vector<std::unique_ptr<uint8_t[]>> stagingPool;
+    std::atomic<uint64_t> arrayWrites = 0;
+    std::atomic<uint64_t> arrayCopies = 0; // the VM copied the array instead of pinning it
+    std::atomic<uint64_t> stagedWrites = 0;
+    std::atomic<bool> stagedCallbacks = false; // see MyCallback::onMoreDataStaged
+    // status page, see startStatusPageInternal. the memory belongs to a Java direct buffer, which
+    // we keep a global ref to while the status thread runs.
+    status_page* statusPage = nullptr;
+    jobject statusPageBuffer = nullptr;
+    std::thread statusThread;
+    std::mutex statusLock;
+    std::condition_variable statusCond;
+    bool statusQuit = false; // guarded by statusLock
+    // pull mode, see startPullModeInternal. the callback thread never takes a lock in pull mode,
+    // settings and flushes are handed to it through atomics.
+    std::atomic<bool> pullMode = false;
+    size_t pullChannelCount = 0; // 0 unless the track is float, processors need float
+    std::mutex pullConfigLock; // serializes the setters
+    pull_config pullConfigs[2];
+    std::atomic<pull_config*> pullConfig = &pullConfigs[0];
+    std::atomic<uint32_t> pullCallbackEpoch = 0; // odd while pullMoreData runs
+    float pullAppliedGain = 1.0f; // callback thread only
+    std::atomic<bool> pullFlush = false;
+    std::atomic<size_t> pullFlushPos = 0; // ring write position at the last flush
+    std::atomic<uint64_t> pullUnderruns = 0;
+    std::atomic<bool> pullWantsData = false;
+    std::mutex pullNotifyLock;
+    jmethodID onPullDataNeeded = nullptr;
+    // scheduling of our threads, see setThreadSchedulingInternal. requests are written under
+    // schedLock and applied once the thread id is known, see noteSchedThread.
+    std::mutex schedLock;
+    std::atomic<pid_t> schedTids[SCHED_THREAD_COUNT] = {};
+    std::atomic<uint32_t> schedRequests[SCHED_THREAD_COUNT] = {}; // sched_request::pack()
+    // cores of each CPU_CLUSTER_*, read from sysfs before the first request is published
+    cpu_set_t schedClusterSets[CPU_CLUSTER_PRIME + 1] = {};
+    bool schedClustersKnown = false; // guarded by schedLock
+    // timing instrumentation, see getLatencyStatsInternal
+    LatencyHistogram latencyStats[LATENCY_STAT_COUNT];
+    int64_t lastMoreDataUs = 0; // callback thread only
+    uint64_t lastMoreDataFrames = 0; // callback thread only
+    std::atomic<bool> moreDataReset = false; // set on stop, pause and flush
 };
+// how long the writer thread sleeps when the ring is empty or the track is full. it is woken
+// up early by new data, but the track doesn't tell us when it has room again.
+#define WRITER_POLL_MS 5
+// blocking array writes are split into chunks of this size, see writeArray
+#define STAGING_BUFFER_SIZE 65536
+#define TRANSFER_CALLBACK 1
+#define TRANSFER_OBTAIN 2
+// fixed channel count: limit
+#define FCC_LIMIT 28
+#define TIMED_OUT (-110)
+#define WOULD_BLOCK (-11)
+static int64_t monotonicUs() {
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+static void recordLatency(track_holder* holder, int stat, int64_t sinceUs) {
+    holder->latencyStats[stat].record((uint64_t) std::max((int64_t) 0, monotonicUs() - sinceUs));
+}
+// Called at the start of every EVENT_MORE_DATA callback. Jitter is how much earlier or later the
+// callback came than the audio handed out by the last one would have lasted. The first callback
+// after a stop, pause or flush only starts a new interval, the gap before it isn't jitter.
+static void recordMoreData(track_holder* holder, uint64_t frameCount) {
+    const int64_t now = monotonicUs();
+    if (holder->moreDataReset.exchange(false, std::memory_order_relaxed)) {
+        holder->lastMoreDataUs = 0;
+    }
+    if (holder->lastMoreDataUs != 0) {
+        const int64_t interval = now - holder->lastMoreDataUs;
+        holder->latencyStats[LATENCY_STAT_MORE_DATA_INTERVAL].record(interval);
+        const uint32_t sampleRate = ZNK7android10AudioTrack13getSampleRateEv(holder->track);
+        if (sampleRate > 0) {
+            const auto expected = (int64_t) (holder->lastMoreDataFrames * 1000000 / sampleRate);
+            holder->latencyStats[LATENCY_STAT_MORE_DATA_JITTER].record(std::abs(interval - expected));
+        }
+    }
+    holder->lastMoreDataUs = now;
+    holder->lastMoreDataFrames = frameCount;
+}
+// Applies a scheduling request to a thread. Only syscalls, no locks or file I/O, so that the
+// callback thread can do this itself. Doesn't have to run on the thread, all of these take a
+// thread id.
+static void applySched(track_holder* holder, pid_t tid, const sched_request& req) {
+    bool fifo = false;
+    if (req.fifoPriority > 0) {
+        sched_param param = { .sched_priority = req.fifoPriority };
+        // apps usually don't have RLIMIT_RTPRIO, in which case this fails and nice is used
+        if (sched_setscheduler(tid, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == 0) {
+            fifo = true;
+        } else {
+            ALOGW("SCHED_FIFO %d denied for thread %d: %s", req.fifoPriority, tid, strerror(errno));
+        }
+    }
+    if (!fifo) {
+        sched_param param = { .sched_priority = 0 };
+        if (sched_getscheduler(tid) != SCHED_OTHER)
+            sched_setscheduler(tid, SCHED_OTHER, &param);
+        if (setpriority(PRIO_PROCESS, tid, req.nice) != 0) {
+            ALOGW("setpriority %d failed for thread %d: %s", req.nice, tid, strerror(errno));
+        }
+    }
+    const cpu_set_t& set = holder->schedClusterSets[req.cluster];
+    // fails if the thread's cpuset cgroup doesn't allow any of these cores
+    if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+        ALOGW("failed to pin thread %d to cluster %d: %s", tid, req.cluster, strerror(errno));
+    }
+}
+// Called on the thread itself, once, before anything else. Lock-free: the thread id and the
+// requests are both published seq_cst, so either setThreadSchedulingInternal sees the id and
+// applies the request, or we see the request, or both. In the last case we re-check after
+// applying, so that an older request can't win over a newer one which was applied meanwhile.
+static void noteSchedThread(track_holder* holder, int thread) {
+    const pid_t tid = gettid();
+    holder->schedTids[thread].store(tid);
+    uint32_t applied = 0;
+    uint32_t packed = holder->schedRequests[thread].load();
+    while (packed != applied) {
+        const sched_request req = sched_request::unpack(packed);
+        if (req.set)
+            applySched(holder, tid, req);
+        applied = packed;
+        packed = holder->schedRequests[thread].load();
+    }
+}
+// Called on the thread itself before it exits. Waits for a concurrent setThreadSchedulingInternal,
+// so that no request is applied to the thread id after it may have been reused.
+static void forgetSchedThread(track_holder* holder, int thread) {
+    std::lock_guard<std::mutex> lock(holder->schedLock);
+    holder->schedTids[thread].store(0);
+}
+// Copies up to size bytes (a multiple of the frame size) from the ring straight into the track's
+// buffer. Returns the amount of bytes copied or an error.
+static ssize_t writerObtain(track_holder* holder, PcmRingBuffer& ring, size_t size) {
+    android::AudioTrack::Buffer buffer;
+    buffer.frameCount = size / holder->ringFrameSize;
+    buffer.mSize = size;
+    size_t nonContig = 0;
+    // waitCount 1 waits for up to 10ms, so stopWriterThread() doesn't have to wait forever
+    const int64_t start = monotonicUs();
+    int32_t ret = ZN7android10AudioTrack12obtainBufferEPNS0_6BufferEiPj(holder->track, &buffer,
+                                                                        1, &nonContig);
+    recordLatency(holder, LATENCY_STAT_OBTAIN, start);
+    if (ret != 0)
+        return ret;
+    ring.copyOut(buffer.raw, buffer.frameCount * holder->ringFrameSize);
+    ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &buffer);
+    return (ssize_t) (buffer.frameCount * holder->ringFrameSize);
+}
+static void writerLoop(track_holder* holder) {
+    pthread_setname_np(pthread_self(), "NativeTrackWrite");
+    noteSchedThread(holder, SCHED_THREAD_WRITER);
+    PcmRingBuffer& ring = *holder->ring;
+    const size_t frameSize = holder->ringFrameSize;
+    // a frame which wraps around the end of the ring has to be copied to be written in one go
+    std::vector<uint8_t> wrappedFrame(frameSize);
+    ssize_t lastError = 0;
+    std::unique_lock<std::mutex> lock(holder->writerLock);
+    while (!holder->writerQuit.load(std::memory_order_relaxed)) {
+        const uint8_t* data;
+        size_t contiguous;
+        const size_t available = ring.peek(&data, &contiguous) / frameSize * frameSize;
+        if (available == 0 || holder->died) {
+            holder->writerCond.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS));
+            continue;
+        }
+        ssize_t written;
+        if (holder->transferMode == TRANSFER_OBTAIN) {
+            written = writerObtain(holder, ring, available);
+            if (written == TIMED_OUT)
+                continue; // already waited
+        } else {
+            contiguous = contiguous / frameSize * frameSize;
+            if (contiguous == 0) {
+                ring.copyOut(wrappedFrame.data(), frameSize);
+                data = wrappedFrame.data();
+                contiguous = frameSize;
+            }
+            const int64_t start = monotonicUs();
+            written = ZN7android10AudioTrack5writeEPKvjb(holder->track, (void*) data,
+                                                         contiguous, false);
+            recordLatency(holder, LATENCY_STAT_WRITE, start);
+        }
+        if (written > 0) {
+            ring.consume(written);
+            lastError = 0;
+            continue;
+        }
+        if (written < 0 && written != lastError) {
+            // paused or stopped tracks return errors too, only log once per kind of error
+            ALOGW("writer thread failed to write to track: %zd", written);
+            lastError = written;
+        }
+        holder->writerCond.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS));
+    }
+    lock.unlock();
+    forgetSchedThread(holder, SCHED_THREAD_WRITER);
+}
+// Serves EVENT_MORE_DATA from the ring without calling into Java. Whatever is queued is copied
+// into the track and processed in place there. If the ring runs low, the notifier thread is woken
+// up to tell Java, so that the callback thread never waits for it.
+static size_t pullMoreData(track_holder* holder, const android::AudioTrack::Buffer& buffer) {
+    // seq_cst pairs with publishPullConfig: either it sees the epoch odd and waits for us, or we
+    // see its new config
+    holder->pullCallbackEpoch.fetch_add(1);
+    const pull_config& config = *holder->pullConfig.load();
+    PcmRingBuffer& ring = *holder->ring;
+    if (holder->pullFlush.exchange(false, std::memory_order_acquire)) {
+        ring.dropUntil(holder->pullFlushPos.load(std::memory_order_relaxed));
+    }
+    const size_t frameSize = holder->ringFrameSize;
+    const uint8_t* data;
+    size_t contiguous;
+    const size_t size = std::min(ring.peek(&data, &contiguous), buffer.mSize) / frameSize * frameSize;
+    ring.copyOut(buffer.raw, size);
+    ring.consume(size);
+    if (size < buffer.mSize) {
+        holder->pullUnderruns++;
+    }
+    const size_t channelCount = holder->pullChannelCount;
+    if (size > 0 && channelCount > 0) {
+        auto out = (float*) buffer.raw;
+        const size_t frameCount = size / frameSize;
+        if (config.gain != 1.0f || holder->pullAppliedGain != 1.0f) {
+            float from[FCC_LIMIT], to[FCC_LIMIT];
+            std::fill(from, from + channelCount, holder->pullAppliedGain);
+            std::fill(to, to + channelCount, config.gain);
+            le_fx::ApplyGain(channelCount, from, to, out, out, frameCount);
+            holder->pullAppliedGain = config.gain;
+        }
+        if (config.drc) {
+            config.drc->Compress(channelCount, config.drcInputAmp, config.drcKneeThreshold,
+                                 config.drcPostAmp, out, out, frameCount);
+        }
+        if (config.limiter) {
+            config.limiter->Process(out, out, frameCount);
+        }
+    }
+    if (ring.size() <= ring.capacity() / 2 && !holder->pullWantsData.exchange(true)) {
+        holder->writerCond.notify_one();
+    }
+    holder->pullCallbackEpoch.fetch_add(1, std::memory_order_release);
+    return size;
+}
+// Hands new pull mode settings to the callback thread without ever blocking it. Must hold
+// pullConfigLock. Returns once the callback can't use the old settings anymore, so that the
+// caller may free processors which were removed, and the old slot may be reused next time. The
+// setters publish even if the track died for that reason, and only report DEAD_OBJECT afterwards.
+static void publishPullConfig(track_holder* holder, const pull_config& next) {
+    pull_config* current = holder->pullConfig.load(std::memory_order_relaxed);
+    pull_config* spare = current == &holder->pullConfigs[0] ? &holder->pullConfigs[1]
+                                                            : &holder->pullConfigs[0];
+    *spare = next;
+    holder->pullConfig.store(spare);
+    const uint32_t epoch = holder->pullCallbackEpoch.load();
+    if ((epoch & 1) == 0)
+        return; // no callback running, the next one sees the new settings
+    // the callback never blocks, so this is at most one buffer worth of processing
+    while (holder->pullCallbackEpoch.load(std::memory_order_acquire) == epoch) {
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+static void pullNotifierLoop(track_holder* holder) {
+    char name[16] = "NativeTrackPull";
+    struct {
+        jint version;
+        char *name;
+        jobject group;
+    } attachArgs = {.version = JNI_VERSION_1_6, .name = &name[0], .group = nullptr};
+    JNIEnv* env;
+    int ret = holder->vm->AttachCurrentThread(&env, &attachArgs);
+    if (ret != JNI_OK) {
+        ALOGE("failed to attach jni thread %d", ret);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(holder->pullNotifyLock);
+    while (!holder->writerQuit.load(std::memory_order_relaxed)) {
+        // the callback thread notifies without holding the lock, hence the timeout
+        holder->writerCond.wait_for(lock, std::chrono::milliseconds(WRITER_POLL_MS));
+        if (holder->died || !holder->pullWantsData.exchange(false))
+            continue;
+        lock.unlock();
+        env->CallVoidMethod(holder->thiz, holder->onPullDataNeeded, (jlong) holder->ring->size());
+        if (env->ExceptionCheck()) {
+            ALOGE("onPullDataNeeded threw");
+            env->ExceptionClear();
+        }
+        lock.lock();
+    }
+    ret = holder->vm->DetachCurrentThread();
+    if (ret != JNI_OK) {
+        ALOGE("failed to detach thread: %d", ret);
+    }
+}
+static void stopWriterThread(track_holder* holder) {
+    if (!holder->writer.joinable())
+        return;
+    holder->writerQuit = true;
+    holder->writerCond.notify_one();
+    holder->writer.join();
+}
+static void updateStatusPage(track_holder* holder) {
+    status_page fresh = {};
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fresh.updateTimeNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+    fresh.died = holder->died;
+    if (!holder->died) {
+        uint32_t position = 0;
+        fresh.positionStatus = ZN7android10AudioTrack11getPositionEPj(holder->track, &position);
+        fresh.position = position;
+        android::AudioTimestamp ts;
+        fresh.timestampStatus = ZN7android10AudioTrack12getTimestampERNS_14AudioTimestampE(holder->track, ts);
+        if (fresh.timestampStatus == 0) {
+            fresh.timestampPosition = ts.mPosition;
+            fresh.timestampNs = ts.mTime.tv_sec * 1000000000LL + ts.mTime.tv_nsec;
+        }
+        if (ZNK7android10AudioTrack17getUnderrunFramesEv) {
+            fresh.underrunFrames = ZNK7android10AudioTrack17getUnderrunFramesEv(holder->track);
+        }
+        fresh.pendingDurationMs = -1;
+        int32_t pending;
+        if (ZN7android10AudioTrack15pendingDurationEPiNS_17ExtendedTimestamp8LocationE
+                && ZN7android10AudioTrack15pendingDurationEPiNS_17ExtendedTimestamp8LocationE(
+                        holder->track, &pending, 1 /* LOCATION_SERVER */) == 0) {
+            fresh.pendingDurationMs = pending;
+        }
+        if (ZN7android10AudioTrack18getRoutedDeviceIdsEv) {
+            std::vector<int32_t> deviceIds = ZN7android10AudioTrack18getRoutedDeviceIdsEv(holder->track);
+            fresh.routedDeviceId = deviceIds.empty() ? 0 : deviceIds[0];
+        } else if (ZN7android10AudioTrack17getRoutedDeviceIdEv) {
+            fresh.routedDeviceId = ZN7android10AudioTrack17getRoutedDeviceIdEv(holder->track);
+        }
+    }
+    PcmRingBuffer* ring = holder->statusRing.load(std::memory_order_acquire);
+    fresh.queuedBytes = ring ? (int64_t) ring->size() : -1;
+    status_page* page = holder->statusPage;
+    const uint32_t seq = page->seq.load(std::memory_order_relaxed);
+    page->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy((uint8_t*) page + offsetof(status_page, updateTimeNs),
+           (uint8_t*) &fresh + offsetof(status_page, updateTimeNs),
+           sizeof(status_page) - offsetof(status_page, updateTimeNs));
+    page->seq.store(seq + 2, std::memory_order_release);
+}
+static void statusLoop(track_holder* holder, std::chrono::milliseconds period) {
+    pthread_setname_np(pthread_self(), "NativeTrackStat");
+    std::unique_lock<std::mutex> lock(holder->statusLock);
+    while (!holder->statusQuit) {
+        lock.unlock();
+        updateStatusPage(holder);
+        lock.lock();
+        holder->statusCond.wait_for(lock, period, [holder] { return holder->statusQuit; });
+    }
+}
+static void stopStatusThread(track_holder* holder) {
+    if (!holder->statusThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(holder->statusLock);
+        holder->statusQuit = true;
+    }
+    holder->statusCond.notify_one();
+    holder->statusThread.join();
+}
 static void myJniDetach(void* arg) {
     int ret = ((JavaVM*)arg)->DetachCurrentThread();
     if (ret != JNI_OK) {
@@ -225,32 +717,25 @@ class MyCallback : public virtual android::AudioTrack::IAudioTrackCallback {
     jmethodID mOnLoopEnd;
     jmethodID mOnBufferEnd;
     jmethodID mOnMoreData;
+    jmethodID mOnMoreDataStaged;
     jmethodID mOnCanWriteMoreData;
 public:
     MyCallback(track_holder& holder, JNIEnv* env, jobject jcallback) : RefBase(), mHolder(&holder) {
         static int idCounter = 0;
         mId = idCounter++;
         mCallback = env->NewGlobalRef(jcallback);
-        jclass callbackClass = env->GetObjectClass(mCallback);
-#define TRY_GET_JNI(FIELD, METHOD, SIGNATURE) \
-        FIELD = env->GetMethodID(callbackClass, METHOD, SIGNATURE); \
-        if (FIELD == nullptr) { \
-            ALOGI("callback does not have matching " METHOD SIGNATURE " method, " \
-                "assuming it does not care"); \
-            env->ExceptionClear(); \
-        }
-        TRY_GET_JNI(mOnUnderrun, "onUnderrun", "()V")
-        TRY_GET_JNI(mOnMarker, "onMarker", "(I)V")
-        TRY_GET_JNI(mOnNewPos, "onNewPos", "(I)V")
-        TRY_GET_JNI(mOnStreamEnd, "onStreamEnd", "()V")
-        TRY_GET_JNI(mOnNewIAudioTrack, "onNewIAudioTrack", "()V")
-        TRY_GET_JNI(mOnNewTimestamp, "onNewTimestamp", "(IJ)V")
-        TRY_GET_JNI(mOnLoopEnd, "onLoopEnd", "(I)V")
-        TRY_GET_JNI(mOnBufferEnd, "onBufferEnd", "()V")
-        TRY_GET_JNI(mOnMoreData, "onMoreData", "(JLjava/nio/ByteBuffer;)J")
-        TRY_GET_JNI(mOnCanWriteMoreData, "onCanWriteMoreData", "(JJ)V")
-#undef TRY_GET_JNI
-        env->DeleteLocalRef(callbackClass);
+        // resolved in JNI_OnLoad, a missing method means the callback does not care
+        mOnUnderrun = gJniCache.onUnderrun;
+        mOnMarker = gJniCache.onMarker;
+        mOnNewPos = gJniCache.onNewPos;
+        mOnStreamEnd = gJniCache.onStreamEnd;
+        mOnNewIAudioTrack = gJniCache.onNewIAudioTrack;
+        mOnNewTimestamp = gJniCache.onNewTimestamp;
+        mOnLoopEnd = gJniCache.onLoopEnd;
+        mOnBufferEnd = gJniCache.onBufferEnd;
+        mOnMoreData = gJniCache.onMoreData;
+        mOnMoreDataStaged = gJniCache.onMoreDataStaged;
+        mOnCanWriteMoreData = gJniCache.onCanWriteMoreData;
     };
     void onUnderrun() override {
         if (!mCallback || mHolder->died || !mOnUnderrun || !maybeAttachThread(__func__)) return;
@@ -297,13 +782,53 @@ public:
         mEnv->CallVoidMethod(mCallback, mOnBufferEnd);
     }
     size_t onMoreData(const android::AudioTrack::Buffer &buffer) override {
+        // pull mode never attaches to the VM, so the thread can't be noted there
+        noteThread();
+        if (mHolder)
+            recordMoreData(mHolder, buffer.frameCount);
+        if (mHolder && mHolder->pullMode.load(std::memory_order_acquire))
+            return pullMoreData(mHolder, buffer);
         if (!mCallback || mHolder->died || !mOnMoreData || !maybeAttachThread(__func__)) return 0;
+        if (mHolder->stagedCallbacks.load(std::memory_order_relaxed) && mOnMoreDataStaged)
+            return onMoreDataStaged(buffer);
         jobject buf = mEnv->NewDirectByteBuffer(buffer.raw, (jlong) (uint64_t) buffer.mSize);
-        auto ret = (size_t) mEnv->CallLongMethod(mCallback, mOnMoreData, buf,
-                                                     (jlong) (uint64_t) buffer.frameCount);
+        auto ret = (size_t) mEnv->CallLongMethod(mCallback, mOnMoreData,
+                                                 (jlong) (uint64_t) buffer.frameCount, buf);
         mEnv->DeleteLocalRef(buf);
         return ret;
     }
+    // Same as onMoreData, but Java fills a long-lived direct buffer over mStaging which is then
+    // copied into the track, so that no ByteBuffer has to be allocated per callback. The staging
+    // buffer grows to the largest request, which is bounded by the track's frame count.
+    size_t onMoreDataStaged(const android::AudioTrack::Buffer &buffer) {
+        if (buffer.mSize > mStagingSize || mStagingBuffer == nullptr) {
+            if (mStagingBuffer) {
+                mEnv->DeleteGlobalRef(mStagingBuffer);
+                mStagingBuffer = nullptr;
+            }
+            mStaging = std::make_unique<uint8_t[]>(buffer.mSize);
+            mStagingSize = buffer.mSize;
+            jobject buf = mEnv->NewDirectByteBuffer(mStaging.get(), (jlong) mStagingSize);
+            if (buf == nullptr) {
+                ALOGE("Out of memory, can't create staging buffer");
+                mEnv->ExceptionClear();
+                return 0;
+            }
+            mStagingBuffer = mEnv->NewGlobalRef(buf);
+            mEnv->DeleteLocalRef(buf);
+        }
+        jlong ret = mEnv->CallLongMethod(mCallback, mOnMoreDataStaged,
+                                         (jlong) (uint64_t) buffer.frameCount, mStagingBuffer,
+                                         (jint) buffer.mSize);
+        if (mEnv->ExceptionCheck()) {
+            ALOGE("onMoreDataStaged threw");
+            mEnv->ExceptionClear();
+            return 0;
+        }
+        const size_t size = std::min((size_t) std::max(ret, (jlong) 0), buffer.mSize);
+        memcpy(buffer.raw, mStaging.get(), size);
+        return size;
+    }
     size_t onCanWriteMoreData(const android::AudioTrack::Buffer &buffer) override {
         if (!mCallback || mHolder->died || !mOnCanWriteMoreData || !maybeAttachThread(__func__)) return 0;
         // this method is a bit of a misnomer, we're supposed to never write in the buffer and
@@ -317,6 +842,9 @@ public:
         mAttached = false; // we're probably _not_ on the callback thread anymore, invalidate mEnv
         if (maybeAttachThread(__func__)) {
             mEnv->DeleteGlobalRef(mCallback);
+            if (mStagingBuffer) {
+                mEnv->DeleteGlobalRef(mStagingBuffer);
+            }
         } else {
             ALOGE("leaking callback reference %p because thread is not attached?!", mCallback);
         }
@@ -324,6 +852,7 @@ public:
         // method does not check if mCallback != null
         mEnv = nullptr;
         mCallback = nullptr;
+        mStagingBuffer = nullptr;
         mHolder = nullptr;
     }
     bool onIncStrongAttempted(uint32_t flags, const void *id) override {
@@ -331,10 +860,21 @@ public:
     }
     private:
     bool mAttached = false;
+    bool mSchedNoted = false;
     JNIEnv* mEnv = nullptr;
+    std::unique_ptr<uint8_t[]> mStaging = nullptr;
+    size_t mStagingSize = 0;
+    jobject mStagingBuffer = nullptr;
     int mId;
+    void noteThread() {
+        if (!mSchedNoted && mHolder) {
+            noteSchedThread(mHolder, SCHED_THREAD_CALLBACK);
+            mSchedNoted = true;
+        }
+    }
     bool maybeAttachThread(const char* caller) {
         // This relies on the fact that all callbacks will be called on the same thread.
+        noteThread();
         if (!mAttached) {
             JNIEnv* env;
             int ret = mHolder->vm->GetEnv((void**)&env, JNI_VERSION_1_6);
@@ -502,10 +1042,67 @@ static void callbackAdapter(int event, void* userptr, void* info) {
     }
 }
 
+static bool resolveSymbols();
+static std::atomic<bool> dlsym_done = false;
+
 extern "C" JNIEXPORT jboolean JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_initDlsym(JNIEnv* env, jobject) {
+    if (dlsym_done.load(std::memory_order_acquire))
+        return true;
+    int64_t start = symbolCacheNowNs();
     if (!initLib(env))
         return false;
+    int64_t expected = 0;
+    gSymbolCache.initLibNs.compare_exchange_strong(expected, symbolCacheNowNs() - start);
+    start = symbolCacheNowNs();
+    symbolCacheBeginBatch();
+    const bool ok = resolveSymbols();
+    symbolCacheEndBatch();
+    expected = 0;
+    gSymbolCache.dlsymNs.compare_exchange_strong(expected, symbolCacheNowNs() - start);
+    if (ok)
+        dlsym_done.store(true, std::memory_order_release);
+    return ok;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_initSymbolCacheInternal(
+        JNIEnv* env, jobject, jstring path, jstring fingerprint) {
+    const char* pathStr = env->GetStringUTFChars(path, nullptr);
+    const char* fingerprintStr = env->GetStringUTFChars(fingerprint, nullptr);
+    symbolCacheInit(pathStr, fingerprintStr);
+    env->ReleaseStringUTFChars(fingerprint, fingerprintStr);
+    env->ReleaseStringUTFChars(path, pathStr);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_initStructOffsetsInternal(
+        JNIEnv* env, jobject, jstring path, jstring fingerprint) {
+    const char* pathStr = env->GetStringUTFChars(path, nullptr);
+    const char* fingerprintStr = env->GetStringUTFChars(fingerprint, nullptr);
+    structOffsetsInit(pathStr, fingerprintStr);
+    env->ReleaseStringUTFChars(fingerprint, fingerprintStr);
+    env->ReleaseStringUTFChars(path, pathStr);
+}
+
+// out = { initLib ns, symbol resolution ns, probes skipped thanks to the cache, probes which
+// failed, whether the cache file matched this build }. Times are of the first initDlsym() call.
+extern "C" JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_getInitStatsInternal(
+        JNIEnv* env, jobject, jlongArray out) {
+    jlong stats[5];
+    stats[0] = gSymbolCache.initLibNs.load();
+    stats[1] = gSymbolCache.dlsymNs.load();
+    stats[2] = gSymbolCache.skippedProbes.load();
+    stats[3] = gSymbolCache.failedProbes.load();
+    {
+        std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+        stats[4] = gSymbolCache.loaded;
+    }
+    env->SetLongArrayRegion(out, 0, 5, stats);
+}
+
+static bool resolveSymbols() {
     if (android_get_device_api_level() >= 31) {
         DLSYM_OR_RETURN(libandroid_runtime, ZN7android19parcelForJavaObjectEP7_JNIEnvP8_jobject, false)
         DLSYM_OR_RETURN(libpermission, ZN7android7content22AttributionSourceState14readFromParcelEPKNS_6ParcelE, false)
@@ -548,6 +1145,9 @@ Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_initDlsym(JNIEnv*
 		DLSYM_OR_RETURN(libaudioclient, ZN7android10AudioTrack21getBufferDurationInUsEPl, false)
 		DLSYM_OR_RETURN(libaudioclient, ZN7android10AudioTrack15pendingDurationEPiNS_17ExtendedTimestamp8LocationE, false)
 		DLSYM_OR_RETURN(libaudioclient, ZN7android10AudioTrack12getTimestampEPNS_17ExtendedTimestampE, false)
+		DLSYM_OR_ELSE(libaudioclient, ZNK7android10AudioTrack17getUnderrunFramesEv) {
+			ALOGW("underrun frames will always be reported as 0");
+		}
 	}
 	DLSYM_OR_RETURN(libaudioclient, ZN7android10AudioTrack16getMinFrameCountEPm19audio_stream_type_tj, false)
     if (android_get_device_api_level() == 23) {
@@ -629,13 +1229,7 @@ Java_org_nift4_gramophone_hificore_NativeTrack_create(
         ZN7android10AudioTrackC1Ev(theTrack);
     }
     holder->thiz = env->NewGlobalRef(thiz);
-    jclass clazz = env->GetObjectClass(thiz);
-    holder->onAudioDeviceUpdate = env->GetMethodID(clazz, "onAudioDeviceUpdate", "(I[I)V");
-    if (holder->onAudioDeviceUpdate == nullptr) {
-        ALOGI("callback does not have onAudioDeviceUpdate(I[I)V, assuming it does not care");
-        env->ExceptionClear();
-    }
-    env->DeleteLocalRef(clazz);
+    holder->onAudioDeviceUpdate = gJniCache.onAudioDeviceUpdate;
     auto callback = new MyCallback(*holder, env, thiz);
     callback->incStrong(holder);
     if (android_get_device_api_level() >= 33) {
@@ -690,6 +1284,7 @@ Java_org_nift4_gramophone_hificore_NativeTrack_set(
         return INT32_MIN;
     }
     auto holder = (track_holder*) ptr;
+    holder->transferMode = transferMode;
     if (sharedMem) {
         holder->sharedMemoryBuffer = env->NewGlobalRef(sharedMem);
     }
@@ -992,37 +1587,36 @@ Java_org_nift4_gramophone_hificore_NativeTrack_getRealPtr(
     return (intptr_t)((track_holder*) ptr)->track;
 }
 
-extern "C" JNIEXPORT jint JNICALL
-Java_org_nift4_gramophone_hificore_NativeTrack_notificationFramesActFromOffset(
-        JNIEnv *, jobject, jlong ptr) {
-    auto holder = (track_holder*) ptr;
+// Hard-coded offset of AudioTrack::mNotificationFramesAct before P, or 0 if we don't know it for
+// this version.
+static intptr_t notificationFramesOffsetHint() {
     size_t extra;
     switch (android_get_device_api_level()) {
         case 27:
         case 26:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x228); // aarch64, x86_64
+            return 0x228; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1d8);
+            return 0x1d8;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1dc);
+            return 0x1dc;
 #endif
         case 25:
         case 24:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x220); // aarch64, x86_64
+            return 0x220; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1cc);
+            return 0x1cc;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1d4);
+            return 0x1d4;
 #endif
         case 23:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x214); // aarch64, x86_64
+            return 0x214; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1c0);
+            return 0x1c0;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1c8);
+            return 0x1c8;
 #endif
         case 22:
             extra =
@@ -1049,17 +1643,42 @@ Java_org_nift4_gramophone_hificore_NativeTrack_notificationFramesActFromOffset(
                 (0);
             break;
         default:
-            return INT32_MAX;
+            return 0;
     }
 #ifdef __LP64__
-    return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1ec + extra); // aarch64, x86_64
+    return 0x1ec + extra; // aarch64, x86_64
 #elif defined(i386)
-    return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1a4 + extra);
+    return 0x1a4 + extra;
 #else
-    return (int32_t)*(uint32_t*)((uintptr_t)holder->track + 0x1ac + extra);
+    return 0x1ac + extra;
 #endif
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_notificationFramesActFromOffset(
+        JNIEnv *, jobject, jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    intptr_t offset = structOffsetGet(STRUCT_OFFSET_TRACK_NOTIFICATION_FRAMES);
+    if (offset == STRUCT_OFFSET_UNKNOWN) {
+        offset = notificationFramesOffsetHint();
+        if (offset == 0)
+            return INT32_MAX;
+        // nothing else tells us the value before P, but every track notifies at least once per
+        // buffer and no buffer is that large, so this catches reading an unrelated field
+        const uint32_t value = *(uint32_t*)((uintptr_t)holder->track + offset);
+        if (value == 0 || value > 0x100000) {
+            ALOGE("mNotificationFramesAct at hard-coded offset %d is %u, this ROM may have a "
+                  "different layout", (int) offset, value);
+            structOffsetReject(STRUCT_OFFSET_TRACK_NOTIFICATION_FRAMES);
+            return INT32_MAX;
+        }
+        structOffsetSet(STRUCT_OFFSET_TRACK_NOTIFICATION_FRAMES, offset);
+    }
+    if (offset == STRUCT_OFFSET_INVALID)
+        return INT32_MAX;
+    return (int32_t)*(uint32_t*)((uintptr_t)holder->track + offset);
+}
+
 extern "C" JNIEXPORT jobject JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_getProxy(JNIEnv* env, jobject, jlong ptr, jint sessionId) {
     if (android_get_device_api_level() < 24) {
@@ -1068,41 +1687,35 @@ Java_org_nift4_gramophone_hificore_NativeTrack_getProxy(JNIEnv* env, jobject, jl
     }
     auto holder = (track_holder*)ptr;
     auto track = holder->track;
-    jclass at = env->FindClass("android/media/AudioTrack");
-    if (at == nullptr) {
-        ALOGE("android/media/AudioTrack does not exist?!");
-        return nullptr;
-    }
-    jmethodID ctor = env->GetMethodID(at, "<init>", "(J)V");
-    if (ctor == nullptr) {
+    if (!jniCacheEnsureAudioTrack(env)) {
         ALOGE("getProxy: didn't find android/media/AudioTrack.<init>(J)V");
         return nullptr;
     }
-    jmethodID setup = env->GetMethodID(at, "deferred_connect", "(J)V");
+    jclass at = gJniCache.audioTrack;
+    jmethodID ctor = gJniCache.audioTrackCtor;
+    jmethodID setup = gJniCache.audioTrackDeferredConnect;
     if (setup == nullptr) {
         ALOGE("getProxy: didn't find android/media/AudioTrack.deferred_connect(J)V");
         return nullptr;
     }
-    jmethodID regPb = env->GetMethodID(at, "baseRegisterPlayer", "(I)V");
+    jmethodID regPb = gJniCache.audioTrackBaseRegisterPlayer;
     if (regPb == nullptr) {
         ALOGE("getProxy: didn't find android/media/AudioTrack.baseRegisterPlayer(J)V");
         return nullptr;
     }
-    jmethodID setId = env->GetMethodID(at, "native_setPlayerIId", "(I)V");
+    jmethodID setId = gJniCache.audioTrackSetPlayerIId;
     if (setId == nullptr) {
         ALOGW("getProxy: didn't find android/media/AudioTrack.native_setPlayerIId(I)V");
 		if (android_get_device_api_level() >= 31) {
-			return nullptr; // throw
+			return nullptr;
 		}
-        env->ExceptionClear();
     }
-    jfieldID id = env->GetFieldID(at, "mPlayerIId", "I");
+    jfieldID id = gJniCache.audioTrackPlayerIId;
     if (id == nullptr) {
         ALOGW("getProxy: didn't find android/media/AudioTrack.mPlayerIId int");
 	    if (android_get_device_api_level() >= 31) {
-		    return nullptr; // throw
+		    return nullptr;
 	    }
-        env->ExceptionClear();
     }
     // creating with 0 and then using deferred_connect() skips PlayerBase registration, which
     // allows us to do it ourselves, but with our real session ID (almost like a real AudioTrack).
@@ -1130,7 +1743,6 @@ Java_org_nift4_gramophone_hificore_NativeTrack_getProxy(JNIEnv* env, jobject, jl
             return nullptr;
         }
     }
-    env->DeleteLocalRef(at);
     return proxy;
 }
 
@@ -1138,6 +1750,10 @@ extern "C" JNIEXPORT void JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_dtor(
         JNIEnv * env, jobject, jlong ptr) {
     auto holder = (track_holder*) ptr;
+    // the callback thread goes away with the track, before its id could be reused
+    forgetSchedThread(holder, SCHED_THREAD_CALLBACK);
+    stopWriterThread(holder);
+    stopStatusThread(holder);
     if (holder->deviceCallback) {
         fake_sp cb = {.thePtr=holder->deviceCallback};
         int ret = ZN7android10AudioTrack25removeAudioDeviceCallbackERKNS_2spINS_11AudioSystem19AudioDeviceCallbackEEE(holder->track, cb);
@@ -1161,6 +1777,9 @@ Java_org_nift4_gramophone_hificore_NativeTrack_dtor(
         env->DeleteGlobalRef(holder->sharedMemoryBuffer);
     }
     env->DeleteGlobalRef(holder->thiz);
+    if (holder->statusPageBuffer) {
+        env->DeleteGlobalRef(holder->statusPageBuffer);
+    }
     delete holder;
 }
 
@@ -1230,6 +1849,7 @@ JNIEXPORT void JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_stopInternal(JNIEnv *, jobject, jlong ptr) {
     auto holder = (track_holder*) ptr;
     ZN7android10AudioTrack4stopEv(holder->track);
+    holder->moreDataReset.store(true, std::memory_order_relaxed);
 }
 
 extern "C"
@@ -1243,7 +1863,22 @@ extern "C"
 JNIEXPORT void JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_flushInternal(JNIEnv *, jobject, jlong ptr) {
     auto holder = (track_holder*) ptr;
-    ZN7android10AudioTrack5flushEv(holder->track);
+    if (holder->pullMode.load(std::memory_order_acquire)) {
+        // the callback thread must never wait for us, so it drops what was queued until now by
+        // itself, the next time it runs
+        holder->pullFlushPos.store(holder->ring->writePosition(), std::memory_order_relaxed);
+        holder->pullFlush.store(true, std::memory_order_release);
+        ZN7android10AudioTrack5flushEv(holder->track);
+    } else if (holder->ring) {
+        // flush is called by the producer, and the writer thread doesn't touch the ring or the
+        // track while we hold the lock, so we can clear the ring on its behalf.
+        std::lock_guard<std::mutex> lock(holder->writerLock);
+        holder->ring->clear();
+        ZN7android10AudioTrack5flushEv(holder->track);
+    } else {
+        ZN7android10AudioTrack5flushEv(holder->track);
+    }
+    holder->moreDataReset.store(true, std::memory_order_relaxed);
 }
 
 extern "C"
@@ -1251,6 +1886,7 @@ JNIEXPORT void JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_pauseInternal(JNIEnv *, jobject, jlong ptr) {
     auto holder = (track_holder*) ptr;
     ZN7android10AudioTrack5pauseEv(holder->track);
+    holder->moreDataReset.store(true, std::memory_order_relaxed);
 }
 
 extern "C"
@@ -1398,6 +2034,8 @@ JNIEXPORT jint JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_getUnderrunFramesInternal(JNIEnv*, jobject,
                                                                          jlong ptr) {
     auto holder = (track_holder*) ptr;
+    if (!ZNK7android10AudioTrack17getUnderrunFramesEv)
+        return 0;
     return (int32_t)ZNK7android10AudioTrack17getUnderrunFramesEv(holder->track);
 }
 
@@ -1453,6 +2091,19 @@ Java_org_nift4_gramophone_hificore_NativeTrack_getTimestampInternal(JNIEnv* env,
     return ret;
 }
 
+// Cheap probe for a track that died while nobody called into it. getTimestamp() is one of the few
+// calls that notice a dead IAudioTrack: it restores the track if it may reconnect, and returns
+// DEAD_OBJECT otherwise. Idle tracks fail with other errors, which don't matter here.
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_isDeadInternal(JNIEnv*, jobject, jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    if (holder->died)
+        return true;
+    android::AudioTimestamp ts;
+    return ZN7android10AudioTrack12getTimestampERNS_14AudioTimestampE(holder->track, ts) == -32;
+}
+
 extern "C"
 JNIEXPORT jlong JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_writeInternal__JLjava_nio_ByteBuffer_2IIZ(JNIEnv *env,
@@ -1470,7 +2121,75 @@ Java_org_nift4_gramophone_hificore_NativeTrack_writeInternal__JLjava_nio_ByteBuf
         return INT32_MIN;
     }
     void* base = (void*)(buffer + offset);
-    return ZN7android10AudioTrack5writeEPKvjb(holder->track, base, size, blocking);
+    const int64_t start = monotonicUs();
+    ssize_t ret = ZN7android10AudioTrack5writeEPKvjb(holder->track, base, size, blocking);
+    recordLatency(holder, LATENCY_STAT_WRITE, start);
+    return ret;
+}
+
+// Writes size bytes starting at byte offset of a primitive array. Non-blocking writes never sleep,
+// so they can write straight from the pinned array. Blocking writes may sleep for a long time,
+// which we can't do while holding the pin (it holds off the GC), so they copy chunks of the array
+// into a staging buffer and write from there.
+static jlong writeArray(JNIEnv* env, track_holder* holder, jarray buf, size_t offset, size_t size,
+                        bool blocking) {
+    holder->arrayWrites++;
+    jboolean isCopy = JNI_FALSE;
+    if (!blocking) {
+        auto buffer = (uint8_t*) env->GetPrimitiveArrayCritical(buf, &isCopy);
+        if (buffer == nullptr) {
+            return INT32_MIN;
+        }
+        if (isCopy) {
+            holder->arrayCopies++;
+        }
+        const int64_t start = monotonicUs();
+        ssize_t ret = ZN7android10AudioTrack5writeEPKvjb(holder->track, buffer + offset, size, false);
+        recordLatency(holder, LATENCY_STAT_WRITE, start);
+        env->ReleasePrimitiveArrayCritical(buf, buffer, JNI_ABORT);
+        return ret;
+    }
+    holder->stagedWrites++;
+    std::unique_ptr<uint8_t[]> staging;
+    {
+        std::lock_guard<std::mutex> lock(holder->stagingLock);
+        if (!holder->stagingPool.empty()) {
+            staging = std::move(holder->stagingPool.back());
+            holder->stagingPool.pop_back();
+        }
+    }
+    if (!staging) {
+        staging = std::make_unique<uint8_t[]>(STAGING_BUFFER_SIZE);
+    }
+    ssize_t total = 0;
+    while (size > 0) {
+        const size_t chunk = std::min(size, (size_t) STAGING_BUFFER_SIZE);
+        auto buffer = (uint8_t*) env->GetPrimitiveArrayCritical(buf, &isCopy);
+        if (buffer == nullptr) {
+            total = total > 0 ? total : INT32_MIN;
+            break;
+        }
+        if (isCopy) {
+            holder->arrayCopies++;
+        }
+        memcpy(staging.get(), buffer + offset, chunk);
+        env->ReleasePrimitiveArrayCritical(buf, buffer, JNI_ABORT);
+        const int64_t start = monotonicUs();
+        ssize_t ret = ZN7android10AudioTrack5writeEPKvjb(holder->track, staging.get(), chunk, true);
+        recordLatency(holder, LATENCY_STAT_WRITE, start);
+        if (ret < 0) {
+            total = total > 0 ? total : ret;
+            break;
+        }
+        total += ret;
+        if ((size_t) ret < chunk)
+            break; // interrupted by stop, pause or flush
+        offset += chunk;
+        size -= chunk;
+    }
+    std::lock_guard<std::mutex> lock(holder->stagingLock);
+    holder->stagingPool.push_back(std::move(staging));
+    return total;
 }
 
 extern "C"
@@ -1482,14 +2201,7 @@ Java_org_nift4_gramophone_hificore_NativeTrack_writeInternal__J_3BIIZ(JNIEnv *en
     auto holder = (track_holder*) ptr;
     if (holder->died)
         return -32; // DEAD_OBJECT
-    jbyte* buffer = env->GetByteArrayElements(buf, nullptr);
-    if (buffer == nullptr) {
-        return INT32_MIN;
-    }
-    void* base = buffer + offset;
-    ssize_t ret = ZN7android10AudioTrack5writeEPKvjb(holder->track, base, size, blocking);
-    env->ReleaseByteArrayElements(buf, buffer, JNI_ABORT);
-    return ret;
+    return writeArray(env, holder, buf, offset, size, blocking);
 }
 
 extern "C"
@@ -1501,14 +2213,395 @@ Java_org_nift4_gramophone_hificore_NativeTrack_writeInternal__J_3FIIZ(JNIEnv *en
 	auto holder = (track_holder*) ptr;
 	if (holder->died)
 		return -32; // DEAD_OBJECT
-	jfloat* buffer = env->GetFloatArrayElements(buf, nullptr);
-	if (buffer == nullptr) {
-		return INT32_MIN;
-	}
-	void* base = buffer + offset;
-	ssize_t ret = ZN7android10AudioTrack5writeEPKvjb(holder->track, base, size * sizeof(jfloat), blocking);
-	env->ReleaseFloatArrayElements(buf, buffer, JNI_ABORT);
-	return ret;
+	return writeArray(env, holder, buf, offset * sizeof(jfloat), size * sizeof(jfloat), blocking);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_getArrayWriteStatsInternal(JNIEnv *env, jobject,
+                                                                          jlong ptr,
+                                                                          jlongArray out) {
+    auto holder = (track_holder*) ptr;
+    jlong stats[3] = { (jlong) holder->arrayWrites.load(), (jlong) holder->arrayCopies.load(),
+                       (jlong) holder->stagedWrites.load() };
+    env->SetLongArrayRegion(out, 0, 3, stats);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_startWriterThreadInternal(JNIEnv *, jobject,
+                                                                         jlong ptr,
+                                                                         jint capacity,
+                                                                         jint frame_size) {
+    auto holder = (track_holder*) ptr;
+    if (holder->ring) {
+        ALOGE("writer thread already started");
+        return false;
+    }
+    if (holder->transferMode != TRANSFER_OBTAIN && holder->transferMode != 3 /* SYNC */
+            && holder->transferMode != 5 /* SYNC_NOTIF_CALLBACK */) {
+        ALOGE("writer thread needs a track which can be written to, transfer mode is %d",
+              holder->transferMode);
+        return false;
+    }
+    if (frame_size < 1 || capacity < frame_size) {
+        ALOGE("bad writer thread arguments: capacity %d frame size %d", capacity, frame_size);
+        return false;
+    }
+    auto ring = std::make_unique<PcmRingBuffer>();
+    if (!ring->init(capacity)) {
+        ALOGE("failed to allocate ring buffer of %d bytes", capacity);
+        return false;
+    }
+    holder->ring = std::move(ring);
+    holder->statusRing.store(holder->ring.get(), std::memory_order_release);
+    holder->ringFrameSize = frame_size;
+    holder->writer = std::thread(writerLoop, holder);
+    return true;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_setStagedCallbacksInternal(JNIEnv *, jobject,
+                                                                          jlong ptr,
+                                                                          jboolean enabled) {
+    auto holder = (track_holder*) ptr;
+    holder->stagedCallbacks = enabled;
+}
+
+// The page lives in buf, a direct buffer allocated by Java, so that it stays valid for as long as
+// Java can read it, even after the track is released.
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_startStatusPageInternal(JNIEnv *env, jobject,
+                                                                       jlong ptr, jobject buf,
+                                                                       jint period_ms) {
+    auto holder = (track_holder*) ptr;
+    if (holder->statusPage) {
+        ALOGE("status page already started");
+        return false;
+    }
+    if (period_ms < 1) {
+        ALOGE("bad status page period %d", period_ms);
+        return false;
+    }
+    void* addr = env->GetDirectBufferAddress(buf);
+    if (addr == nullptr || env->GetDirectBufferCapacity(buf) < (jlong) sizeof(status_page)
+            || reinterpret_cast<uintptr_t>(addr) % alignof(status_page) != 0) {
+        ALOGE("status page buffer %p is not a direct buffer of %zu aligned bytes", addr,
+              sizeof(status_page));
+        return false;
+    }
+    holder->statusPageBuffer = env->NewGlobalRef(buf);
+    holder->statusPage = new (addr) status_page();
+    updateStatusPage(holder); // so that the first read doesn't see an empty page
+    holder->statusThread = std::thread(statusLoop, holder, std::chrono::milliseconds(period_ms));
+    return true;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_startPullModeInternal(JNIEnv *env, jobject,
+                                                                     jlong ptr, jint capacity,
+                                                                     jint frame_size,
+                                                                     jint float_channel_count) {
+    auto holder = (track_holder*) ptr;
+    if (holder->ring) {
+        ALOGE("writer thread or pull mode already started");
+        return false;
+    }
+    if (holder->transferMode != TRANSFER_CALLBACK) {
+        ALOGE("pull mode needs a callback track, transfer mode is %d", holder->transferMode);
+        return false;
+    }
+    if (frame_size < 1 || capacity < frame_size || float_channel_count < 0
+            || float_channel_count > FCC_LIMIT) {
+        ALOGE("bad pull mode arguments: capacity %d frame size %d channel count %d", capacity,
+              frame_size, float_channel_count);
+        return false;
+    }
+    holder->onPullDataNeeded = gJniCache.onPullDataNeeded;
+    if (holder->onPullDataNeeded == nullptr) {
+        ALOGE("missing onPullDataNeeded method");
+        return false;
+    }
+    auto ring = std::make_unique<PcmRingBuffer>();
+    if (!ring->init(capacity)) {
+        ALOGE("failed to allocate ring buffer of %d bytes", capacity);
+        return false;
+    }
+    holder->ring = std::move(ring);
+    holder->statusRing.store(holder->ring.get(), std::memory_order_release);
+    holder->ringFrameSize = frame_size;
+    holder->pullChannelCount = float_channel_count;
+    holder->writer = std::thread(pullNotifierLoop, holder);
+    holder->pullMode.store(true, std::memory_order_release);
+    return true;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_setPullGainInternal(JNIEnv *, jobject, jlong ptr,
+                                                                   jfloat gain) {
+    auto holder = (track_holder*) ptr;
+    std::lock_guard<std::mutex> lock(holder->pullConfigLock);
+    pull_config next = *holder->pullConfig.load(std::memory_order_relaxed);
+    next.gain = gain;
+    publishPullConfig(holder, next);
+    return holder->died ? -32 /* DEAD_OBJECT */ : 0;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_setPullCompressorInternal(JNIEnv *, jobject,
+                                                                         jlong ptr, jlong drc_ptr,
+                                                                         jfloat input_amp,
+                                                                         jfloat knee_threshold,
+                                                                         jfloat post_amp) {
+    auto holder = (track_holder*) ptr;
+    std::lock_guard<std::mutex> lock(holder->pullConfigLock);
+    pull_config next = *holder->pullConfig.load(std::memory_order_relaxed);
+    next.drc = (le_fx::AdaptiveDynamicRangeCompression*) drc_ptr;
+    next.drcInputAmp = input_amp;
+    next.drcKneeThreshold = knee_threshold;
+    next.drcPostAmp = post_amp;
+    publishPullConfig(holder, next);
+    return holder->died ? -32 /* DEAD_OBJECT */ : 0;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_setPullLimiterInternal(JNIEnv *, jobject,
+                                                                      jlong ptr,
+                                                                      jlong limiter_ptr) {
+    auto holder = (track_holder*) ptr;
+    auto limiter = (le_fx::LookaheadLimiter*) limiter_ptr;
+    // Process() steps through the buffer by its own channel count
+    if (limiter && limiter->GetChannelCount() != holder->pullChannelCount) {
+        ALOGE("limiter has %zu channels, but the track has %zu", limiter->GetChannelCount(),
+              holder->pullChannelCount);
+        return -22; // BAD_VALUE
+    }
+    std::lock_guard<std::mutex> lock(holder->pullConfigLock);
+    pull_config next = *holder->pullConfig.load(std::memory_order_relaxed);
+    next.limiter = limiter;
+    publishPullConfig(holder, next);
+    return holder->died ? -32 /* DEAD_OBJECT */ : 0;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_getPullUnderrunsInternal(JNIEnv *, jobject,
+                                                                        jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    if (holder->died)
+        return -32; // DEAD_OBJECT
+    return (jlong) holder->pullUnderruns.load();
+}
+
+// out = { count, mean, max, p50, p90, p99, p99.9 } in microseconds for each LATENCY_STAT_*
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_getLatencyStatsInternal(JNIEnv *env, jobject,
+                                                                       jlong ptr,
+                                                                       jlongArray out) {
+    auto holder = (track_holder*) ptr;
+    jlong stats[LATENCY_STAT_COUNT * 7];
+    for (int i = 0; i < LATENCY_STAT_COUNT; i++) {
+        const LatencyHistogram& h = holder->latencyStats[i];
+        const uint64_t count = h.count();
+        jlong* row = &stats[i * 7];
+        row[0] = (jlong) count;
+        row[1] = count > 0 ? (jlong) (h.sum() / count) : 0;
+        row[2] = (jlong) h.max();
+        row[3] = (jlong) h.percentile(0.5);
+        row[4] = (jlong) h.percentile(0.9);
+        row[5] = (jlong) h.percentile(0.99);
+        row[6] = (jlong) h.percentile(0.999);
+    }
+    env->SetLongArrayRegion(out, 0, LATENCY_STAT_COUNT * 7, stats);
+}
+
+extern "C"
+JNIEXPORT jstring JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_dumpLatencyStatsInternal(JNIEnv *env, jobject,
+                                                                        jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    static const char* names[LATENCY_STAT_COUNT] = {
+            "more data interval", "more data jitter", "write", "obtainBuffer" };
+    std::string result = "NativeTrack latency stats\n";
+    char line[160];
+    for (int i = 0; i < LATENCY_STAT_COUNT; i++) {
+        const LatencyHistogram& h = holder->latencyStats[i];
+        const uint64_t count = h.count();
+        snprintf(line, sizeof(line), " %s: count(%llu), mean(%llu us), max(%llu us), "
+                                     "p50(%llu us), p99(%llu us)\n", names[i],
+                 (unsigned long long) count, (unsigned long long) (count > 0 ? h.sum() / count : 0),
+                 (unsigned long long) h.max(), (unsigned long long) h.percentile(0.5),
+                 (unsigned long long) h.percentile(0.99));
+        result += line;
+        h.dumpBuckets(result);
+    }
+    return env->NewStringUTF(result.c_str());
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_resetLatencyStatsInternal(JNIEnv *, jobject,
+                                                                         jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    for (auto& h : holder->latencyStats) {
+        h.reset();
+    }
+}
+
+// Requests SCHED_FIFO at fifo_priority (or nice if that's 0 or not allowed) and pins the thread to
+// a cluster. If the thread isn't running yet, this is applied as soon as it starts. Failures are
+// only logged, check getThreadSchedulingInternal for what the thread actually got.
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_setThreadSchedulingInternal(JNIEnv *, jobject,
+                                                                           jlong ptr,
+                                                                           jint thread,
+                                                                           jint fifo_priority,
+                                                                           jint nice,
+                                                                           jint cluster) {
+    auto holder = (track_holder*) ptr;
+    if (thread < 0 || thread >= SCHED_THREAD_COUNT || cluster < CPU_CLUSTER_ANY
+            || cluster > CPU_CLUSTER_PRIME || nice < -20 || nice > 19) {
+        ALOGE("bad scheduling request: thread %d cluster %d nice %d", thread, cluster, nice);
+        return false;
+    }
+    if (fifo_priority < 0 || fifo_priority > sched_get_priority_max(SCHED_FIFO)) {
+        ALOGE("bad SCHED_FIFO priority %d", fifo_priority);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(holder->schedLock);
+    if (!holder->schedClustersKnown) {
+        // sysfs reads, keep them off the threads which are being tuned
+        for (int i = CPU_CLUSTER_ANY; i <= CPU_CLUSTER_PRIME; i++) {
+            cpuClusterSet(i, &holder->schedClusterSets[i]);
+        }
+        holder->schedClustersKnown = true;
+    }
+    const sched_request req = {
+            .set = true,
+            .fifoPriority = fifo_priority,
+            .nice = nice,
+            .cluster = cluster,
+    };
+    holder->schedRequests[thread].store(req.pack());
+    const pid_t tid = holder->schedTids[thread].load();
+    if (tid != 0)
+        applySched(holder, tid, req);
+    return true;
+}
+
+// out = { tid, policy, rt priority, nice, affinity of the first 64 cores }. Returns false if the
+// thread isn't known (yet).
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_getThreadSchedulingInternal(JNIEnv *env, jobject,
+                                                                           jlong ptr,
+                                                                           jint thread,
+                                                                           jlongArray out) {
+    auto holder = (track_holder*) ptr;
+    if (thread < 0 || thread >= SCHED_THREAD_COUNT)
+        return false;
+    std::lock_guard<std::mutex> lock(holder->schedLock);
+    const pid_t tid = holder->schedTids[thread].load(std::memory_order_relaxed);
+    if (tid == 0)
+        return false;
+    jlong result[5] = { tid, -1, 0, 0, 0 };
+    result[1] = sched_getscheduler(tid);
+    sched_param param = {};
+    if (sched_getparam(tid, &param) == 0)
+        result[2] = param.sched_priority;
+    errno = 0;
+    const int prio = getpriority(PRIO_PROCESS, tid);
+    result[3] = errno == 0 ? prio : 0;
+    cpu_set_t set;
+    if (sched_getaffinity(tid, sizeof(set), &set) == 0) {
+        for (int i = 0; i < 64; i++) {
+            if (CPU_ISSET(i, &set)) result[4] |= 1LL << i;
+        }
+    }
+    env->SetLongArrayRegion(out, 0, 5, result);
+    return true;
+}
+
+// Enqueues as much as fits and returns the amount of bytes enqueued, without ever blocking.
+// Only whole frames are written to the track, so callers should enqueue whole frames too.
+static jlong queueToRing(track_holder* holder, const void* data, size_t size) {
+    if (holder->ring == nullptr) {
+        ALOGE("queue called without a writer thread or pull mode");
+        return INT32_MIN;
+    }
+    PcmRingBuffer& ring = *holder->ring;
+    const bool wasEmpty = ring.size() < holder->ringFrameSize;
+    const size_t written = ring.write(data, size);
+    if (wasEmpty && written > 0) {
+        holder->writerCond.notify_one();
+    }
+    return (jlong) written;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_queueInternal__JLjava_nio_ByteBuffer_2II(
+        JNIEnv *env, jobject, jlong ptr, jobject buf, jint offset, jint size) {
+    auto holder = (track_holder*) ptr;
+    if (holder->died)
+        return -32; // DEAD_OBJECT
+    auto buffer = reinterpret_cast<uintptr_t>(env->GetDirectBufferAddress(buf));
+    if (buffer == 0) {
+        return INT32_MIN;
+    }
+    const jlong capacity = env->GetDirectBufferCapacity(buf);
+    if (offset < 0 || size < 0 || (jlong) offset + size > capacity) {
+        ALOGE("queue out of bounds: offset %d size %d capacity %lld", offset, size,
+              (long long) capacity);
+        return -22; // BAD_VALUE
+    }
+    return queueToRing(holder, (void*)(buffer + offset), size);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_queueInternal__J_3BII(JNIEnv *env, jobject,
+                                                                    jlong ptr, jbyteArray buf,
+                                                                    jint offset, jint size) {
+    auto holder = (track_holder*) ptr;
+    if (holder->died)
+        return -32; // DEAD_OBJECT
+    const jsize length = env->GetArrayLength(buf);
+    if (offset < 0 || size < 0 || (jlong) offset + size > length) {
+        ALOGE("queue out of bounds: offset %d size %d length %d", offset, size, length);
+        return -22; // BAD_VALUE
+    }
+    holder->arrayWrites++;
+    jboolean isCopy = JNI_FALSE;
+    auto buffer = (jbyte*) env->GetPrimitiveArrayCritical(buf, &isCopy);
+    if (buffer == nullptr) {
+        return INT32_MIN;
+    }
+    if (isCopy) {
+        holder->arrayCopies++;
+    }
+    jlong ret = queueToRing(holder, buffer + offset, size);
+    env->ReleasePrimitiveArrayCritical(buf, buffer, JNI_ABORT);
+    return ret;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_queuedBytesInternal(JNIEnv *, jobject, jlong ptr) {
+    auto holder = (track_holder*) ptr;
+    if (holder->ring == nullptr) {
+        ALOGE("queuedBytes called without a writer thread or pull mode");
+        return -1;
+    }
+    return (jlong) holder->ring->size();
 }
 
 extern "C"
@@ -1524,8 +2617,10 @@ Java_org_nift4_gramophone_hificore_NativeTrack_obtainBufferInternal(JNIEnv *env,
     temp.frameCount = requested_frame_count;
     temp.mSize = requested_frame_count * frame_size; // technically not needed
     size_t nonContig = 0;
+    const int64_t start = monotonicUs();
     int32_t ret = ZN7android10AudioTrack12obtainBufferEPNS0_6BufferEiPj(holder->track, &temp,
                                                                         waitCount, &nonContig);
+    recordLatency(holder, LATENCY_STAT_OBTAIN, start);
     if (nc != nullptr) {
         jlong* arr = env->GetLongArrayElements(nc, nullptr);
         arr[0] = nonContig;
@@ -1543,7 +2638,14 @@ Java_org_nift4_gramophone_hificore_NativeTrack_obtainBufferInternal(JNIEnv *env,
         ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &temp);
         return nullptr;
     }
-    holder->sequences.emplace(temp.raw, temp.sequence);
+    if (!holder->sequences.put(temp.raw, temp.sequence)) {
+        ALOGE("more than %zu buffers obtained without releasing them, giving this one back",
+              sequence_table::kSlots);
+        temp.frameCount = 0;
+        temp.mSize = 0;
+        ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &temp);
+        return nullptr;
+    }
     return env->NewDirectByteBuffer(temp.raw, temp.mSize);
 }
 
@@ -1559,16 +2661,73 @@ Java_org_nift4_gramophone_hificore_NativeTrack_releaseBufferInternal(JNIEnv *env
     temp.raw = env->GetDirectBufferAddress(buf);
     temp.mSize = limit;
     temp.frameCount = limit / frame_size;
-    auto iter = holder->sequences.find(temp.raw);
-    if (iter != holder->sequences.end()) {
-        temp.sequence = iter->second;
-        holder->sequences.erase(iter);
-    } else {
+    if (!holder->sequences.take(temp.raw, &temp.sequence)) {
         ALOGE("sequence number of %p not found, this should NEVER happen and is a bug", temp.raw);
     }
     ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &temp);
 }
 
+// Copies size bytes (whole frames) from a direct buffer into the track with as many obtainBuffer /
+// releaseBuffer rounds as needed, so that the non-contiguous part after the end of the track's
+// ring is filled in the same JNI call. Only the first obtain waits (for waitCount), the rest take
+// what is available right away. Returns the amount of bytes copied or an error if none were.
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_obtainFillReleaseInternal(JNIEnv *env, jobject,
+                                                                         jlong ptr,
+                                                                         jint frame_size,
+                                                                         jobject buf, jint offset,
+                                                                         jint size,
+                                                                         jint waitCount) {
+    auto holder = (track_holder*) ptr;
+    if (holder->died)
+        return -32; // DEAD_OBJECT
+    auto src = (uint8_t*) env->GetDirectBufferAddress(buf);
+    if (src == nullptr || frame_size < 1) {
+        return INT32_MIN;
+    }
+    const jlong capacity = env->GetDirectBufferCapacity(buf);
+    if (offset < 0 || size < 0 || (jlong) offset + size > capacity) {
+        ALOGE("obtainFillRelease out of bounds: offset %d size %d capacity %lld", offset, size,
+              (long long) capacity);
+        return -22; // BAD_VALUE
+    }
+    src += offset;
+    size_t remaining = size / frame_size * frame_size;
+    jlong total = 0;
+    while (remaining > 0) {
+        android::AudioTrack::Buffer temp;
+        temp.frameCount = remaining / frame_size;
+        temp.mSize = remaining;
+        size_t nonContig = 0;
+        const int64_t start = monotonicUs();
+        int32_t ret = ZN7android10AudioTrack12obtainBufferEPNS0_6BufferEiPj(holder->track, &temp,
+                                                                            total == 0 ? waitCount : 0,
+                                                                            &nonContig);
+        recordLatency(holder, LATENCY_STAT_OBTAIN, start);
+        if (ret != 0) {
+            if (total > 0 || ret == WOULD_BLOCK || ret == TIMED_OUT)
+                break;
+            return ret;
+        }
+        if (temp.frameCount * frame_size != temp.mSize) {
+            ALOGE("obtainBuffer unexpected frame size frameCount(%zu) frameSize(%d) size(%zu)",
+                  temp.frameCount, frame_size, temp.mSize);
+            temp.frameCount = 0;
+            temp.mSize = 0;
+            ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &temp);
+            return total > 0 ? total : INT32_MIN;
+        }
+        memcpy(temp.raw, src + total, temp.mSize);
+        total += (jlong) temp.mSize;
+        remaining -= temp.mSize;
+        ZN7android10AudioTrack13releaseBufferEPKNS0_6BufferE(holder->track, &temp);
+        if (nonContig == 0)
+            break; // the track is full
+    }
+    return total;
+}
+
 extern "C"
 JNIEXPORT jboolean JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_pauseAndWaitInternal(JNIEnv *, jobject, jlong ptr, jlong timeout) {
@@ -1576,7 +2735,9 @@ Java_org_nift4_gramophone_hificore_NativeTrack_pauseAndWaitInternal(JNIEnv *, jo
     if (holder->died)
         return true;
     std::chrono::milliseconds millis(timeout);
-    return ZN7android10AudioTrack12pauseAndWaitERKNSt3__16chrono8durationIxNS1_5ratioILl1ELl1000EEEEE(holder->track, millis);
+    const bool ret = ZN7android10AudioTrack12pauseAndWaitERKNSt3__16chrono8durationIxNS1_5ratioILl1ELl1000EEEEE(holder->track, millis);
+    holder->moreDataReset.store(true, std::memory_order_relaxed);
+    return ret;
 }
 
 extern "C"
@@ -1670,7 +2831,7 @@ Java_org_nift4_gramophone_hificore_NativeTrack_getPlaybackRateInternal(JNIEnv *e
 	auto holder = (track_holder*) ptr;
 	audio_playback_rate rate = ZNK7android10AudioTrack15getPlaybackRateEv(holder->track);
 	env->SetFloatArrayRegion(speed_pitch, 0, 2, &rate.mSpeed);
-	return (jlong)rate.mStretchMode << 32 | rate.mFallbackMode;
+	return (jlong) ((uint64_t) rate.mStretchMode << 32 | (uint32_t) rate.mFallbackMode);
 }
 
 extern "C"
@@ -1700,6 +2861,128 @@ Java_org_nift4_gramophone_hificore_NativeTrack_pendingDurationInternal(JNIEnv *,
 	return (jlong)out << 32 | ret;
 }
 
+// bits for queryStateInternal, must match the QUERY_* constants in NativeTrack.kt
+#define QUERY_SAMPLE_RATE 0
+#define QUERY_ORIGINAL_SAMPLE_RATE 1
+#define QUERY_POSITION 2
+#define QUERY_BUFFER_POSITION 3
+#define QUERY_MARKER_POSITION 4
+#define QUERY_POSITION_UPDATE_PERIOD 5
+#define QUERY_OUTPUT 6
+#define QUERY_UNDERRUN_FRAMES 7
+#define QUERY_BUFFER_DURATION_US 8
+#define QUERY_STOPPED 9
+#define QUERY_HAS_STARTED 10
+#define QUERY_SELECTED_DEVICE 11
+#define QUERY_PLAYBACK_RATE 12
+#define QUERY_COUNT 13
+// the playback rate doesn't fit into one slot, its modes go into an extra one after the others
+#define QUERY_PLAYBACK_RATE_MODES QUERY_COUNT
+#define QUERY_RESULT_COUNT (QUERY_COUNT + 1)
+// value for queries whose symbol doesn't exist on this Android version
+#define QUERY_UNAVAILABLE INT64_MIN
+// Runs every query in mask and writes the results to out[bit], using the same encoding as the
+// single getters (status << 32 | data for the ones that have a status). This gets all of them
+// with one JNI transition. The track may have died, in which case the results are still written
+// (the getters only read local state), but DEAD_OBJECT is returned.
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_NativeTrack_queryStateInternal(JNIEnv *env, jobject,
+                                                                  jlong ptr, jint mask,
+                                                                  jlongArray out) {
+	auto holder = (track_holder*) ptr;
+	if (env->GetArrayLength(out) < QUERY_RESULT_COUNT) {
+		ALOGE("queryState result array too small");
+		return -22; // BAD_VALUE
+	}
+	jlong results[QUERY_RESULT_COUNT];
+	results[QUERY_PLAYBACK_RATE_MODES] = 0;
+	uint32_t data;
+	audio_playback_rate rate;
+	for (int i = 0; i < QUERY_COUNT; i++) {
+		if (!(mask & (1 << i))) {
+			results[i] = 0;
+			continue;
+		}
+		switch (i) {
+			case QUERY_SAMPLE_RATE:
+				results[i] = ZNK7android10AudioTrack13getSampleRateEv(holder->track);
+				break;
+			case QUERY_ORIGINAL_SAMPLE_RATE:
+				results[i] = ZNK7android10AudioTrack21getOriginalSampleRateEv
+						? ZNK7android10AudioTrack21getOriginalSampleRateEv(holder->track)
+						: QUERY_UNAVAILABLE;
+				break;
+			case QUERY_POSITION:
+				data = 0;
+				results[i] = (int64_t)(((uint64_t)ZN7android10AudioTrack11getPositionEPj(
+						holder->track, &data) << 32) | data);
+				break;
+			case QUERY_BUFFER_POSITION:
+				data = 0;
+				results[i] = (int64_t)(((uint64_t)ZN7android10AudioTrack17getBufferPositionEPj(
+						holder->track, &data) << 32) | data);
+				break;
+			case QUERY_MARKER_POSITION:
+				data = 0;
+				results[i] = (int64_t)(((uint64_t)ZNK7android10AudioTrack17getMarkerPositionEPj(
+						holder->track, &data) << 32) | data);
+				break;
+			case QUERY_POSITION_UPDATE_PERIOD:
+				data = 0;
+				results[i] = (int64_t)(((uint64_t)ZNK7android10AudioTrack23getPositionUpdatePeriodEPj(
+						holder->track, &data) << 32) | data);
+				break;
+			case QUERY_OUTPUT:
+				results[i] = (int32_t)ZNK7android10AudioTrack9getOutputEv(holder->track);
+				break;
+			case QUERY_UNDERRUN_FRAMES:
+				results[i] = ZNK7android10AudioTrack17getUnderrunFramesEv
+						? (jlong)ZNK7android10AudioTrack17getUnderrunFramesEv(holder->track)
+						: QUERY_UNAVAILABLE;
+				break;
+			case QUERY_BUFFER_DURATION_US:
+				if (ZN7android10AudioTrack21getBufferDurationInUsEPl) {
+					int64_t duration = 0;
+					int32_t ret = ZN7android10AudioTrack21getBufferDurationInUsEPl(holder->track,
+					                                                               &duration);
+					results[i] = ret != 0 ? (ret > 0 ? -1 : ret) : duration;
+				} else {
+					results[i] = QUERY_UNAVAILABLE;
+				}
+				break;
+			case QUERY_STOPPED:
+				results[i] = ZNK7android10AudioTrack7stoppedEv(holder->track);
+				break;
+			case QUERY_HAS_STARTED:
+				results[i] = ZN7android10AudioTrack10hasStartedEv
+						? ZN7android10AudioTrack10hasStartedEv(holder->track)
+						: QUERY_UNAVAILABLE;
+				break;
+			case QUERY_SELECTED_DEVICE:
+				results[i] = ZN7android10AudioTrack15getOutputDeviceEv
+						? ZN7android10AudioTrack15getOutputDeviceEv(holder->track)
+						: QUERY_UNAVAILABLE;
+				break;
+			case QUERY_PLAYBACK_RATE:
+				if (ZNK7android10AudioTrack15getPlaybackRateEv) {
+					// speed << 32 | pitch as raw float bits, same modes as getPlaybackRateInternal
+					rate = ZNK7android10AudioTrack15getPlaybackRateEv(holder->track);
+					results[i] = (jlong) ((uint64_t) std::bit_cast<uint32_t>(rate.mSpeed) << 32
+							| std::bit_cast<uint32_t>(rate.mPitch));
+					results[QUERY_PLAYBACK_RATE_MODES] = (jlong) ((uint64_t) rate.mStretchMode << 32
+							| (uint32_t) rate.mFallbackMode);
+				} else {
+					results[i] = QUERY_UNAVAILABLE;
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	env->SetLongArrayRegion(out, 0, QUERY_RESULT_COUNT, results);
+	return holder->died ? -32 /* DEAD_OBJECT */ : 0;
+}
 extern "C"
 JNIEXPORT jint JNICALL
 Java_org_nift4_gramophone_hificore_NativeTrack_getTimestamp2Internal(JNIEnv *env, jobject,
@@ -1725,4 +3008,36 @@ Java_org_nift4_gramophone_hificore_NativeTrack_00024Companion_getMinFrameCountIn
                                                                                        jint stream_type,
                                                                                        jint sample_rate_in_hz) {
 	return ZN7android10AudioTrack16getMinFrameCountEPm19audio_stream_type_tj(stream_type, sample_rate_in_hz);
-}
\ No newline at end of file
+}
+#define NATIVE_METHOD(NAME, SIGNATURE, FUNC) \
+    { NAME, SIGNATURE, (void*) Java_org_nift4_gramophone_hificore_NativeTrack_##FUNC }
+
+// The natives used for creating tracks and moving audio data, so that the first call of each of
+// them doesn't have to look up the mangled symbol name. All others are still found by name.
+bool registerNativeTrackNatives(JNIEnv* env, jclass clazz) {
+    static const JNINativeMethod methods[] = {
+        NATIVE_METHOD("create", "(Landroid/os/Parcel;)J", create),
+        NATIVE_METHOD("set", "(JIIIIIIIFIIJZZZIIIIIIZIIIILjava/nio/ByteBuffer;)I", set),
+        NATIVE_METHOD("getRealPtr", "(J)J", getRealPtr),
+        NATIVE_METHOD("notificationFramesActFromOffset", "(J)I", notificationFramesActFromOffset),
+        NATIVE_METHOD("getProxy", "(JI)Landroid/media/AudioTrack;", getProxy),
+        NATIVE_METHOD("dtor", "(J)V", dtor),
+        NATIVE_METHOD("startInternal", "(J)I", startInternal),
+        NATIVE_METHOD("stopInternal", "(J)V", stopInternal),
+        NATIVE_METHOD("flushInternal", "(J)V", flushInternal),
+        NATIVE_METHOD("pauseInternal", "(J)V", pauseInternal),
+        NATIVE_METHOD("writeInternal", "(JLjava/nio/ByteBuffer;IIZ)J",
+                      writeInternal__JLjava_nio_ByteBuffer_2IIZ),
+        NATIVE_METHOD("writeInternal", "(J[BIIZ)J", writeInternal__J_3BIIZ),
+        NATIVE_METHOD("writeInternal", "(J[FIIZ)J", writeInternal__J_3FIIZ),
+        NATIVE_METHOD("queueInternal", "(JLjava/nio/ByteBuffer;II)J",
+                      queueInternal__JLjava_nio_ByteBuffer_2II),
+        NATIVE_METHOD("queueInternal", "(J[BII)J", queueInternal__J_3BII),
+        NATIVE_METHOD("obtainBufferInternal", "(JII[JJ)Ljava/nio/ByteBuffer;", obtainBufferInternal),
+        NATIVE_METHOD("releaseBufferInternal", "(JILjava/nio/ByteBuffer;I)V", releaseBufferInternal),
+        NATIVE_METHOD("obtainFillReleaseInternal", "(JILjava/nio/ByteBuffer;III)J",
+                      obtainFillReleaseInternal),
+    };
+    return env->RegisterNatives(clazz, methods, sizeof(methods) / sizeof(methods[0])) == JNI_OK;
+}
+#undef NATIVE_METHOD
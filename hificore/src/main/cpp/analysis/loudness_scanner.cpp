@@ -0,0 +1,286 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG "LoudnessScanner"
+
+#include <android/log_macros.h>
+#include <jni.h>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../compressor/loudness_meter.h"
+#include "../cpu_topology.h"
+#include "../jni_cache.h"
+
+// Scans many tracks for loudness at once. Every track is a PcmProducer object on the Java side,
+// which is asked for float PCM until it runs dry. Tracks are spread over one work queue per
+// thread, and a thread which runs out of work steals from the back of the other queues, so a
+// few very long tracks don't leave the other threads idle at the end.
+//
+// Only track indices are queued. The producer of a track is fetched from the Java side when a
+// thread starts on it and its local ref is dropped when it is done, so only the tracks being
+// scanned hold a reference. Taking a global ref per track up front would overflow the global
+// reference table (about 51200 entries) for large libraries.
+
+// frames per read() call
+#define SCAN_BUFFER_FRAMES 8192
+// fixed channel count: limit
+#define FCC_LIMIT 28
+
+class LoudnessScanner {
+public:
+    LoudnessScanner(JNIEnv* env, jobject thiz, jint count) {
+        int err = env->GetJavaVM(&mVm);
+        if (err != JNI_OK) {
+            ALOGE("could not get JavaVM: %d. aborting!", err);
+            abort();
+        }
+        mThiz = env->NewGlobalRef(thiz);
+        mCount = count > 0 ? (size_t) count : 0;
+        // resolved in JNI_OnLoad, the scan threads can't see app classes
+        mGetSampleRate = gJniCache.producerGetSampleRate;
+        mGetChannelCount = gJniCache.producerGetChannelCount;
+        mRead = gJniCache.producerRead;
+        mClose = gJniCache.producerClose;
+        mOnTrackDone = gJniCache.scannerOnTrackDone;
+        mProducerAt = gJniCache.scannerProducerAt;
+        if (!mGetSampleRate || !mGetChannelCount || !mRead || !mClose || !mOnTrackDone
+                || !mProducerAt) {
+            ALOGE("missing java methods for the scanner");
+            mValid = false;
+        }
+    }
+
+    ~LoudnessScanner() {
+        cancel();
+        join();
+        JNIEnv* env;
+        if (mVm->GetEnv((void**)&env, JNI_VERSION_1_6) == JNI_OK) {
+            env->DeleteGlobalRef(mThiz);
+        } else {
+            ALOGE("destroyed on a detached thread, leaking global refs");
+        }
+    }
+
+    bool start(unsigned threadCount) {
+        if (!mValid || !mThreads.empty()) return false;
+        if (threadCount == 0) threadCount = bigCoreCount();
+        threadCount = std::max(1u, (unsigned) std::min((size_t) threadCount, mCount));
+        ALOGI("scanning %zu tracks with %u threads", mCount, threadCount);
+        for (unsigned i = 0; i < threadCount; i++) {
+            mQueues.emplace_back(std::make_unique<WorkQueue>());
+        }
+        for (size_t i = 0; i < mCount; i++) {
+            mQueues[i % threadCount]->tasks.push_back(i);
+        }
+        for (unsigned i = 0; i < threadCount; i++) {
+            mThreads.emplace_back(&LoudnessScanner::run, this, i);
+        }
+        return true;
+    }
+
+    void cancel() {
+        mCancelled = true;
+    }
+
+    void join() {
+        for (auto& thread : mThreads) {
+            if (thread.joinable()) thread.join();
+        }
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<size_t> tasks;
+    };
+
+    bool nextTask(size_t worker, size_t& task) {
+        {
+            WorkQueue& own = *mQueues[worker];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < mQueues.size(); i++) {
+            WorkQueue& victim = *mQueues[(worker + i) % mQueues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void run(size_t worker) {
+        char name[16] = {'\0'};
+        snprintf(name, sizeof(name), "LoudnessScan%zu", worker);
+        struct {
+            jint version;
+            char *name;
+            jobject group;
+        } attachArgs = {.version = JNI_VERSION_1_6, .name = &name[0], .group = nullptr};
+        JNIEnv* env;
+        int ret = mVm->AttachCurrentThread(&env, &attachArgs);
+        if (ret != JNI_OK) {
+            ALOGE("failed to attach jni thread %d", ret);
+            return;
+        }
+        le_fx::LoudnessMeter meter;
+        size_t task;
+        while (!mCancelled && nextTask(worker, task)) {
+            float results[4] = {};
+            bool ok = false;
+            jobject producer = env->CallObjectMethod(mThiz, mProducerAt, (jint) task);
+            if (env->ExceptionCheck() || producer == nullptr) {
+                ALOGE("could not get the producer for track %zu", task);
+                env->ExceptionClear();
+            } else {
+                ok = scanTrack(env, producer, meter, results);
+                env->CallVoidMethod(producer, mClose);
+                if (env->ExceptionCheck()) {
+                    ALOGE("PcmProducer.close() threw for track %zu", task);
+                    env->ExceptionClear();
+                }
+                env->DeleteLocalRef(producer);
+            }
+            if (mCancelled) break;
+            const int done = ++mDone;
+            {
+                // one callback at a time, so the java side doesn't need to synchronize
+                std::lock_guard<std::mutex> guard(mCallbackLock);
+                env->CallVoidMethod(mThiz, mOnTrackDone, (jint) task, (jint) done, (jboolean) ok,
+                                    results[0], results[1], results[2], results[3]);
+            }
+            if (env->ExceptionCheck()) {
+                ALOGE("onTrackDone threw for track %zu", task);
+                env->ExceptionClear();
+            }
+        }
+        ret = mVm->DetachCurrentThread();
+        if (ret != JNI_OK) {
+            ALOGE("failed to detach thread: %d", ret);
+        }
+    }
+
+    bool scanTrack(JNIEnv* env, jobject producer, le_fx::LoudnessMeter& meter, float* results) {
+        std::fill(results, results + 4, 0.0f);
+        const jint sampleRate = env->CallIntMethod(producer, mGetSampleRate);
+        const jint channelCount = env->CallIntMethod(producer, mGetChannelCount);
+        if (env->ExceptionCheck()) {
+            ALOGE("PcmProducer threw while getting the format");
+            env->ExceptionClear();
+            return false;
+        }
+        if (channelCount < 1 || channelCount > FCC_LIMIT
+                || !meter.Initialize((float) sampleRate, channelCount)) {
+            ALOGE("unsupported format: %d Hz, %d channels", sampleRate, channelCount);
+            return false;
+        }
+        std::vector<float> buffer(SCAN_BUFFER_FRAMES * channelCount);
+        jobject jbuffer = env->NewDirectByteBuffer(buffer.data(), (jlong) (buffer.size() * sizeof(float)));
+        if (jbuffer == nullptr) {
+            ALOGE("Out of memory, can't create buffer");
+            env->ExceptionClear();
+            return false;
+        }
+        bool ok = true;
+        while (!mCancelled) {
+            const jint frames = env->CallIntMethod(producer, mRead, jbuffer);
+            if (env->ExceptionCheck()) {
+                ALOGE("PcmProducer.read() threw");
+                env->ExceptionClear();
+                ok = false;
+                break;
+            }
+            if (frames <= 0) break;
+            if (frames > SCAN_BUFFER_FRAMES) {
+                ALOGE("PcmProducer.read() returned %d frames, more than fit", frames);
+                ok = false;
+                break;
+            }
+            meter.Process(buffer.data(), frames);
+        }
+        env->DeleteLocalRef(jbuffer);
+        results[0] = meter.GetIntegratedLoudness();
+        results[1] = meter.GetLoudnessRange();
+        results[2] = meter.GetTruePeak();
+        results[3] = meter.GetSamplePeak();
+        return ok && !mCancelled;
+    }
+
+    JavaVM* mVm = nullptr;
+    jobject mThiz = nullptr;
+    size_t mCount = 0;
+    jmethodID mGetSampleRate = nullptr;
+    jmethodID mGetChannelCount = nullptr;
+    jmethodID mRead = nullptr;
+    jmethodID mClose = nullptr;
+    jmethodID mOnTrackDone = nullptr;
+    jmethodID mProducerAt = nullptr;
+    bool mValid = true;
+    std::vector<std::unique_ptr<WorkQueue>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::atomic<bool> mCancelled = false;
+    std::atomic<int> mDone = 0;
+    std::mutex mCallbackLock;
+};
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessScanner_create(JNIEnv *env, jobject thiz,
+                                                          jint count) {
+    return (intptr_t) new LoudnessScanner(env, thiz, count);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessScanner_startNative(JNIEnv *, jobject, jlong ptr,
+                                                               jint thread_count) {
+    auto obj = (LoudnessScanner*) ptr;
+    return obj->start(thread_count > 0 ? thread_count : 0);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessScanner_cancelNative(JNIEnv *, jobject, jlong ptr) {
+    auto obj = (LoudnessScanner*) ptr;
+    obj->cancel();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessScanner_joinNative(JNIEnv *, jobject, jlong ptr) {
+    auto obj = (LoudnessScanner*) ptr;
+    obj->join();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessScanner_releaseNative(JNIEnv *, jobject, jlong ptr) {
+    auto obj = (LoudnessScanner*) ptr;
+    delete obj;
+}
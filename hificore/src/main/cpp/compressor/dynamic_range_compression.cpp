@@ -27,7 +27,8 @@ namespace le_fx {
 
 	// GRAMOPHONE: added more knobs
 	void AdaptiveDynamicRangeCompression::Initialize(
-			float sampling_rate, float tau_attack, float tau_release, float compression_ratio) {
+			float sampling_rate, float tau_attack, float tau_release, float compression_ratio,
+			size_t block_size) {
 		sampling_rate_ = sampling_rate;
 		state_ = 0.0f;
 		slope_ = 1.0f / compression_ratio - 1.0f;
@@ -44,22 +45,41 @@ namespace le_fx {
 		} else {
 			alpha_release_ = 0.0f;
 		}
+		block_size_ = std::clamp(block_size, (size_t) 1, kMaxBlockSize);
+		alpha_attack_block_ = std::pow(alpha_attack_, static_cast<float>(block_size_));
+		alpha_release_block_ = std::pow(alpha_release_, static_cast<float>(block_size_));
+		amp_valid_ = false;
+		ramp_left_ = 0;
+		true_peak_.Reset();
+	}
+
+	void AdaptiveDynamicRangeCompression::SetTruePeak(bool enabled) {
+		if (enabled && !true_peak_enabled_) {
+			true_peak_.Reset();
+		}
+		true_peak_enabled_ = enabled;
+	}
+
+	void AdaptiveDynamicRangeCompression::SetGainRamp(size_t ramp_frames) {
+		ramp_frames_ = ramp_frames;
+		if (ramp_frames_ == 0 && ramp_left_ != 0) {
+			AdvanceAmps(ramp_left_);
+		}
 	}
 
 // Instantiate Compress for supported channel counts.
 #define INSTANTIATE_COMPRESS(CHANNEL_COUNT) \
 case CHANNEL_COUNT: \
     if constexpr (CHANNEL_COUNT <= FCC_LIMIT) { \
-        Compress(inputAmp, kneeThreshold, postAmp, \
-                reinterpret_cast<internal_array_t<float, CHANNEL_COUNT>*>(in), \
-				reinterpret_cast<internal_array_t<float, CHANNEL_COUNT>*>(out), frameCount); \
+        Compress<vector_hw_t<float, CHANNEL_COUNT>>(inputAmp, kneeThreshold, postAmp, \
+                in, out, frameCount); \
         return; \
     } \
     break;
 
 	void AdaptiveDynamicRangeCompression::Compress(size_t channelCount, float inputAmp, float kneeThreshold,
 												   float postAmp, float* in, float* out, size_t frameCount) {
-		using android::audio_utils::intrinsics::internal_array_t;
+		using android::audio_utils::intrinsics::vector_hw_t;
 		switch (channelCount) {
 			INSTANTIATE_COMPRESS(1)
 			INSTANTIATE_COMPRESS(2)
@@ -96,6 +116,88 @@ case CHANNEL_COUNT: \
 		abort();
 	}
 
+	// GRAMOPHONE: plain gain for when no compression is needed. Every frame is multiplied
+	// by gain + gainStep * frameIndex, per channel.
+	template <typename V>
+	static void ApplyGain(const float* in, float* out, size_t frameCount, V gain, V gainStep) {
+		using namespace android::audio_utils::intrinsics;
+		for (size_t i = 0; i < frameCount; ++i) {
+			vst1(out + i * V::size(), vmul(vld1<V>(in + i * V::size()),
+					vmla(gain, gainStep, static_cast<float>(i))));
+		}
+	}
+
+	// Constant gain does not depend on the channel layout, so use the widest vector.
+	static void ApplyGain(const float* in, float* out, size_t sampleCount, float gain) {
+		using namespace android::audio_utils::intrinsics;
+		using V = vector_hw_t<float, 16>;
+		size_t i = 0;
+		for (; i + V::size() <= sampleCount; i += V::size()) {
+			vst1(out + i, vmul(vld1<V>(in + i), gain));
+		}
+		for (; i < sampleCount; ++i) {
+			out[i] = in[i] * gain;
+		}
+	}
+
+#define INSTANTIATE_GAIN(CHANNEL_COUNT) \
+case CHANNEL_COUNT: \
+    if constexpr (CHANNEL_COUNT <= FCC_LIMIT) { \
+        using V = vector_hw_t<float, CHANNEL_COUNT>; \
+        ApplyGain<V>(in, out, frameCount, vld1<V>(fromGain), \
+                vmul(vsub(vld1<V>(toGain), vld1<V>(fromGain)), 1.f / static_cast<float>(frameCount))); \
+        return true; \
+    } \
+    break;
+
+	bool ApplyGain(size_t channelCount, const float* fromGain, const float* toGain,
+						  const float* in, float* out, size_t frameCount) {
+		using namespace android::audio_utils::intrinsics;
+		if (frameCount == 0) return true;
+		bool constant = true;
+		for (size_t c = 0; c < channelCount; ++c) {
+			constant &= fromGain[c] == fromGain[0] && toGain[c] == fromGain[0];
+		}
+		if (constant) {
+			ApplyGain(in, out, channelCount * frameCount, fromGain[0]);
+			return true;
+		}
+		switch (channelCount) {
+			INSTANTIATE_GAIN(1)
+			INSTANTIATE_GAIN(2)
+			INSTANTIATE_GAIN(3)
+			INSTANTIATE_GAIN(4)
+			INSTANTIATE_GAIN(5)
+			INSTANTIATE_GAIN(6)
+			INSTANTIATE_GAIN(7)
+			INSTANTIATE_GAIN(8)
+			INSTANTIATE_GAIN(9)
+			INSTANTIATE_GAIN(10)
+			INSTANTIATE_GAIN(11)
+			INSTANTIATE_GAIN(12)
+			INSTANTIATE_GAIN(13)
+			INSTANTIATE_GAIN(14)
+			INSTANTIATE_GAIN(15)
+			INSTANTIATE_GAIN(16)
+			INSTANTIATE_GAIN(17)
+			INSTANTIATE_GAIN(18)
+			INSTANTIATE_GAIN(19)
+			INSTANTIATE_GAIN(20)
+			INSTANTIATE_GAIN(21)
+			INSTANTIATE_GAIN(22)
+			INSTANTIATE_GAIN(23)
+			INSTANTIATE_GAIN(24)
+			INSTANTIATE_GAIN(25)
+			INSTANTIATE_GAIN(26)
+			INSTANTIATE_GAIN(27)
+			INSTANTIATE_GAIN(28)
+			default:
+				break;
+		}
+		ALOGE("%s: channelCount: %zu not supported", __func__, channelCount);
+		return false;
+	}
+
 }  // namespace le_fx
 
 
@@ -123,9 +225,31 @@ Java_org_nift4_gramophone_hificore_AdaptiveDynamicRangeCompression_initNative(JN
                                                                               jfloat sampling_rate,
                                                                               jfloat tau_attack,
                                                                               jfloat tau_release,
-                                                                              jfloat compression_ratio) {
+                                                                              jfloat compression_ratio,
+                                                                              jint block_size) {
+	auto obj = (le_fx::AdaptiveDynamicRangeCompression*) ptr;
+	obj->Initialize(sampling_rate, tau_attack, tau_release, compression_ratio,
+					block_size > 0 ? block_size : 1);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_AdaptiveDynamicRangeCompression_setGainRampNative(JNIEnv *,
+                                                                                     jobject,
+                                                                                     jlong ptr,
+                                                                                     jint ramp_frames) {
+	auto obj = (le_fx::AdaptiveDynamicRangeCompression*) ptr;
+	obj->SetGainRamp(ramp_frames > 0 ? ramp_frames : 0);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_AdaptiveDynamicRangeCompression_setTruePeakNative(JNIEnv *,
+                                                                                     jobject,
+                                                                                     jlong ptr,
+                                                                                     jboolean enabled) {
 	auto obj = (le_fx::AdaptiveDynamicRangeCompression*) ptr;
-	obj->Initialize(sampling_rate, tau_attack, tau_release, compression_ratio);
+	obj->SetTruePeak(enabled);
 }
 
 extern "C"
@@ -145,4 +269,30 @@ Java_org_nift4_gramophone_hificore_AdaptiveDynamicRangeCompression_compressNativ
 	auto out = (float*) env->GetDirectBufferAddress(out_buf);
 	obj->Compress(channel_count, input_amp, knee_threshold,
 				  post_amp, in, out, frame_count);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_AdaptiveDynamicRangeCompression_00024Companion_applyGainNative(
+		JNIEnv *env, jobject, jint channel_count, jfloatArray from_gain, jfloatArray to_gain,
+		jobject in_buf, jobject out_buf, jint frame_count) {
+	if (channel_count < 1 || channel_count > FCC_LIMIT || frame_count < 0) {
+		ALOGE("%s: bad arguments: channel_count %d frame_count %d", __func__, channel_count, frame_count);
+		return false;
+	}
+	if (env->GetArrayLength(from_gain) != channel_count || env->GetArrayLength(to_gain) != channel_count) {
+		ALOGE("%s: need one gain per channel", __func__);
+		return false;
+	}
+	float from[FCC_LIMIT];
+	float to[FCC_LIMIT];
+	env->GetFloatArrayRegion(from_gain, 0, channel_count, from);
+	env->GetFloatArrayRegion(to_gain, 0, channel_count, to);
+	auto in = (float*) env->GetDirectBufferAddress(in_buf);
+	auto out = (float*) env->GetDirectBufferAddress(out_buf);
+	if (in == nullptr || out == nullptr) {
+		ALOGE("%s: buffer is not direct", __func__);
+		return false;
+	}
+	return le_fx::ApplyGain(channel_count, from, to, in, out, frame_count);
 }
\ No newline at end of file
@@ -15,21 +15,19 @@
  */
 #ifndef LE_FX_ENGINE_DSP_CORE_DYNAMIC_RANGE_COMPRESSION_H_
 
+#include <algorithm>
+#include <cmath>
 #include "intrinsic_utils.h"
+#include "true_peak_detector.h"
 
 namespace le_fx {
 	namespace math {
 // taken from common/core/math.h
 // A fast approximation to log2(.)
+		// GRAMOPHONE: use the polynomial approximation from intrinsic_utils.h, which is more
+		// accurate than the quadratic one and shared with the vectorized envelope code
 		inline float fast_log2(float val) {
-			int* const exp_ptr = reinterpret_cast <int *> (&val);
-			int x = *exp_ptr;
-			const int log_2 = ((x >> 23) & 255) - 128;
-			x &= ~(255 << 23);
-			x += 127 << 23;
-			*exp_ptr = x;
-			val = ((-1.0f / 3) * val + 2) * val - 2.0f / 3;
-			return static_cast<float>(val + log_2);
+			return android::audio_utils::intrinsics::vfast_log2(val);
 		}
 
 // A fast approximation to log(.)
@@ -50,7 +48,22 @@ namespace le_fx {
 		AdaptiveDynamicRangeCompression& operator=(const AdaptiveDynamicRangeCompression&) = delete;
 
 		// GRAMOPHONE: added more knobs
-		void Initialize(float sampling_rate, float tau_attack, float tau_release, float compression_ratio);
+		// block_size > 1 selects the block-rate envelope, see CompressBlocks().
+		void Initialize(float sampling_rate, float tau_attack, float tau_release, float compression_ratio,
+						size_t block_size = 1);
+
+		// GRAMOPHONE: upper bound for the block_size passed to Initialize()
+		static constexpr size_t kMaxBlockSize = 64;
+
+		// GRAMOPHONE: when inputAmp or postAmp passed to Compress() differ from the previous call,
+		// move to the new values linearly over ramp_frames frames instead of jumping. The ramp
+		// continues across Compress() calls. 0 (the default) applies new values immediately.
+		// Initialize() keeps this setting, but the first Compress() after it never ramps.
+		void SetGainRamp(size_t ramp_frames);
+
+		// GRAMOPHONE: also feed the 4x oversampled true peak (see TruePeakDetector) into the
+		// envelope, so that inter-sample overs are compressed as well. Off by default.
+		void SetTruePeak(bool enabled);
 
 		// optionally, in-place compression if in == out.
 		void Compress(size_t channelCount, float inputAmp, float kneeThresholdDb, float postAmp,
@@ -61,42 +74,206 @@ namespace le_fx {
 	private:
 
 		// Templated Compress routine.
+		// GRAMOPHONE: V may be a hardware vector type which is not layout compatible with
+		// float[V::size()], so frames are moved with vld1() / vst1() instead of a cast.
 		template <typename V>
-		void Compress(float inputAmp, float kneeThreshold, float postAmp, V* in, V* out, size_t frameCount) {
+		void Compress(float inputAmp, float kneeThreshold, float postAmp, const float* in, float* out,
+					  size_t frameCount) {
 			// GRAMOPHONE: move scale into Compress()
 			constexpr float scale = 1 << 15; // power of 2 is lossless conversion to int16_t range
 			constexpr float inverseScale = 1.f / scale;
 			// Converts from dB to 1og-base
 			float knee_threshold = 0.1151292546497023061569109358970308676362037658691406250f *
 					kneeThreshold + 10.39717719035538401328722102334722876548767089843750f;
-			for (size_t i = 0; i < frameCount; ++i) {
-				auto v = android::audio_utils::intrinsics::vmul(in[i], inputAmp * scale);
-				const float max_abs_x = android::audio_utils::intrinsics::vmaxv(
-						android::audio_utils::intrinsics::vabs(v));
+			SetAmpTarget(inputAmp, postAmp);
+			if (block_size_ > 1) {
+				CompressBlocks<V>(knee_threshold, in, out, frameCount);
+				return;
+			}
+			// GRAMOPHONE: the envelope recursion itself is serial, but the logarithm of the peaks
+			// and the exponential of the resulting state are not, so compute them for a chunk of
+			// frames at once. compressor_gain_ is exp(state_) by construction, so we compute it
+			// from state_ directly instead of multiplying up the deltas.
+			using chunk_t = android::audio_utils::intrinsics::vector_hw_t<float, kEnvelopeChunk>;
+			float peak_db[kEnvelopeChunk];
+			float gains[kEnvelopeChunk];
+			float input_amp[kEnvelopeChunk];
+			float total_amp[kEnvelopeChunk];
+			for (size_t i = 0; i < frameCount; i += kEnvelopeChunk) {
+				const size_t n = std::min(kEnvelopeChunk, frameCount - i);
+				NextAmps(n, input_amp, total_amp);
+				for (size_t j = 0; j < kEnvelopeChunk; ++j) {
+					float max_abs_x = kMinLogAbsValue;
+					if (j < n) {
+						const auto x = android::audio_utils::intrinsics::vld1<V>(in + (i + j) * V::size());
+						const auto v = android::audio_utils::intrinsics::vmul(x, input_amp[j] * scale);
+						max_abs_x = std::max(max_abs_x, android::audio_utils::intrinsics::vmaxv(
+								android::audio_utils::intrinsics::vabs(v)));
+						if (true_peak_enabled_) {
+							max_abs_x = std::max(max_abs_x,
+									true_peak_.Next(x) * std::abs(input_amp[j] * scale));
+						}
+					}
+					peak_db[j] = max_abs_x;
+				}
+				android::audio_utils::intrinsics::vst1(peak_db, android::audio_utils::intrinsics::vmul(
+						android::audio_utils::intrinsics::vfast_log2(
+								android::audio_utils::intrinsics::vld1<chunk_t>(peak_db)), kLn2));
+				for (size_t j = 0; j < n; ++j) {
+					// Subtract Threshold from log-encoded input to get the amount of overshoot
+					const float overshoot = peak_db[j] - knee_threshold;
+					// Hard half-wave rectifier
+					const float rect = std::max(overshoot, 0.0f);
+					// Multiply rectified overshoot with slope
+					const float cv = rect * slope_;
+					const float alpha = (cv <= state_) ? alpha_attack_ : alpha_release_;
+					state_ = alpha * state_ + (1.0f - alpha) * cv;
+					gains[j] = state_;
+				}
+				// GRAMOPHONE: added post gain knob, folded into the gain
+				android::audio_utils::intrinsics::vst1(gains, android::audio_utils::intrinsics::vmul(
+						android::audio_utils::intrinsics::vfast_exp2(
+								android::audio_utils::intrinsics::vmul(
+										android::audio_utils::intrinsics::vld1<chunk_t>(gains), kLog2e)),
+						android::audio_utils::intrinsics::vmul(
+								android::audio_utils::intrinsics::vld1<chunk_t>(total_amp), scale)));
+				for (size_t j = 0; j < n; ++j) {
+					const auto x = android::audio_utils::intrinsics::vmul(
+							android::audio_utils::intrinsics::vld1<V>(in + (i + j) * V::size()), gains[j]);
+					const auto v = android::audio_utils::intrinsics::vclamp(x, -kFixedPointLimit, kFixedPointLimit);
+					android::audio_utils::intrinsics::vst1(out + (i + j) * V::size(),
+							android::audio_utils::intrinsics::vmul(inverseScale, v));
+				}
+			}
+			compressor_gain_ = android::audio_utils::intrinsics::vfast_exp2(state_ * kLog2e);
+		}
+
+		// GRAMOPHONE: block-rate variant of Compress(). The peak detector runs once per block of
+		// block_size_ frames on the largest sample of the block, with the smoothing constant raised
+		// to the power of the block length, so the envelope after each block is the same as if the
+		// per-frame detector had seen the block peak on every frame. The gain is then interpolated
+		// linearly across the block, leaving a plain multiply-clamp per frame.
+		//
+		// Because the block peak is never smaller than any per-frame peak, the envelope at the end
+		// of each block is at least as deep as the per-frame one. Within a block during the attack,
+		// the linear gain ramp lies slightly above the exponential per-frame curve though, so the
+		// output can be a little louder there (measured: < 0.03dB). It can be a lot quieter in front
+		// of a transient, as the whole block is already attenuated for it. With the ReplayGain time
+		// constants at 44.1kHz, steps and full scale clicks in a sine signal, this was at most 2.6dB
+		// for 16 frames, 4.4dB for 32 frames and 6.4dB for 64 frames, decaying within one attack
+		// time constant, and less at higher rates. src/test/cpp/dynamic_range_compression_test.cpp
+		// checks these bounds. Use 1 for the exact per-frame behaviour.
+		// A gain ramp (see SetGainRamp()) advances once per block here and is folded into the
+		// interpolated gain, so it stays piecewise linear.
+		template <typename V>
+		void CompressBlocks(float knee_threshold, const float* in, float* out, size_t frameCount) {
+			constexpr float scale = 1 << 15;
+			constexpr float inverseScale = 1.f / scale;
+			for (size_t i = 0; i < frameCount; i += block_size_) {
+				const size_t n = std::min(block_size_, frameCount - i);
+				const float prev_total_amp = input_amp_ * post_amp_;
+				AdvanceAmps(n);
+				const float inputAmp = input_amp_ * scale;
+				const float* block_in = in + i * V::size();
+				float* block_out = out + i * V::size();
+				float max_abs_x = 0.0f;
+				for (size_t j = 0; j < n; ++j) {
+					const auto x = android::audio_utils::intrinsics::vld1<V>(block_in + j * V::size());
+					max_abs_x = std::max(max_abs_x, android::audio_utils::intrinsics::vmaxv(
+							android::audio_utils::intrinsics::vabs(x)));
+					if (true_peak_enabled_) {
+						max_abs_x = std::max(max_abs_x, true_peak_.Next(x));
+					}
+				}
+				max_abs_x *= std::abs(inputAmp);
 				const float max_abs_x_dB = math::fast_log(std::max(max_abs_x, kMinLogAbsValue));
-				// Subtract Threshold from log-encoded input to get the amount of overshoot
 				const float overshoot = max_abs_x_dB - knee_threshold;
-				// Hard half-wave rectifier
 				const float rect = std::max(overshoot, 0.0f);
-				// Multiply rectified overshoot with slope
 				const float cv = rect * slope_;
-				const float prev_state = state_;
-				const float alpha = (cv <= state_) ? alpha_attack_ : alpha_release_;
+				float alpha;
+				if (n == block_size_) {
+					alpha = (cv <= state_) ? alpha_attack_block_ : alpha_release_block_;
+				} else {
+					// only for the last, partial block of a buffer.
+					alpha = std::pow((cv <= state_) ? alpha_attack_ : alpha_release_, static_cast<float>(n));
+				}
 				state_ = alpha * state_ + (1.0f - alpha) * cv;
-				compressor_gain_ *= expf(state_ - prev_state);
-				// GRAMOPHONE: added post gain knob
-				const auto x = android::audio_utils::intrinsics::vmul(v, compressor_gain_ * postAmp);
-				v = android::audio_utils::intrinsics::vclamp(x, -kFixedPointLimit, kFixedPointLimit);
-				out[i] = android::audio_utils::intrinsics::vmul(inverseScale, v);
+				const float prev_gain = compressor_gain_ * prev_total_amp * scale;
+				compressor_gain_ = android::audio_utils::intrinsics::vfast_exp2(state_ * kLog2e);
+				const float gain_step = (compressor_gain_ * post_amp_ * inputAmp - prev_gain) /
+						static_cast<float>(n);
+				float gain = prev_gain;
+				for (size_t j = 0; j < n; ++j) {
+					gain += gain_step;
+					const auto x = android::audio_utils::intrinsics::vmul(
+							android::audio_utils::intrinsics::vld1<V>(block_in + j * V::size()), gain);
+					const auto v = android::audio_utils::intrinsics::vclamp(x, -kFixedPointLimit, kFixedPointLimit);
+					android::audio_utils::intrinsics::vst1(block_out + j * V::size(),
+							android::audio_utils::intrinsics::vmul(inverseScale, v));
+				}
 			}
 		}
 
+		// GRAMOPHONE: gain ramp helpers, see SetGainRamp()
+		void SetAmpTarget(float input_amp, float post_amp) {
+			if (!amp_valid_ || ramp_frames_ == 0) {
+				input_amp_ = input_amp_target_ = input_amp;
+				post_amp_ = post_amp_target_ = post_amp;
+				ramp_left_ = 0;
+				amp_valid_ = true;
+				return;
+			}
+			if (input_amp == input_amp_target_ && post_amp == post_amp_target_) {
+				return;
+			}
+			// restart from wherever a running ramp currently is
+			input_amp_target_ = input_amp;
+			post_amp_target_ = post_amp;
+			ramp_left_ = ramp_frames_;
+			input_amp_step_ = (input_amp_target_ - input_amp_) / static_cast<float>(ramp_left_);
+			post_amp_step_ = (post_amp_target_ - post_amp_) / static_cast<float>(ramp_left_);
+		}
+
+		// Moves the ramp forward by n frames.
+		void AdvanceAmps(size_t n) {
+			if (ramp_left_ > n) {
+				ramp_left_ -= n;
+				input_amp_ += input_amp_step_ * static_cast<float>(n);
+				post_amp_ += post_amp_step_ * static_cast<float>(n);
+			} else {
+				ramp_left_ = 0;
+				input_amp_ = input_amp_target_;
+				post_amp_ = post_amp_target_;
+			}
+		}
+
+		// Writes input amp and input amp * post amp for the next n frames and moves the ramp
+		// forward by n frames.
+		void NextAmps(size_t n, float* input_amp, float* total_amp) {
+			if (ramp_left_ == 0) {
+				std::fill(input_amp, input_amp + kEnvelopeChunk, input_amp_);
+				std::fill(total_amp, total_amp + kEnvelopeChunk, input_amp_ * post_amp_);
+				return;
+			}
+			for (size_t j = 0; j < n; ++j) {
+				AdvanceAmps(1);
+				input_amp[j] = input_amp_;
+				total_amp[j] = input_amp_ * post_amp_;
+			}
+			std::fill(input_amp + n, input_amp + kEnvelopeChunk, input_amp_);
+			std::fill(total_amp + n, total_amp + kEnvelopeChunk, input_amp_ * post_amp_);
+		}
+
 		// The minimum accepted absolute input value to prevent numerical issues
 		// when the input is close to zero.
 		static constexpr float kMinLogAbsValue =
 				0.032766999999999997517097227728299912996590137481689453125f;
 		// Fixed-point arithmetic limits
 		static constexpr float kFixedPointLimit = 32767.0f;
+		// GRAMOPHONE: frames per vectorized log / exp evaluation in the per-frame path
+		static constexpr size_t kEnvelopeChunk = 16;
+		static constexpr float kLn2 = 0.693147180559945309417232121458176568f;
+		static constexpr float kLog2e = 1.44269504088896340735992468100189214f;
 
 		float slope_;
 		float sampling_rate_;
@@ -108,9 +285,33 @@ namespace le_fx {
 		float alpha_attack_;
 		// release constant for exponential dumping
 		float alpha_release_;
+		// GRAMOPHONE: frames per envelope update, 1 means per-frame
+		size_t block_size_ = 1;
+		// alpha_attack_ / alpha_release_ raised to the power of block_size_
+		float alpha_attack_block_;
+		float alpha_release_block_;
+		// GRAMOPHONE: see SetTruePeak()
+		bool true_peak_enabled_ = false;
+		TruePeakDetector true_peak_;
+		// GRAMOPHONE: gain ramp state, see SetGainRamp()
+		size_t ramp_frames_ = 0;
+		size_t ramp_left_ = 0;
+		bool amp_valid_ = false;
+		float input_amp_ = 1.0f;
+		float post_amp_ = 1.0f;
+		float input_amp_target_ = 1.0f;
+		float post_amp_target_ = 1.0f;
+		float input_amp_step_ = 0.0f;
+		float post_amp_step_ = 0.0f;
 		// GRAMOPHONE: remove target_gain_to_knee_threshold_
 	};
 
+	// GRAMOPHONE: fromGain and toGain hold one gain per channel. The gain ramps linearly from
+	// fromGain at the first frame towards toGain, which would be reached at frame index frameCount.
+	// In-place if in == out. Returns false if the channel count is not supported.
+	bool ApplyGain(size_t channelCount, const float* fromGain, const float* toGain,
+				   const float* in, float* out, size_t frameCount);
+
 }  // namespace le_fx
 
 #endif  // LE_FX_ENGINE_DSP_CORE_DYNAMIC_RANGE_COMPRESSION_H_
@@ -18,6 +18,10 @@
 #define ANDROID_AUDIO_UTILS_INTRINSIC_UTILS_H
 
 #include <array>  // std::size
+#include <bit>  // std::bit_cast
+#include <cmath>  // std::floor
+#include <cstdint>
+#include <cstring>  // memcpy
 #include <type_traits>
 #include "template_utils.h"
 
@@ -38,6 +42,21 @@
 #define USE_NEON
 #endif
 
+// GRAMOPHONE: x86 and x86_64 builds get SSE2 (always present on both Android x86 ABIs)
+// and, if the compiler is allowed to emit it, AVX for 8 wide float vectors.
+#pragma push_macro("USE_SSE")
+#pragma push_macro("USE_AVX")
+#undef USE_SSE
+#undef USE_AVX
+
+#if !defined(USE_NEON) && defined(__SSE2__)
+#include <immintrin.h>
+#define USE_SSE
+#if defined(__AVX__)
+#define USE_AVX
+#endif
+#endif
+
 // We use macros to hide intrinsic methods that do not exist for
 // incompatible target architectures; otherwise we have a
 // "use of undeclared identifier" compilation error when
@@ -51,10 +70,16 @@
 //
 // DN_(x) replaces x with nullptr for non-ARM arch
 // DN64_(x) replaces x with nullptr for non-ARM64 arch
+// DS_(x) replaces x with nullptr for non-x86 arch (SSE2)
+// DA_(x) replaces x with nullptr for x86 without AVX
 #pragma push_macro("DN_")
 #pragma push_macro("DN64_")
+#pragma push_macro("DS_")
+#pragma push_macro("DA_")
 #undef DN_
 #undef DN64_
+#undef DS_
+#undef DA_
 
 #ifdef USE_NEON
 #if defined(__aarch64__)
@@ -69,6 +94,18 @@
 #define DN64_(x) nullptr
 #endif // USE_NEON
 
+#ifdef USE_SSE
+#define DS_(x) x
+#else
+#define DS_(x) nullptr
+#endif // USE_SSE
+
+#ifdef USE_AVX
+#define DA_(x) x
+#else
+#define DA_(x) nullptr
+#endif // USE_AVX
+
 namespace android::audio_utils::intrinsics {
 
 // For static assert(false) we need a template version to avoid early failure.
@@ -859,7 +896,7 @@ constexpr void vapply(const F& f, V& v) {
 			auto& [v1] = vv;
 			vapply(f, v1);
 		} else {
-			static_assert(false, "Currently supports up to 32 members only.");
+			static_assert(dependent_false_v<VT>, "Currently supports up to 32 members only.");
 		}
 	}
 }
@@ -970,16 +1007,19 @@ constexpr inline S vconvert(const T& in) {
   using alternative_15_t = struct { struct { float32x4x2_t a; struct { float v[7]; } b; } s; };
 */
 
-#ifdef USE_NEON
+#if defined(USE_NEON) || defined(USE_SSE)
 
 // This will be specialized later to hold different types.
 template<int N>
-struct vfloat_struct {};
+struct vfloat_struct;
 
 // Helper method to extract type contained in the struct.
 template<int N>
 using vfloat_t = typename vfloat_struct<N>::t;
 
+template<typename T, typename F>
+static inline T vld1(const F *f);
+
 // Create vfloat_extended_t to add helper methods.
 //
 // It is preferable to use vector_hw_t instead, which
@@ -1015,14 +1055,20 @@ struct vfloat_extended_t : public vfloat_t<N> {
         for (; i < N; ++i) {
             v[i] = {};
         }
-        static_assert(sizeof(*this) == sizeof(v));
-        static_assert(sizeof(*this) == N * sizeof(float));
-        memcpy(this, v, sizeof(*this));
+        load(v);
     }
     vfloat_extended_t(internal_array_t<float, N> value) {
-        static_assert(sizeof(*this) == sizeof(value.v));
-        static_assert(sizeof(*this) == N * sizeof(float));
-        memcpy(this, value.v, sizeof(*this));
+        load(value.v);
+    }
+private:
+    // GRAMOPHONE: x86 composite types are not packed (see below), so they may be larger
+    // than N floats. Only memcpy if the layout is known to be identical.
+    void load(const float* v) {
+        if constexpr (sizeof(*this) == N * sizeof(float)) {
+            memcpy(this, v, sizeof(*this));
+        } else {
+            *static_cast<vfloat_t<N>*>(this) = vld1<vfloat_t<N>>(v);
+        }
     }
 };
 
@@ -1033,6 +1079,10 @@ template<typename F, size_t N>
 using vector_hw_t = std::conditional_t<
         std::is_same_v<F, float>, vfloat_extended_t<N>, internal_array_t<F, N>>;
 
+#endif // defined(USE_NEON) || defined(USE_SSE)
+
+#ifdef USE_NEON
+
 // Recursively define structs containing the NEON intrinsic types for a given vector size.
 // intrinsic_utils.h allows structurally recursive type definitions based on
 // pairs of types (much like Lisp list cons pairs).
@@ -1145,9 +1195,47 @@ struct vfloat_struct<32> { using t = struct { struct __attribute__((packed)) {
 static_assert(std::is_trivially_copyable_v<vfloat_struct<31>>);
 static_assert(std::is_trivially_copyable_v<vfloat_t<31>>);
 
+#elif defined(USE_SSE)
+
+// GRAMOPHONE: x86 counterpart of the NEON structs above. There is no 2 wide float type, so
+// sizes below 4 stay scalar, 8 and 16 use __m256 if AVX is available. All other sizes are
+// a cons-pair of the largest such prefix and the remainder.
+//
+// Unlike the NEON structs, these are not packed: SSE loads through a reference to an
+// under-aligned __m128 member would fault. Hence sizeof(vfloat_t<N>) may exceed
+// N * sizeof(float), and vld1() / vst1() must be used to move data from / to float arrays.
+constexpr int vfloat_prefix_size(int N) {
+	return N > 16 ? 16 : N > 8 ? 8 : N > 4 ? 4 : N > 2 ? 2 : N;
+}
+
+template<int N>
+struct vfloat_struct { using t = struct { struct {
+	vfloat_t<vfloat_prefix_size(N)> a; vfloat_t<N - vfloat_prefix_size(N)> b; } s; }; };
+template<>
+struct vfloat_struct<1> { using t = struct { float v[1]; }; };
+template<>
+struct vfloat_struct<2> { using t = struct { float v[2]; }; };
+template<>
+struct vfloat_struct<4> { using t = struct { __m128 v[1]; }; };
+#ifdef USE_AVX
+template<>
+struct vfloat_struct<8> { using t = struct { __m256 v[1]; }; };
+template<>
+struct vfloat_struct<16> { using t = struct { __m256 v[2]; }; };
 #else
+template<>
+struct vfloat_struct<8> { using t = struct { __m128 v[2]; }; };
+template<>
+struct vfloat_struct<16> { using t = struct { __m128 v[4]; }; };
+#endif // USE_AVX
 
-// x64 or risc-v, use loop vectorization if no HW type exists.
+// assert our structs are trivially copyable so we can use memcpy freely.
+static_assert(std::is_trivially_copyable_v<vfloat_struct<31>>);
+static_assert(std::is_trivially_copyable_v<vfloat_t<31>>);
+
+#else
+
+// risc-v, use loop vectorization if no HW type exists.
 template<typename F, int N>
 using vector_hw_t = internal_array_t<F, N>;
 
@@ -1316,10 +1404,95 @@ inline bool veq(T a, T b) {
 	}
 }
 
+#ifdef USE_SSE
+
+// GRAMOPHONE: x86 has no direct equivalent for some NEON intrinsics used below, so we provide
+// them here. Operands of max/min are swapped because std::max(x, y) is (x < y) ? y : x, while
+// _mm_max_ps(x, y) is (x > y) ? x : y. This way, NaN and signed zero behave as the scalar path.
+// Horizontal reductions associate differently than the scalar loop, as they do on NEON.
+
+static inline __m128 sse_abs_ps(__m128 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+static inline __m128 sse_add_ps(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 sse_max_ps(__m128 a, __m128 b) { return _mm_max_ps(b, a); }
+static inline __m128 sse_min_ps(__m128 a, __m128 b) { return _mm_min_ps(b, a); }
+static inline __m128 sse_mul_ps(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+static inline __m128 sse_mla_ps(__m128 a, __m128 b, __m128 c) {
+	return _mm_add_ps(a, _mm_mul_ps(b, c));
+}
+static inline __m128 sse_mla_n_ps(__m128 a, __m128 b, float c) {
+	return _mm_add_ps(a, _mm_mul_ps(b, _mm_set1_ps(c)));
+}
+static inline __m128 sse_neg_ps(__m128 a) { return _mm_xor_ps(_mm_set1_ps(-0.f), a); }
+static inline __m128 sse_sub_ps(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+static inline float sse_addv_ps(__m128 a) {
+	const __m128 s = _mm_add_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1))));
+}
+static inline float sse_maxv_ps(__m128 a) {
+	const __m128 s = sse_max_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_max_ss(_mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)), s));
+}
+static inline float sse_minv_ps(__m128 a) {
+	const __m128 s = sse_min_ps(a, _mm_movehl_ps(a, a));
+	return _mm_cvtss_f32(_mm_min_ss(_mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)), s));
+}
+
+static inline __m128d sse_abs_pd(__m128d a) { return _mm_andnot_pd(_mm_set1_pd(-0.), a); }
+static inline __m128d sse_add_pd(__m128d a, __m128d b) { return _mm_add_pd(a, b); }
+static inline __m128d sse_max_pd(__m128d a, __m128d b) { return _mm_max_pd(b, a); }
+static inline __m128d sse_min_pd(__m128d a, __m128d b) { return _mm_min_pd(b, a); }
+static inline __m128d sse_mul_pd(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
+static inline __m128d sse_mla_pd(__m128d a, __m128d b, __m128d c) {
+	return _mm_add_pd(a, _mm_mul_pd(b, c));
+}
+static inline __m128d sse_mla_n_pd(__m128d a, __m128d b, double c) {
+	return _mm_add_pd(a, _mm_mul_pd(b, _mm_set1_pd(c)));
+}
+static inline __m128d sse_neg_pd(__m128d a) { return _mm_xor_pd(_mm_set1_pd(-0.), a); }
+static inline __m128d sse_sub_pd(__m128d a, __m128d b) { return _mm_sub_pd(a, b); }
+static inline double sse_addv_pd(__m128d a) {
+	return _mm_cvtsd_f64(_mm_add_sd(a, _mm_unpackhi_pd(a, a)));
+}
+static inline double sse_maxv_pd(__m128d a) {
+	return _mm_cvtsd_f64(_mm_max_sd(_mm_unpackhi_pd(a, a), a));
+}
+static inline double sse_minv_pd(__m128d a) {
+	return _mm_cvtsd_f64(_mm_min_sd(_mm_unpackhi_pd(a, a), a));
+}
+
+#ifdef USE_AVX
+static inline __m256 avx_abs_ps(__m256 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+static inline __m256 avx_add_ps(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+static inline __m256 avx_max_ps(__m256 a, __m256 b) { return _mm256_max_ps(b, a); }
+static inline __m256 avx_min_ps(__m256 a, __m256 b) { return _mm256_min_ps(b, a); }
+static inline __m256 avx_mul_ps(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+static inline __m256 avx_mla_ps(__m256 a, __m256 b, __m256 c) {
+	return _mm256_add_ps(a, _mm256_mul_ps(b, c));
+}
+static inline __m256 avx_mla_n_ps(__m256 a, __m256 b, float c) {
+	return _mm256_add_ps(a, _mm256_mul_ps(b, _mm256_set1_ps(c)));
+}
+static inline __m256 avx_neg_ps(__m256 a) { return _mm256_xor_ps(_mm256_set1_ps(-0.f), a); }
+static inline __m256 avx_sub_ps(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+static inline float avx_addv_ps(__m256 a) {
+	return sse_addv_ps(_mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+static inline float avx_maxv_ps(__m256 a) {
+	return sse_maxv_ps(sse_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+static inline float avx_minv_ps(__m256 a) {
+	return sse_minv_ps(sse_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1)));
+}
+#endif // USE_AVX
+
+#endif // USE_SSE
+
 // --------------------------------------------------------------------
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T>
-inline T implement_arg1(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a) {
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T>
+inline T implement_arg1(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		return f(a);
 #ifdef USE_NEON
@@ -1332,6 +1505,16 @@ inline T implement_arg1(const F& f, const FN1& fn1, const FN2& fn2, const FN3& f
         return fn3(a);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return fs1(a);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return fs2(a);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return fa1(a);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		T ret;
@@ -1340,21 +1523,23 @@ inline T implement_arg1(const F& f, const FN1& fn1, const FN2& fn2, const FN3& f
 		if constexpr (std::is_array_v<decltype(retval)>) {
 #pragma unroll
 			for (size_t i = 0; i < std::size(aval); ++i) {
-				retval[i] = implement_arg1(f, fn1, fn2, fn3, aval[i]);
+				retval[i] = implement_arg1(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i]);
 			}
 			return ret;
 		} else /* constexpr */ {
 			auto& [r1, r2] = retval;
 			const auto& [a1, a2] = aval;
-			r1 = implement_arg1(f, fn1, fn2, fn3, a1);
-			r2 = implement_arg1(f, fn1, fn2, fn3, a2);
+			r1 = implement_arg1(f, fn1, fn2, fn3, fs1, fs2, fa1, a1);
+			r2 = implement_arg1(f, fn1, fn2, fn3, fs1, fs2, fa1, a2);
 			return ret;
 		}
 	}
 }
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T>
-inline auto implement_arg1v(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a) {
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T>
+inline auto implement_arg1v(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		return a;
 
@@ -1366,6 +1551,16 @@ inline auto implement_arg1v(const F& f, const FN1& fn1, const FN2& fn2, const FN
     } else if constexpr (std::is_same_v<T, float64x2_t>) {
         return fn3(a);
 #endif // defined(USE_NEON) && defined(__aarch64__)
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return fs1(a);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return fs2(a);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return fa1(a);
+#endif // USE_AVX
+#endif // USE_SSE
 	} else if constexpr (is_array_like<T>) {
 		using ret_t = std::decay_t<decltype(a[0])>;
 
@@ -1381,17 +1576,17 @@ inline auto implement_arg1v(const F& f, const FN1& fn1, const FN2& fn2, const FN
 		const auto &[aval] = a;
 		if constexpr (std::is_array_v<decltype(aval)>) {
 			using ret_t = std::decay_t<decltype(first_element_of(aval[0]))>;
-			ret_t ret = implement_arg1v(f, fn1, fn2, fn3, aval[0]);
+			ret_t ret = implement_arg1v(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[0]);
 #pragma unroll
 			for (size_t i = 1; i < std::size(aval); ++i) {
-				ret = f(ret, implement_arg1v(f, fn1, fn2, fn3, aval[i]));
+				ret = f(ret, implement_arg1v(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i]));
 			}
 			return ret;
 		} else /* constexpr */ {
 			using ret_t = std::decay_t<decltype(first_element_of(a))>;
 			const auto& [a1, a2] = aval;
-			ret_t ret = implement_arg1v(f, fn1, fn2, fn3, a1);
-			ret = f(ret, implement_arg1v(f, fn1, fn2, fn3, a2));
+			ret_t ret = implement_arg1v(f, fn1, fn2, fn3, fs1, fs2, fa1, a1);
+			ret = f(ret, implement_arg1v(f, fn1, fn2, fn3, fs1, fs2, fa1, a2));
 			return ret;
 		}
 	}
@@ -1416,13 +1611,15 @@ auto invoke_intrinsic_with_dup_as_needed(const F& f, T a, S b) {
 }
 
 // arg2 with a vector and scalar parameter.
-template<typename F, typename FN1, typename FN2, typename FN3, typename T, typename S>
-inline auto implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a, S b) {
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T, typename S>
+inline auto implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a, S b) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		if constexpr (std::is_same_v<S, float> || std::is_same_v<S, double>) {
 			return f(a, b);
 		} else /* constexpr */ {
-			return implement_arg2(f, fn1, fn2, fn3, b, a); // we prefer T to be the vector/struct.
+			return implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, b, a); // we prefer T to be the vector/struct.
 		}
 	} else if constexpr (std::is_same_v<S, float> || std::is_same_v<S, double>) {
 		// handle the lane variant
@@ -1437,6 +1634,17 @@ inline auto implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3
 #endif
         } else
 #endif // USE_NEON
+#ifdef USE_SSE
+		if constexpr (std::is_same_v<T, __m128>) {
+			return invoke_intrinsic_with_dup_as_needed(fs1, a, b);
+		} else if constexpr (std::is_same_v<T, __m128d>) {
+			return invoke_intrinsic_with_dup_as_needed(fs2, a, b);
+#ifdef USE_AVX
+		} else if constexpr (std::is_same_v<T, __m256>) {
+			return invoke_intrinsic_with_dup_as_needed(fa1, a, b);
+#endif // USE_AVX
+		} else
+#endif // USE_SSE
 		{
 			T ret;
 			auto &[retval] = ret;  // single-member struct
@@ -1444,14 +1652,14 @@ inline auto implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3
 			if constexpr (std::is_array_v<decltype(retval)>) {
 #pragma unroll
 				for (size_t i = 0; i < std::size(aval); ++i) {
-					retval[i] = implement_arg2(f, fn1, fn2, fn3, aval[i], b);
+					retval[i] = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i], b);
 				}
 				return ret;
 			} else /* constexpr */ {
 				auto& [r1, r2] = retval;
 				const auto& [a1, a2] = aval;
-				r1 = implement_arg2(f, fn1, fn2, fn3, a1, b);
-				r2 = implement_arg2(f, fn1, fn2, fn3, a2, b);
+				r1 = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, a1, b);
+				r2 = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, a2, b);
 				return ret;
 			}
 		}
@@ -1461,8 +1669,10 @@ inline auto implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3
 	}
 }
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T>
-inline T implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a, T b) {
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T>
+inline T implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a, T b) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		return f(a, b);
 
@@ -1476,6 +1686,16 @@ inline T implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& f
         return fn3(a, b);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return fs1(a, b);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return fs2(a, b);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return fa1(a, b);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		T ret;
@@ -1485,37 +1705,44 @@ inline T implement_arg2(const F& f, const FN1& fn1, const FN2& fn2, const FN3& f
 		if constexpr (std::is_array_v<decltype(retval)>) {
 #pragma unroll
 			for (size_t i = 0; i < std::size(aval); ++i) {
-				retval[i] = implement_arg2(f, fn1, fn2, fn3, aval[i], bval[i]);
+				retval[i] = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i], bval[i]);
 			}
 			return ret;
 		} else /* constexpr */ {
 			auto& [r1, r2] = retval;
 			const auto& [a1, a2] = aval;
 			const auto& [b1, b2] = bval;
-			r1 = implement_arg2(f, fn1, fn2, fn3, a1, b1);
-			r2 = implement_arg2(f, fn1, fn2, fn3, a2, b2);
+			r1 = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, a1, b1);
+			r2 = implement_arg2(f, fn1, fn2, fn3, fs1, fs2, fa1, a2, b2);
 			return ret;
 		}
 	}
 }
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T, typename S, typename R>
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T, typename S, typename R>
 inline auto implement_arg3(
-		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, R a, T b, S c) {
+		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, R a, T b, S c) {
 	// Arbitrary support is not allowed.
 	(void) f;
 	(void) fn1;
 	(void) fn2;
 	(void) fn3;
+	(void) fs1;
+	(void) fs2;
+	(void) fa1;
 	(void) a;
 	(void) b;
 	(void) c;
 	static_assert(dependent_false_v<T>);
 }
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T, typename S>
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T, typename S>
 inline auto implement_arg3(
-		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a, T b, S c) {
+		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a, T b, S c) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		if constexpr (std::is_same_v<S, float> || std::is_same_v<S, double>) {
 			return f(a, b, c);
@@ -1535,6 +1762,17 @@ inline auto implement_arg3(
 #endif
         } else
 #endif // USE_NEON
+#ifdef USE_SSE
+		if constexpr (std::is_same_v<T, __m128>) {
+			return fs1(a, b, c);
+		} else if constexpr (std::is_same_v<T, __m128d>) {
+			return fs2(a, b, c);
+#ifdef USE_AVX
+		} else if constexpr (std::is_same_v<T, __m256>) {
+			return fa1(a, b, c);
+#endif // USE_AVX
+		} else
+#endif // USE_SSE
 		{
 			T ret;
 			auto &[retval] = ret;  // single-member struct
@@ -1543,15 +1781,15 @@ inline auto implement_arg3(
 			if constexpr (std::is_array_v<decltype(retval)>) {
 #pragma unroll
 				for (size_t i = 0; i < std::size(aval); ++i) {
-					retval[i] = implement_arg3(f, fn1, fn2, fn3, aval[i], bval[i], c);
+					retval[i] = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i], bval[i], c);
 				}
 				return ret;
 			} else /* constexpr */ {
 				auto &[r1, r2] = retval;
 				const auto &[a1, a2] = aval;
 				const auto &[b1, b2] = bval;
-				r1 = implement_arg3(f, fn1, fn2, fn3, a1, b1, c);
-				r2 = implement_arg3(f, fn1, fn2, fn3, a2, b2, c);
+				r1 = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, a1, b1, c);
+				r2 = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, a2, b2, c);
 				return ret;
 			}
 		}
@@ -1561,9 +1799,11 @@ inline auto implement_arg3(
 	}
 }
 
-template<typename F, typename FN1, typename FN2, typename FN3, typename T>
+template<typename F, typename FN1, typename FN2, typename FN3,
+		typename FS1, typename FS2, typename FA1, typename T>
 inline T implement_arg3(
-		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3, T a, T b, T c) {
+		const F& f, const FN1& fn1, const FN2& fn2, const FN3& fn3,
+		const FS1& fs1, const FS2& fs2, const FA1& fa1, T a, T b, T c) {
 	if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
 		return f(a, b, c);
 
@@ -1577,6 +1817,16 @@ inline T implement_arg3(
         return fn3(a, b, c);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return fs1(a, b, c);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return fs2(a, b, c);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return fa1(a, b, c);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		T ret;
@@ -1587,7 +1837,7 @@ inline T implement_arg3(
 		if constexpr (std::is_array_v<decltype(retval)>) {
 #pragma unroll
 			for (size_t i = 0; i < std::size(aval); ++i) {
-				retval[i] = implement_arg3(f, fn1, fn2, fn3, aval[i], bval[i], cval[i]);
+				retval[i] = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, aval[i], bval[i], cval[i]);
 			}
 			return ret;
 		} else /* constexpr */ {
@@ -1595,8 +1845,8 @@ inline T implement_arg3(
 			const auto& [a1, a2] = aval;
 			const auto& [b1, b2] = bval;
 			const auto& [c1, c2] = cval;
-			r1 = implement_arg3(f, fn1, fn2, fn3, a1, b1, c1);
-			r2 = implement_arg3(f, fn1, fn2, fn3, a2, b2, c2);
+			r1 = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, a1, b1, c1);
+			r2 = implement_arg3(f, fn1, fn2, fn3, fs1, fs2, fa1, a2, b2, c2);
 			return ret;
 		}
 	}
@@ -1606,20 +1856,23 @@ inline T implement_arg3(
 template<typename T>
 static inline T vabs(T a) {
 	return implement_arg1([](const auto& x) { return std::abs(x); },
-	                      DN_(vabs_f32), DN_(vabsq_f32), DN64_(vabsq_f64), a);
+	                      DN_(vabs_f32), DN_(vabsq_f32), DN64_(vabsq_f64),
+	                      DS_(sse_abs_ps), DS_(sse_abs_pd), DA_(avx_abs_ps), a);
 }
 
 template<typename T>
 inline T vadd(T a, T b) {
 	return implement_arg2([](const auto& x, const auto& y) { return x + y; },
-	                      DN_(vadd_f32), DN_(vaddq_f32), DN64_(vaddq_f64), a, b);
+	                      DN_(vadd_f32), DN_(vaddq_f32), DN64_(vaddq_f64),
+	                      DS_(sse_add_ps), DS_(sse_add_pd), DA_(avx_add_ps), a, b);
 }
 
 // add internally
 template<typename T>
 inline auto vaddv(const T& a) {
 	return implement_arg1v([](const auto& x, const auto& y) { return x + y; },
-	                       DN64_(vaddv_f32), DN64_(vaddvq_f32), DN64_(vaddvq_f64), a);
+	                       DN64_(vaddv_f32), DN64_(vaddvq_f32), DN64_(vaddvq_f64),
+	                       DS_(sse_addv_ps), DS_(sse_addv_pd), DA_(avx_addv_ps), a);
 }
 
 // duplicate float into all elements.
@@ -1638,6 +1891,16 @@ inline T vdupn(F f) {
         return vdupq_n_f64(f);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return _mm_set1_ps(f);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return _mm_set1_pd(f);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return _mm256_set1_ps(f);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		T ret;
@@ -1675,6 +1938,16 @@ static inline T vld1(const F *f) {
         return vld1q_f64(f);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return _mm_loadu_ps(f);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return _mm_loadu_pd(f);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return _mm256_loadu_ps(f);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		T ret;
@@ -1703,37 +1976,43 @@ static inline T vld1(const F *f) {
 template<typename T, typename F>
 inline auto vmax(T a, F b) {
 	return implement_arg2([](const auto& x, const auto& y) { return std::max(x, y); },
-	                      DN_(vmax_f32), DN_(vmaxq_f32), DN64_(vmaxq_f64), a, b);
+	                      DN_(vmax_f32), DN_(vmaxq_f32), DN64_(vmaxq_f64),
+	                      DS_(sse_max_ps), DS_(sse_max_pd), DA_(avx_max_ps), a, b);
 }
 
 template<typename T>
 inline T vmax(T a, T b) {
 	return implement_arg2([](const auto& x, const auto& y) { return std::max(x, y); },
-	                      DN_(vmax_f32), DN_(vmaxq_f32), DN64_(vmaxq_f64), a, b);
+	                      DN_(vmax_f32), DN_(vmaxq_f32), DN64_(vmaxq_f64),
+	                      DS_(sse_max_ps), DS_(sse_max_pd), DA_(avx_max_ps), a, b);
 }
 
 template<typename T>
 inline auto vmaxv(const T& a) {
 	return implement_arg1v([](const auto& x, const auto& y) { return std::max(x, y); },
-	                       DN64_(vmaxv_f32), DN64_(vmaxvq_f32), DN64_(vmaxvq_f64), a);
+	                       DN64_(vmaxv_f32), DN64_(vmaxvq_f32), DN64_(vmaxvq_f64),
+	                       DS_(sse_maxv_ps), DS_(sse_maxv_pd), DA_(avx_maxv_ps), a);
 }
 
 template<typename T, typename F>
 inline auto vmin(T a, F b) {
 	return implement_arg2([](const auto& x, const auto& y) { return std::min(x, y); },
-	                      DN_(vmin_f32), DN_(vminq_f32), DN64_(vminq_f64), a, b);
+	                      DN_(vmin_f32), DN_(vminq_f32), DN64_(vminq_f64),
+	                      DS_(sse_min_ps), DS_(sse_min_pd), DA_(avx_min_ps), a, b);
 }
 
 template<typename T>
 inline T vmin(T a, T b) {
 	return implement_arg2([](const auto& x, const auto& y) { return std::min(x, y); },
-	                      DN_(vmin_f32), DN_(vminq_f32), DN64_(vminq_f64), a, b);
+	                      DN_(vmin_f32), DN_(vminq_f32), DN64_(vminq_f64),
+	                      DS_(sse_min_ps), DS_(sse_min_pd), DA_(avx_min_ps), a, b);
 }
 
 template<typename T>
 inline auto vminv(const T& a) {
 	return implement_arg1v([](const auto& x, const auto& y) { return std::min(x, y); },
-	                       DN64_(vminv_f32), DN64_(vminvq_f32), DN64_(vminvq_f64), a);
+	                       DN64_(vminv_f32), DN64_(vminvq_f32), DN64_(vminvq_f64),
+	                       DS_(sse_minv_ps), DS_(sse_minv_pd), DA_(avx_minv_ps), a);
 }
 
 /**
@@ -1751,7 +2030,8 @@ float64x2_t vmlaq_n_f64(float64x2_t __p0, float64x2_t __p1, float64_t __p2);
 template<typename T, typename F>
 static inline T vmla(T a, T b, F c) {
 	return implement_arg3([](const auto& x, const auto& y, const auto& z) { return x + y * z; },
-	                      DN_(vmla_n_f32), DN_(vmlaq_n_f32), DN64_(vmlaq_n_f64), a, b, c);
+	                      DN_(vmla_n_f32), DN_(vmlaq_n_f32), DN64_(vmlaq_n_f64),
+	                      DS_(sse_mla_n_ps), DS_(sse_mla_n_pd), DA_(avx_mla_n_ps), a, b, c);
 }
 
 template<typename T, typename F>
@@ -1763,7 +2043,8 @@ static inline T vmla(T a, F b, T c) {
 template<typename T>
 inline T vmla(const T& a, const T& b, const T& c) {
 	return implement_arg3([](const auto& x, const auto& y, const auto& z) { return x + y * z; },
-	                      DN_(vmla_f32), DN_(vmlaq_f32), DN64_(vmlaq_f64), a, b, c);
+	                      DN_(vmla_f32), DN_(vmlaq_f32), DN64_(vmlaq_f64),
+	                      DS_(sse_mla_ps), DS_(sse_mla_pd), DA_(avx_mla_ps), a, b, c);
 }
 
 /**
@@ -1775,20 +2056,23 @@ inline T vmla(const T& a, const T& b, const T& c) {
 template<typename T, typename F>
 static inline auto vmul(T a, F b) {
 	return implement_arg2([](const auto& x, const auto& y) { return x * y; },
-	                      DN_(vmul_n_f32), DN_(vmulq_n_f32), DN64_(vmulq_n_f64), a, b);
+	                      DN_(vmul_n_f32), DN_(vmulq_n_f32), DN64_(vmulq_n_f64),
+	                      DS_(sse_mul_ps), DS_(sse_mul_pd), DA_(avx_mul_ps), a, b);
 }
 
 template<typename T>
 inline T vmul(T a, T b) {
 	return implement_arg2([](const auto& x, const auto& y) { return x * y; },
-	                      DN_(vmul_f32), DN_(vmulq_f32), DN64_(vmulq_f64), a, b);
+	                      DN_(vmul_f32), DN_(vmulq_f32), DN64_(vmulq_f64),
+	                      DS_(sse_mul_ps), DS_(sse_mul_pd), DA_(avx_mul_ps), a, b);
 }
 
 // negate
 template<typename T>
 inline T vneg(T a) {
 	return implement_arg1([](const auto& x) { return -x; },
-	                      DN_(vneg_f32), DN_(vnegq_f32), DN64_(vnegq_f64), a);
+	                      DN_(vneg_f32), DN_(vnegq_f32), DN64_(vnegq_f64),
+	                      DS_(sse_neg_ps), DS_(sse_neg_pd), DA_(avx_neg_ps), a);
 }
 
 // store to float pointer.
@@ -1807,6 +2091,16 @@ static inline void vst1(F *f, T a) {
         return vst1q_f64(f, a);
 #endif
 #endif // USE_NEON
+#ifdef USE_SSE
+	} else if constexpr (std::is_same_v<T, __m128>) {
+		return _mm_storeu_ps(f, a);
+	} else if constexpr (std::is_same_v<T, __m128d>) {
+		return _mm_storeu_pd(f, a);
+#ifdef USE_AVX
+	} else if constexpr (std::is_same_v<T, __m256>) {
+		return _mm256_storeu_ps(f, a);
+#endif // USE_AVX
+#endif // USE_SSE
 
 	} else /* constexpr */ {
 		const auto &[aval] = a;
@@ -1830,7 +2124,8 @@ static inline void vst1(F *f, T a) {
 template<typename T>
 inline T vsub(T a, T b) {
 	return implement_arg2([](const auto& x, const auto& y) { return x - y; },
-	                      DN_(vsub_f32), DN_(vsubq_f32), DN64_(vsubq_f64), a, b);
+	                      DN_(vsub_f32), DN_(vsubq_f32), DN64_(vsubq_f64),
+	                      DS_(sse_sub_ps), DS_(sse_sub_pd), DA_(avx_sub_ps), a, b);
 }
 
 // Derived methods
@@ -1843,10 +2138,177 @@ static inline T vclamp(const T& value, const S& min_value, const R& max_value) {
 	return vmin(vmax(value, min_value), max_value);
 }
 
+// GRAMOPHONE: fast base 2 exponential and logarithm.
+//
+// Both split the argument into exponent and mantissa with integer bit operations and
+// approximate the remainder with a minimax polynomial evaluated by vmla(), so they work on
+// float, on internal_array_t / vector_hw_t, and on float NEON / SSE / AVX registers alike.
+// Double precision types are not supported.
+//
+// vfast_exp2(x): maximum relative error 1.6e-7 (about 2 ulp). Arguments are clamped to
+//   [-126, 127], so the result is always finite.
+// vfast_log2(x): maximum absolute error 2.3e-6 for x in [0.5, 2), and maximum relative error
+//   2e-6 elsewhere, for normal x > 0. Zero, negative, denormal, infinite and NaN arguments give
+//   unspecified results, callers must clamp beforehand.
+
+// 2^f for f in [0, 1)
+inline constexpr float kFastExp2Poly[] = {
+		0.999999925f, 0.693153073f, 0.240153617f, 0.0558263179f, 0.00898934025f, 0.00187757661f };
+// log2(1 + t) / t for t in [sqrt(0.5) - 1, sqrt(2) - 1)
+inline constexpr float kFastLog2Poly[] = {
+		1.44271348f, -0.721131858f, 0.479348021f, -0.367489994f, 0.322154775f, -0.206591638f };
+// bits of sqrt(0.5), used to center the mantissa around 1
+inline constexpr int32_t kFastLog2Offset = 0x3f3504f3;
+
+// Horner scheme, c[0] + c[1] * x + c[2] * x^2 + ...
+template<typename T, size_t N>
+static inline T vpoly(const T& x, const float (&c)[N]) {
+	T r = vdupn<T>(c[N - 1]);
+#pragma unroll
+	for (size_t k = N - 1; k > 0; --k) {
+		r = vmla(vdupn<T>(c[k - 1]), r, x);
+	}
+	return r;
+}
+
+static inline float fast_exp2_f32(float x) {
+	x = std::min(std::max(x, -126.f), 127.f);
+	const float fl = std::floor(x);
+	const float p = vpoly(x - fl, kFastExp2Poly);
+	return std::bit_cast<float>(std::bit_cast<int32_t>(p) + (static_cast<int32_t>(fl) << 23));
+}
+
+static inline float fast_log2_f32(float x) {
+	const int32_t bits = std::bit_cast<int32_t>(x);
+	const int32_t e = (bits - kFastLog2Offset) >> 23;
+	const float t = std::bit_cast<float>(bits - (e << 23)) - 1.f;
+	return t * vpoly(t, kFastLog2Poly) + static_cast<float>(e);
+}
+
+#ifdef USE_NEON
+static inline float32x2_t neon_fast_exp2_f32(float32x2_t x) {
+	x = vmin_f32(vmax_f32(x, vdup_n_f32(-126.f)), vdup_n_f32(127.f));
+#if defined(__aarch64__)
+	const float32x2_t fl = vrndm_f32(x);
+#else
+	const float32x2_t t = vcvt_f32_s32(vcvt_s32_f32(x)); // rounds towards zero
+	const float32x2_t fl = vsub_f32(t, vreinterpret_f32_u32(
+			vand_u32(vcgt_f32(t, x), vreinterpret_u32_f32(vdup_n_f32(1.f)))));
+#endif
+	const float32x2_t p = vpoly(vsub_f32(x, fl), kFastExp2Poly);
+	return vreinterpret_f32_s32(vadd_s32(vreinterpret_s32_f32(p),
+	                                     vshl_n_s32(vcvt_s32_f32(fl), 23)));
+}
+
+static inline float32x4_t neon_fast_exp2q_f32(float32x4_t x) {
+	x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-126.f)), vdupq_n_f32(127.f));
+#if defined(__aarch64__)
+	const float32x4_t fl = vrndmq_f32(x);
+#else
+	const float32x4_t t = vcvtq_f32_s32(vcvtq_s32_f32(x)); // rounds towards zero
+	const float32x4_t fl = vsubq_f32(t, vreinterpretq_f32_u32(
+			vandq_u32(vcgtq_f32(t, x), vreinterpretq_u32_f32(vdupq_n_f32(1.f)))));
+#endif
+	const float32x4_t p = vpoly(vsubq_f32(x, fl), kFastExp2Poly);
+	return vreinterpretq_f32_s32(vaddq_s32(vreinterpretq_s32_f32(p),
+	                                       vshlq_n_s32(vcvtq_s32_f32(fl), 23)));
+}
+
+static inline float32x2_t neon_fast_log2_f32(float32x2_t x) {
+	const int32x2_t bits = vreinterpret_s32_f32(x);
+	const int32x2_t e = vshr_n_s32(vsub_s32(bits, vdup_n_s32(kFastLog2Offset)), 23);
+	const float32x2_t t = vsub_f32(vreinterpret_f32_s32(vsub_s32(bits, vshl_n_s32(e, 23))),
+	                               vdup_n_f32(1.f));
+	return vadd_f32(vmul_f32(t, vpoly(t, kFastLog2Poly)), vcvt_f32_s32(e));
+}
+
+static inline float32x4_t neon_fast_log2q_f32(float32x4_t x) {
+	const int32x4_t bits = vreinterpretq_s32_f32(x);
+	const int32x4_t e = vshrq_n_s32(vsubq_s32(bits, vdupq_n_s32(kFastLog2Offset)), 23);
+	const float32x4_t t = vsubq_f32(vreinterpretq_f32_s32(vsubq_s32(bits, vshlq_n_s32(e, 23))),
+	                                vdupq_n_f32(1.f));
+	return vaddq_f32(vmulq_f32(t, vpoly(t, kFastLog2Poly)), vcvtq_f32_s32(e));
+}
+#endif // USE_NEON
+
+#ifdef USE_SSE
+static inline __m128 sse_fast_exp2_ps(__m128 x) {
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.f));
+#ifdef __SSE4_1__
+	const __m128 fl = _mm_floor_ps(x);
+#else
+	const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x)); // rounds towards zero
+	const __m128 fl = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.f)));
+#endif
+	const __m128 p = vpoly(_mm_sub_ps(x, fl), kFastExp2Poly);
+	return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(p),
+	                                      _mm_slli_epi32(_mm_cvttps_epi32(fl), 23)));
+}
+
+static inline __m128 sse_fast_log2_ps(__m128 x) {
+	const __m128i bits = _mm_castps_si128(x);
+	const __m128i e = _mm_srai_epi32(_mm_sub_epi32(bits, _mm_set1_epi32(kFastLog2Offset)), 23);
+	const __m128 t = _mm_sub_ps(_mm_castsi128_ps(_mm_sub_epi32(bits, _mm_slli_epi32(e, 23))),
+	                            _mm_set1_ps(1.f));
+	return _mm_add_ps(_mm_mul_ps(t, vpoly(t, kFastLog2Poly)), _mm_cvtepi32_ps(e));
+}
+
+#ifdef USE_AVX
+#ifdef __AVX2__
+static inline __m256 avx_fast_exp2_ps(__m256 x) {
+	x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-126.f)), _mm256_set1_ps(127.f));
+	const __m256 fl = _mm256_floor_ps(x);
+	const __m256 p = vpoly(_mm256_sub_ps(x, fl), kFastExp2Poly);
+	return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(p),
+	                                            _mm256_slli_epi32(_mm256_cvttps_epi32(fl), 23)));
+}
+
+static inline __m256 avx_fast_log2_ps(__m256 x) {
+	const __m256i bits = _mm256_castps_si256(x);
+	const __m256i e = _mm256_srai_epi32(
+			_mm256_sub_epi32(bits, _mm256_set1_epi32(kFastLog2Offset)), 23);
+	const __m256 t = _mm256_sub_ps(
+			_mm256_castsi256_ps(_mm256_sub_epi32(bits, _mm256_slli_epi32(e, 23))),
+			_mm256_set1_ps(1.f));
+	return _mm256_add_ps(_mm256_mul_ps(t, vpoly(t, kFastLog2Poly)), _mm256_cvtepi32_ps(e));
+}
+#else
+// AVX without AVX2 has no 256 bit integer operations.
+static inline __m256 avx_fast_exp2_ps(__m256 x) {
+	return _mm256_set_m128(sse_fast_exp2_ps(_mm256_extractf128_ps(x, 1)),
+	                       sse_fast_exp2_ps(_mm256_castps256_ps128(x)));
+}
+
+static inline __m256 avx_fast_log2_ps(__m256 x) {
+	return _mm256_set_m128(sse_fast_log2_ps(_mm256_extractf128_ps(x, 1)),
+	                       sse_fast_log2_ps(_mm256_castps256_ps128(x)));
+}
+#endif // __AVX2__
+#endif // USE_AVX
+#endif // USE_SSE
+
+template<typename T>
+inline T vfast_exp2(T a) {
+	return implement_arg1([](const auto& x) { return fast_exp2_f32(x); },
+	                      DN_(neon_fast_exp2_f32), DN_(neon_fast_exp2q_f32), nullptr,
+	                      DS_(sse_fast_exp2_ps), nullptr, DA_(avx_fast_exp2_ps), a);
+}
+
+template<typename T>
+inline T vfast_log2(T a) {
+	return implement_arg1([](const auto& x) { return fast_log2_f32(x); },
+	                      DN_(neon_fast_log2_f32), DN_(neon_fast_log2q_f32), nullptr,
+	                      DS_(sse_fast_log2_ps), nullptr, DA_(avx_fast_log2_ps), a);
+}
+
 } // namespace android::audio_utils::intrinsics
 
+#pragma pop_macro("DA_")
+#pragma pop_macro("DS_")
 #pragma pop_macro("DN64_")
 #pragma pop_macro("DN_")
+#pragma pop_macro("USE_AVX")
+#pragma pop_macro("USE_SSE")
 #pragma pop_macro("USE_NEON")
 
 #endif // !ANDROID_AUDIO_UTILS_INTRINSIC_UTILS_H
\ No newline at end of file
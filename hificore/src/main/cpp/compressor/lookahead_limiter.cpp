@@ -0,0 +1,184 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG "LookaheadLimiter"
+
+#include <android/log_macros.h>
+#include "lookahead_limiter.h"
+#include <jni.h>
+
+// fixed channel count: limit
+#define FCC_LIMIT 28
+
+namespace le_fx {
+
+	bool LookaheadLimiter::Initialize(float sampling_rate, size_t channel_count, float lookahead,
+									  float tau_release, float ceiling_db) {
+		if (channel_count < 1 || channel_count > FCC_LIMIT || !(sampling_rate > 0.0f)) {
+			ALOGE("%s: bad arguments: sampling_rate %f channel_count %zu", __func__,
+				  sampling_rate, channel_count);
+			return false;
+		}
+		channel_count_ = channel_count;
+		lookahead = std::clamp(lookahead, kMinLookahead, kMaxLookahead);
+		delay_ = std::max((size_t) 1, (size_t) std::lround(lookahead * sampling_rate));
+		window_ = delay_ + 1;
+		ceiling_ = std::pow(10.0f, ceiling_db / 20.0f);
+		if (tau_release > 0.0f) {
+			release_coef_ = 1.0f - std::exp(-1.0f / (tau_release * sampling_rate));
+		} else {
+			release_coef_ = 1.0f;
+		}
+		Reset();
+		return true;
+	}
+
+	void LookaheadLimiter::Reset() {
+		latency_ = delay_ + (true_peak_enabled_ ? TruePeakDetector::kDelay : 0);
+		release_gain_ = 1.0f;
+		frame_ = 0;
+		delay_line_.assign(latency_ * channel_count_, 0.0f);
+		delay_pos_ = 0;
+		deque_peak_.assign(window_, 0.0f);
+		deque_frame_.assign(window_, 0);
+		deque_head_ = 0;
+		deque_size_ = 0;
+		average_.assign(window_, 1.0f);
+		average_pos_ = 0;
+		average_sum_ = static_cast<double>(window_);
+		true_peak_.Reset();
+		std::fill(std::begin(peak_delay_), std::end(peak_delay_), 0.0f);
+		peak_delay_pos_ = 0;
+		last_true_peak_ = 0.0f;
+	}
+
+	void LookaheadLimiter::SetTruePeak(bool enabled) {
+		if (enabled == true_peak_enabled_)
+			return;
+		true_peak_enabled_ = enabled;
+		// before Initialize(), the state is set up there
+		if (window_ > 0) {
+			Reset();
+		}
+	}
+
+// Instantiate Process for supported channel counts.
+#define INSTANTIATE_PROCESS(CHANNEL_COUNT) \
+case CHANNEL_COUNT: \
+    if constexpr (CHANNEL_COUNT <= FCC_LIMIT) { \
+        Process<vector_hw_t<float, CHANNEL_COUNT>>(in, out, frameCount); \
+        return; \
+    } \
+    break;
+
+	void LookaheadLimiter::Process(const float* in, float* out, size_t frameCount) {
+		using android::audio_utils::intrinsics::vector_hw_t;
+		switch (channel_count_) {
+			INSTANTIATE_PROCESS(1)
+			INSTANTIATE_PROCESS(2)
+			INSTANTIATE_PROCESS(3)
+			INSTANTIATE_PROCESS(4)
+			INSTANTIATE_PROCESS(5)
+			INSTANTIATE_PROCESS(6)
+			INSTANTIATE_PROCESS(7)
+			INSTANTIATE_PROCESS(8)
+			INSTANTIATE_PROCESS(9)
+			INSTANTIATE_PROCESS(10)
+			INSTANTIATE_PROCESS(11)
+			INSTANTIATE_PROCESS(12)
+			INSTANTIATE_PROCESS(13)
+			INSTANTIATE_PROCESS(14)
+			INSTANTIATE_PROCESS(15)
+			INSTANTIATE_PROCESS(16)
+			INSTANTIATE_PROCESS(17)
+			INSTANTIATE_PROCESS(18)
+			INSTANTIATE_PROCESS(19)
+			INSTANTIATE_PROCESS(20)
+			INSTANTIATE_PROCESS(21)
+			INSTANTIATE_PROCESS(22)
+			INSTANTIATE_PROCESS(23)
+			INSTANTIATE_PROCESS(24)
+			INSTANTIATE_PROCESS(25)
+			INSTANTIATE_PROCESS(26)
+			INSTANTIATE_PROCESS(27)
+			INSTANTIATE_PROCESS(28)
+			default:
+				break;
+		}
+		ALOGE("%s: channelCount: %zu not supported", __func__, channel_count_);
+		abort();
+	}
+
+}  // namespace le_fx
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_create(JNIEnv *, jobject) {
+	return (intptr_t) new le_fx::LookaheadLimiter();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_releaseNative(JNIEnv *, jobject, jlong ptr) {
+	auto obj = (le_fx::LookaheadLimiter*) ptr;
+	delete obj;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_initNative(JNIEnv *, jobject, jlong ptr,
+                                                               jfloat sampling_rate,
+                                                               jint channel_count,
+                                                               jfloat lookahead,
+                                                               jfloat tau_release,
+                                                               jfloat ceiling_db) {
+	auto obj = (le_fx::LookaheadLimiter*) ptr;
+	if (channel_count < 1) {
+		ALOGE("%s: bad channel count %d", __func__, channel_count);
+		return false;
+	}
+	return obj->Initialize(sampling_rate, channel_count, lookahead, tau_release, ceiling_db);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_getLatencyNative(JNIEnv *, jobject,
+                                                                     jlong ptr) {
+	auto obj = (le_fx::LookaheadLimiter*) ptr;
+	return (jint) obj->GetLatency();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_setTruePeakNative(JNIEnv *, jobject,
+                                                                      jlong ptr,
+                                                                      jboolean enabled) {
+	auto obj = (le_fx::LookaheadLimiter*) ptr;
+	obj->SetTruePeak(enabled);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LookaheadLimiter_processNative(JNIEnv *env, jobject,
+                                                                  jlong ptr, jobject in_buf,
+                                                                  jobject out_buf,
+                                                                  jint frame_count) {
+	auto obj = (le_fx::LookaheadLimiter*) ptr;
+	auto in = (float*) env->GetDirectBufferAddress(in_buf);
+	auto out = (float*) env->GetDirectBufferAddress(out_buf);
+	obj->Process(in, out, frame_count);
+}
@@ -0,0 +1,168 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_LOOKAHEAD_LIMITER_H
+#define GRAMOPHONE_LOOKAHEAD_LIMITER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "intrinsic_utils.h"
+#include "true_peak_detector.h"
+
+namespace le_fx {
+
+// A brick-wall peak limiter with lookahead. The input is delayed by the lookahead, while the
+// gain for each frame is derived from the largest peak in the next lookahead + 1 frames:
+//
+// 1. the maximum absolute sample of the window is tracked with a monotonic deque,
+//    and turned into the largest gain h that keeps the window below the ceiling,
+// 2. h recovers towards 1 with an exponential release, but never above h,
+// 3. a moving average over the same window length smooths the attack.
+//
+// Every value averaged in step 3 saw the frame that is being output in its window, so the
+// average can't exceed the gain required by that frame, and no output sample exceeds the
+// ceiling. The attack is a linear fade over the lookahead instead of a step.
+class LookaheadLimiter {
+public:
+	LookaheadLimiter() = default;
+	LookaheadLimiter(const LookaheadLimiter&) = delete;
+	LookaheadLimiter& operator=(const LookaheadLimiter&) = delete;
+
+	static constexpr float kMinLookahead = 0.001f;
+	static constexpr float kMaxLookahead = 0.005f;
+
+	// lookahead is clamped to [kMinLookahead, kMaxLookahead] seconds. Resets all state, so the
+	// first GetLatency() frames of output after this are silent.
+	bool Initialize(float sampling_rate, size_t channel_count, float lookahead,
+					float tau_release, float ceiling_db);
+
+	// Added delay in frames.
+	size_t GetLatency() const { return latency_; }
+
+	// Interleaved channels expected by Process(), 0 before Initialize().
+	size_t GetChannelCount() const { return channel_count_; }
+
+	// Also limit the 4x oversampled true peak (see TruePeakDetector), so that the ceiling holds
+	// for inter-sample peaks as well, up to the error from the gain changing within the span of
+	// the interpolation filter. The detector reports a peak TruePeakDetector::kDelay frames late,
+	// so the samples are delayed by that much more: GetLatency() grows by kDelay. Changing it
+	// resets all state like Initialize() does. Off by default.
+	void SetTruePeak(bool enabled);
+
+	// optionally, in-place processing if in == out.
+	void Process(const float* in, float* out, size_t frameCount);
+
+	// Feeds the peak of the newest frame and returns the gain for the oldest delayed frame.
+	// Process() calls this once per frame, it's only public for the tests.
+	float NextGain(float peak) {
+		// Evict the front first if it's about to leave the window, so that the deque never
+		// holds more than window_ entries and the push can't overwrite the current maximum.
+		if (deque_size_ > 0 && deque_frame_[deque_head_] + window_ <= frame_) {
+			deque_head_ = (deque_head_ + 1) % window_;
+			--deque_size_;
+		}
+		// monotonic deque: values strictly decreasing from front to back
+		while (deque_size_ > 0 && deque_peak_[DequeBack()] <= peak) {
+			--deque_size_;
+		}
+		const size_t back = (deque_head_ + deque_size_) % window_;
+		deque_peak_[back] = peak;
+		deque_frame_[back] = frame_;
+		++deque_size_;
+		++frame_;
+		const float max_peak = deque_peak_[deque_head_];
+		const float hold = max_peak > ceiling_ ? ceiling_ / max_peak : 1.0f;
+		release_gain_ = std::min(hold, release_gain_ + (1.0f - release_gain_) * release_coef_);
+		average_sum_ += release_gain_ - average_[average_pos_];
+		average_[average_pos_] = release_gain_;
+		if (++average_pos_ == window_) average_pos_ = 0;
+		return static_cast<float>(average_sum_ / static_cast<double>(window_));
+	}
+
+	// Largest peak passed to NextGain() within the window of its last lookahead + 1 calls, for
+	// the tests.
+	float GetWindowPeak() const { return deque_size_ > 0 ? deque_peak_[deque_head_] : 0.0f; }
+
+private:
+	template <typename V>
+	void Process(const float* in, float* out, size_t frameCount) {
+		using namespace android::audio_utils::intrinsics;
+		for (size_t i = 0; i < frameCount; ++i) {
+			const V x = vld1<V>(in + i * V::size());
+			float peak = vmaxv(vabs(x));
+			if (true_peak_enabled_) {
+				// The detector only now returns the points between frame i - kDelay and the next
+				// one. Feed them together with the points before that frame and its delayed
+				// sample peak, so every gain which applies to a frame saw both of its sides.
+				const float true_peak = true_peak_.Next(x);
+				const float sample_peak = peak_delay_[peak_delay_pos_];
+				peak_delay_[peak_delay_pos_] = peak;
+				if (++peak_delay_pos_ == TruePeakDetector::kDelay) peak_delay_pos_ = 0;
+				peak = std::max({ sample_peak, true_peak, last_true_peak_ });
+				last_true_peak_ = true_peak;
+			}
+			const float gain = NextGain(peak);
+			float* slot = delay_line_.data() + delay_pos_ * V::size();
+			const V delayed = vld1<V>(slot);
+			vst1(slot, x);
+			if (++delay_pos_ == latency_) delay_pos_ = 0;
+			// the gain alone keeps us below the ceiling, the clamp only catches rounding
+			vst1(out + i * V::size(), vclamp(vmul(delayed, gain), -ceiling_, ceiling_));
+		}
+	}
+
+	void Reset();
+
+	size_t DequeBack() const {
+		return (deque_head_ + deque_size_ - 1) % window_;
+	}
+
+	bool true_peak_enabled_ = false;
+	TruePeakDetector true_peak_;
+	// sample peaks of the last kDelay frames, and the true peak of the previous frame
+	float peak_delay_[TruePeakDetector::kDelay] = {};
+	size_t peak_delay_pos_ = 0;
+	float last_true_peak_ = 0.0f;
+	size_t channel_count_ = 0;
+	// lookahead in frames, window_ is delay_ + 1
+	size_t delay_ = 0;
+	// delay_, plus kDelay with true peak
+	size_t latency_ = 0;
+	size_t window_ = 0;
+	float ceiling_ = 1.0f;
+	// 1 - alpha of the release smoothing
+	float release_coef_ = 0.0f;
+	float release_gain_ = 1.0f;
+	uint64_t frame_ = 0;
+	// interleaved, latency_ frames
+	std::vector<float> delay_line_;
+	size_t delay_pos_ = 0;
+	// ring buffers with window_ entries each
+	std::vector<float> deque_peak_;
+	std::vector<uint64_t> deque_frame_;
+	size_t deque_head_ = 0;
+	size_t deque_size_ = 0;
+	std::vector<float> average_;
+	size_t average_pos_ = 0;
+	double average_sum_ = 0.0;
+};
+
+}  // namespace le_fx
+
+#endif  // GRAMOPHONE_LOOKAHEAD_LIMITER_H
@@ -0,0 +1,276 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG "LoudnessMeter"
+
+#include <android/log_macros.h>
+#include "loudness_meter.h"
+#include <jni.h>
+
+// fixed channel count: limit
+#define FCC_LIMIT 28
+
+namespace le_fx {
+
+	bool LoudnessMeter::Initialize(float sampling_rate, size_t channel_count) {
+		if (channel_count < 1 || channel_count > FCC_LIMIT || !(sampling_rate >= 1000.0f)) {
+			ALOGE("%s: bad arguments: sampling_rate %f channel_count %zu", __func__,
+				  sampling_rate, channel_count);
+			return false;
+		}
+		channel_count_ = channel_count;
+		sub_block_frames_ = std::max((size_t) 1, (size_t) std::lround(sampling_rate / 10.0f));
+		sub_block_pos_ = 0;
+		sub_block_count_ = 0;
+		// K-weighting for arbitrary sample rates, coefficients as in libebur128
+		const double rate = sampling_rate;
+		double f0 = 1681.974450955533;
+		const double G = 3.999843853973347;
+		double Q = 0.7071752369554196;
+		double K = std::tan(M_PI * f0 / rate);
+		const double Vh = std::pow(10.0, G / 20.0);
+		const double Vb = std::pow(Vh, 0.4996667741545416);
+		double a0 = 1.0 + K / Q + K * K;
+		b_[0][0] = static_cast<float>((Vh + Vb * K / Q + K * K) / a0);
+		b_[0][1] = static_cast<float>(2.0 * (K * K - Vh) / a0);
+		b_[0][2] = static_cast<float>((Vh - Vb * K / Q + K * K) / a0);
+		a_[0][0] = 1.0f;
+		a_[0][1] = static_cast<float>(2.0 * (K * K - 1.0) / a0);
+		a_[0][2] = static_cast<float>((1.0 - K / Q + K * K) / a0);
+		f0 = 38.13547087602444;
+		Q = 0.5003270373238773;
+		K = std::tan(M_PI * f0 / rate);
+		a0 = 1.0 + K / Q + K * K;
+		b_[1][0] = 1.0f;
+		b_[1][1] = -2.0f;
+		b_[1][2] = 1.0f;
+		a_[1][0] = 1.0f;
+		a_[1][1] = static_cast<float>(2.0 * (K * K - 1.0) / a0);
+		a_[1][2] = static_cast<float>((1.0 - K / Q + K * K) / a0);
+		std::fill(std::begin(weights_), std::end(weights_), 1.0f);
+		if (channel_count_ == 5) {
+			weights_[3] = weights_[4] = 1.41f;
+		} else if (channel_count_ == 6) {
+			weights_[3] = 0.0f;
+			weights_[4] = weights_[5] = 1.41f;
+		}
+		for (auto& s : state_) std::fill(std::begin(s), std::end(s), 0.0f);
+		std::fill(std::begin(energy_), std::end(energy_), 0.0f);
+		std::fill(std::begin(peak_), std::end(peak_), 0.0f);
+		std::fill(std::begin(sub_blocks_), std::end(sub_blocks_), 0.0);
+		true_peak_ = 0.0f;
+		true_peak_detector_.Reset();
+		momentary_.Reset();
+		short_term_.Reset();
+		return true;
+	}
+
+	void LoudnessMeter::Histogram::Add(double e) {
+		const float loudness = EnergyToLoudness(e);
+		if (!(loudness >= kAbsoluteGate)) return;
+		const auto bin = std::min(kHistogramBins - 1, static_cast<size_t>(
+				(loudness - kAbsoluteGate) * kHistogramBins / (kHistogramMax - kAbsoluteGate)));
+		++count[bin];
+		energy[bin] += e;
+	}
+
+	size_t LoudnessMeter::Histogram::RelativeGateBin(float gate) const {
+		uint64_t n = 0;
+		double sum = 0.0;
+		for (size_t i = 0; i < kHistogramBins; ++i) {
+			n += count[i];
+			sum += energy[i];
+		}
+		if (n == 0) return kHistogramBins;
+		const float threshold = EnergyToLoudness(sum / static_cast<double>(n)) + gate;
+		if (threshold < kAbsoluteGate) return 0;
+		return std::min(kHistogramBins, static_cast<size_t>(std::ceil(
+				(threshold - kAbsoluteGate) * kHistogramBins / (kHistogramMax - kAbsoluteGate))));
+	}
+
+	void LoudnessMeter::EndSubBlock() {
+		double e = 0.0;
+		for (size_t c = 0; c < channel_count_; ++c) {
+			e += static_cast<double>(weights_[c]) * energy_[c];
+			energy_[c] = 0.0f;
+		}
+		sub_blocks_[sub_block_count_ % kShortTermSubBlocks] = e / static_cast<double>(sub_block_frames_);
+		++sub_block_count_;
+		sub_block_pos_ = 0;
+		if (sub_block_count_ >= kMomentarySubBlocks) {
+			double sum = 0.0;
+			for (size_t i = 1; i <= kMomentarySubBlocks; ++i) {
+				sum += sub_blocks_[(sub_block_count_ - i) % kShortTermSubBlocks];
+			}
+			momentary_.Add(sum / kMomentarySubBlocks);
+		}
+		if (sub_block_count_ >= kShortTermSubBlocks) {
+			double sum = 0.0;
+			for (double b : sub_blocks_) sum += b;
+			short_term_.Add(sum / kShortTermSubBlocks);
+		}
+	}
+
+	float LoudnessMeter::GetIntegratedLoudness() const {
+		uint64_t n = 0;
+		double sum = 0.0;
+		for (size_t i = momentary_.RelativeGateBin(-10.0f); i < kHistogramBins; ++i) {
+			n += momentary_.count[i];
+			sum += momentary_.energy[i];
+		}
+		if (n == 0) return -HUGE_VALF;
+		return EnergyToLoudness(sum / static_cast<double>(n));
+	}
+
+	float LoudnessMeter::GetLoudnessRange() const {
+		const size_t gate = short_term_.RelativeGateBin(-20.0f);
+		uint64_t n = 0;
+		for (size_t i = gate; i < kHistogramBins; ++i) n += short_term_.count[i];
+		if (n == 0) return 0.0f;
+		// 10th and 95th percentile, as in EBU Tech 3342
+		const uint64_t low_index = n / 10;
+		const uint64_t high_index = std::min(n - 1, n * 95 / 100);
+		float low = 0.0f, high = 0.0f;
+		uint64_t seen = 0;
+		for (size_t i = gate; i < kHistogramBins; ++i) {
+			if (short_term_.count[i] == 0) continue;
+			const uint64_t next = seen + short_term_.count[i];
+			if (seen <= low_index && low_index < next) low = BinToLoudness(i);
+			if (seen <= high_index && high_index < next) {
+				high = BinToLoudness(i);
+				break;
+			}
+			seen = next;
+		}
+		return high - low;
+	}
+
+	float LoudnessMeter::GetSamplePeak() const {
+		return *std::max_element(peak_, peak_ + std::max((size_t) 1, channel_count_));
+	}
+
+// Instantiate ProcessSegment for supported channel counts.
+#define INSTANTIATE_PROCESS(CHANNEL_COUNT) \
+case CHANNEL_COUNT: \
+    if constexpr (CHANNEL_COUNT <= FCC_LIMIT) { \
+        ProcessSegment<vector_hw_t<float, CHANNEL_COUNT>>(in, frameCount); \
+        return; \
+    } \
+    break;
+
+	void LoudnessMeter::ProcessSegment(const float* in, size_t frameCount) {
+		using android::audio_utils::intrinsics::vector_hw_t;
+		switch (channel_count_) {
+			INSTANTIATE_PROCESS(1)
+			INSTANTIATE_PROCESS(2)
+			INSTANTIATE_PROCESS(3)
+			INSTANTIATE_PROCESS(4)
+			INSTANTIATE_PROCESS(5)
+			INSTANTIATE_PROCESS(6)
+			INSTANTIATE_PROCESS(7)
+			INSTANTIATE_PROCESS(8)
+			INSTANTIATE_PROCESS(9)
+			INSTANTIATE_PROCESS(10)
+			INSTANTIATE_PROCESS(11)
+			INSTANTIATE_PROCESS(12)
+			INSTANTIATE_PROCESS(13)
+			INSTANTIATE_PROCESS(14)
+			INSTANTIATE_PROCESS(15)
+			INSTANTIATE_PROCESS(16)
+			INSTANTIATE_PROCESS(17)
+			INSTANTIATE_PROCESS(18)
+			INSTANTIATE_PROCESS(19)
+			INSTANTIATE_PROCESS(20)
+			INSTANTIATE_PROCESS(21)
+			INSTANTIATE_PROCESS(22)
+			INSTANTIATE_PROCESS(23)
+			INSTANTIATE_PROCESS(24)
+			INSTANTIATE_PROCESS(25)
+			INSTANTIATE_PROCESS(26)
+			INSTANTIATE_PROCESS(27)
+			INSTANTIATE_PROCESS(28)
+			default:
+				break;
+		}
+		ALOGE("%s: channelCount: %zu not supported", __func__, channel_count_);
+		abort();
+	}
+
+	void LoudnessMeter::Process(const float* in, size_t frameCount) {
+		while (frameCount > 0) {
+			// sub-blocks must not straddle ProcessSegment() calls
+			const size_t n = std::min(frameCount, sub_block_frames_ - sub_block_pos_);
+			ProcessSegment(in, n);
+			in += n * channel_count_;
+			frameCount -= n;
+			sub_block_pos_ += n;
+			if (sub_block_pos_ == sub_block_frames_) {
+				EndSubBlock();
+			}
+		}
+	}
+
+}  // namespace le_fx
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessMeter_create(JNIEnv *, jobject) {
+	return (intptr_t) new le_fx::LoudnessMeter();
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessMeter_releaseNative(JNIEnv *, jobject, jlong ptr) {
+	auto obj = (le_fx::LoudnessMeter*) ptr;
+	delete obj;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessMeter_initNative(JNIEnv *, jobject, jlong ptr,
+                                                            jfloat sampling_rate,
+                                                            jint channel_count) {
+	auto obj = (le_fx::LoudnessMeter*) ptr;
+	if (channel_count < 1) {
+		ALOGE("%s: bad channel count %d", __func__, channel_count);
+		return false;
+	}
+	return obj->Initialize(sampling_rate, channel_count);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessMeter_processNative(JNIEnv *env, jobject, jlong ptr,
+                                                               jobject in_buf, jint frame_count) {
+	auto obj = (le_fx::LoudnessMeter*) ptr;
+	auto in = (float*) env->GetDirectBufferAddress(in_buf);
+	obj->Process(in, frame_count);
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_org_nift4_gramophone_hificore_LoudnessMeter_getResultsNative(JNIEnv *env, jobject,
+                                                                  jlong ptr, jfloatArray out) {
+	auto obj = (le_fx::LoudnessMeter*) ptr;
+	const jfloat results[] = {
+			obj->GetIntegratedLoudness(),
+			obj->GetLoudnessRange(),
+			obj->GetTruePeak(),
+			obj->GetSamplePeak(),
+	};
+	env->SetFloatArrayRegion(out, 0, sizeof(results) / sizeof(results[0]), results);
+}
@@ -0,0 +1,141 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_LOUDNESS_METER_H
+#define GRAMOPHONE_LOUDNESS_METER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "intrinsic_utils.h"
+#include "true_peak_detector.h"
+
+namespace le_fx {
+
+// Streaming loudness meter after ITU-R BS.1770-4 and EBU Tech 3341 / 3342.
+//
+// The signal is K-weighted with two biquads per channel, and the mean square is collected per
+// 100ms sub-block. Every sub-block completes a 400ms momentary block (75% overlap), and once
+// 3s have been seen, a short-term block. Instead of keeping every block, their loudness is
+// binned into histograms with 0.01 LU resolution, so memory use does not grow with the length
+// of the stream and the gating can be evaluated at any time.
+//
+// Channels are weighted as in BS.1770 if there are 5 or 6 of them (L R C [LFE] Ls Rs order,
+// LFE is ignored), otherwise all channels count the same.
+class LoudnessMeter {
+public:
+	LoudnessMeter() = default;
+	LoudnessMeter(const LoudnessMeter&) = delete;
+	LoudnessMeter& operator=(const LoudnessMeter&) = delete;
+
+	// Resets all state.
+	bool Initialize(float sampling_rate, size_t channel_count);
+
+	void Process(const float* in, size_t frameCount);
+
+	// Gated integrated loudness in LUFS, -HUGE_VALF if no block is above the absolute gate.
+	float GetIntegratedLoudness() const;
+	// Loudness range in LU, 0 if less than 3s were seen.
+	float GetLoudnessRange() const;
+	// Largest absolute value of the 4x oversampled signal, linear.
+	float GetTruePeak() const { return true_peak_; }
+	// Largest absolute sample value, linear.
+	float GetSamplePeak() const;
+
+private:
+	static constexpr size_t kMaxChannels = TruePeakDetector::kMaxChannels;
+	static constexpr size_t kMomentarySubBlocks = 4;
+	static constexpr size_t kShortTermSubBlocks = 30;
+	static constexpr float kAbsoluteGate = -70.0f;
+	static constexpr float kHistogramMax = 10.0f;
+	static constexpr size_t kHistogramBins = 8000; // 0.01 LU per bin
+
+	struct Histogram {
+		std::vector<uint32_t> count;
+		std::vector<double> energy;
+		void Reset() {
+			count.assign(kHistogramBins, 0);
+			energy.assign(kHistogramBins, 0.0);
+		}
+		void Add(double e);
+		// Lowest bin at or above the relative gate (mean energy of all blocks + gate), or
+		// kHistogramBins if there are no blocks.
+		size_t RelativeGateBin(float gate) const;
+	};
+
+	static float EnergyToLoudness(double e) {
+		return -0.691f + 10.0f * std::log10(static_cast<float>(e));
+	}
+	static float BinToLoudness(size_t bin) {
+		return kAbsoluteGate + static_cast<float>(bin) * (kHistogramMax - kAbsoluteGate) /
+				static_cast<float>(kHistogramBins);
+	}
+
+	void ProcessSegment(const float* in, size_t frameCount);
+
+	template <typename V>
+	void ProcessSegment(const float* in, size_t frameCount) {
+		using namespace android::audio_utils::intrinsics;
+		constexpr size_t N = V::size();
+		V z[4];
+		for (size_t s = 0; s < 4; ++s) z[s] = vld1<V>(state_[s]);
+		V acc = vld1<V>(energy_);
+		V peak = vld1<V>(peak_);
+		float true_peak = true_peak_;
+		for (size_t i = 0; i < frameCount; ++i) {
+			const V x = vld1<V>(in + i * N);
+			peak = vmax(peak, vabs(x));
+			true_peak = std::max(true_peak, true_peak_detector_.Next(x));
+			// two transposed direct form II biquads: pre-filter (high shelf), then RLB high-pass
+			const V y1 = vmla(z[0], x, b_[0][0]);
+			z[0] = vmla(vmla(z[1], x, b_[0][1]), y1, -a_[0][1]);
+			z[1] = vmla(vmul(x, b_[0][2]), y1, -a_[0][2]);
+			const V y2 = vmla(z[2], y1, b_[1][0]);
+			z[2] = vmla(vmla(z[3], y1, b_[1][1]), y2, -a_[1][1]);
+			z[3] = vmla(vmul(y1, b_[1][2]), y2, -a_[1][2]);
+			acc = vmla(acc, y2, y2);
+		}
+		for (size_t s = 0; s < 4; ++s) vst1(state_[s], z[s]);
+		vst1(energy_, acc);
+		vst1(peak_, peak);
+		true_peak_ = true_peak;
+	}
+
+	void EndSubBlock();
+
+	size_t channel_count_ = 0;
+	size_t sub_block_frames_ = 0;
+	size_t sub_block_pos_ = 0;
+	uint64_t sub_block_count_ = 0;
+	float b_[2][3];
+	float a_[2][3];
+	float weights_[kMaxChannels];
+	float state_[4][kMaxChannels];
+	float energy_[kMaxChannels];
+	float peak_[kMaxChannels];
+	float true_peak_ = 0.0f;
+	TruePeakDetector true_peak_detector_;
+	// weighted mean square of the last kShortTermSubBlocks sub-blocks
+	double sub_blocks_[kShortTermSubBlocks];
+	Histogram momentary_;
+	Histogram short_term_;
+};
+
+}  // namespace le_fx
+
+#endif  // GRAMOPHONE_LOUDNESS_METER_H
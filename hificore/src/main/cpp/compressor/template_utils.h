@@ -259,7 +259,7 @@ auto structure_to_tuple(const T& t) {
 		auto&& [t1] = t;
 		return std::make_tuple(t1);
 	} else {
-		static_assert(false, "Currently supports up to 20 members only.");
+		static_assert(dependent_false_v<T>, "Currently supports up to 20 members only.");
 	}
 }
 
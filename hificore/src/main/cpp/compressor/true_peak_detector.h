@@ -0,0 +1,101 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_TRUE_PEAK_DETECTOR_H
+#define GRAMOPHONE_TRUE_PEAK_DETECTOR_H
+
+#include <algorithm>
+#include <cstring>
+#include "intrinsic_utils.h"
+
+namespace le_fx {
+
+// Estimates the peak of the reconstructed analog signal, including inter-sample overs, by 4x
+// oversampling with the 48-tap polyphase FIR from ITU-R BS.1770-4 Annex 2. The 4 phases of a
+// channel are computed at once, one vector lane per phase.
+//
+// The filter has a group delay of 5.5 frames, so the value returned for a frame describes the
+// signal around 5 to 6 frames earlier. For impulsive signals, it can be up to 0.25dB below the
+// sample peak, so callers should take the maximum with the plain sample peak.
+class TruePeakDetector {
+public:
+	static constexpr size_t kMaxChannels = 28;
+	static constexpr size_t kPhases = 4;
+	static constexpr size_t kTaps = 12;
+	// The points returned by Next() for frame t lie between frames t - kDelay and t - kDelay + 1.
+	static constexpr size_t kDelay = 6;
+
+	void Reset() {
+		std::fill(std::begin(history_), std::end(history_), 0.0f);
+		pos_ = 0;
+	}
+
+	// Pushes the next frame and returns the largest absolute value of the 4 interpolated points
+	// over all channels. V::size() must stay the same between calls until Reset().
+	template <typename V>
+	float Next(const V& x) {
+		using namespace android::audio_utils::intrinsics;
+		using P = vector_hw_t<float, kPhases>;
+		static_assert(V::size() <= kMaxChannels);
+		constexpr size_t N = V::size();
+		float frame[N];
+		vst1(frame, x);
+		const size_t pos = pos_;
+		if (++pos_ == kTaps) pos_ = 0;
+		// The phases are in the vector lanes, so each channel is a dot product of its history
+		// with the coefficient vectors. Two accumulators halve the dependency chain.
+		P peak = vdupn<P>(0.0f);
+		for (size_t c = 0; c < N; ++c) {
+			float* history = history_ + c * 2 * kTaps;
+			// every frame is stored twice so the newest kTaps frames are always contiguous
+			history[pos] = history[pos + kTaps] = frame[c];
+			const float* window = history + pos_; // oldest first
+			P acc0 = vmul(vld1<P>(kCoefficients[0]), window[0]);
+			P acc1 = vmul(vld1<P>(kCoefficients[1]), window[1]);
+			for (size_t k = 2; k < kTaps; k += 2) {
+				acc0 = vmla(acc0, vld1<P>(kCoefficients[k]), window[k]);
+				acc1 = vmla(acc1, vld1<P>(kCoefficients[k + 1]), window[k + 1]);
+			}
+			peak = vmax(peak, vabs(vadd(acc0, acc1)));
+		}
+		return vmaxv(peak);
+	}
+
+private:
+	// kCoefficients[k][p] is applied to the k-th oldest of the last kTaps frames to get phase p.
+	static constexpr float kCoefficients[kTaps][kPhases] = {
+			{ -0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f },
+			{  0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f },
+			{ -0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f },
+			{  0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f },
+			{ -0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f },
+			{  0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f },
+			{  0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f },
+			{ -0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f },
+			{  0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f },
+			{ -0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f },
+			{  0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f },
+			{  0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f },
+	};
+
+	float history_[2 * kTaps * kMaxChannels] = {};
+	size_t pos_ = 0;
+};
+
+}  // namespace le_fx
+
+#endif  // GRAMOPHONE_TRUE_PEAK_DETECTOR_H
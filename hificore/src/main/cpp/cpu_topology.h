@@ -0,0 +1,80 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_CPU_TOPOLOGY_H
+#define GRAMOPHONE_CPU_TOPOLOGY_H
+
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// Core clusters, told apart by their maximum frequency according to cpufreq. Must match
+// NativeTrack.CpuCluster.
+#define CPU_CLUSTER_ANY 0
+#define CPU_CLUSTER_LITTLE 1 // the slowest cores
+#define CPU_CLUSTER_BIG 2 // everything except the slowest cores
+#define CPU_CLUSTER_PRIME 3 // the fastest cores
+
+// Maximum frequency of every configured core, 0 if it can't be read (e.g. offline core).
+static inline std::vector<long> cpuMaxFreqs() {
+    const long cores = std::max(1L, sysconf(_SC_NPROCESSORS_CONF));
+    std::vector<long> maxFreq(cores, 0);
+    for (long i = 0; i < cores; i++) {
+        char path[80];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cpufreq/cpuinfo_max_freq", i);
+        FILE* f = fopen(path, "re");
+        if (f == nullptr) continue;
+        if (fscanf(f, "%ld", &maxFreq[i]) != 1) maxFreq[i] = 0;
+        fclose(f);
+    }
+    return maxFreq;
+}
+
+// Fills set with the cores of the cluster. If all cores are the same or cpufreq can't be read,
+// every cluster contains all cores. Returns the amount of cores in the set.
+static inline int cpuClusterSet(int cluster, cpu_set_t* set) {
+    const std::vector<long> maxFreq = cpuMaxFreqs();
+    long lowest = 0, highest = 0;
+    for (long freq : maxFreq) {
+        if (freq > 0 && (lowest == 0 || freq < lowest)) lowest = freq;
+        highest = std::max(highest, freq);
+    }
+    const bool uniform = lowest == highest;
+    CPU_ZERO(set);
+    for (size_t i = 0; i < maxFreq.size() && i < CPU_SETSIZE; i++) {
+        bool in;
+        switch (uniform ? CPU_CLUSTER_ANY : cluster) {
+            case CPU_CLUSTER_LITTLE: in = maxFreq[i] == lowest; break;
+            case CPU_CLUSTER_BIG: in = maxFreq[i] > lowest; break;
+            case CPU_CLUSTER_PRIME: in = maxFreq[i] == highest; break;
+            default: in = true; break;
+        }
+        if (in) CPU_SET(i, set);
+    }
+    return CPU_COUNT(set);
+}
+
+// Number of cores outside of the slowest cluster, or all cores if they are all the same or
+// cpufreq can't be read.
+static inline unsigned bigCoreCount() {
+    cpu_set_t set;
+    return std::max(1, cpuClusterSet(CPU_CLUSTER_BIG, &set));
+}
+
+#endif //GRAMOPHONE_CPU_TOPOLOGY_H
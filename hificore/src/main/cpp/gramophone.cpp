@@ -23,16 +23,21 @@
 #include "audio-legacy.h"
 #include <dlfcn.h>
 #include <android/log_macros.h>
+#include <cstddef>
 #include <cstdlib>
 #include <string>
 #include <vector>
 #include <unistd.h>
-#include <thread>
+#include <fcntl.h>
+#include <cerrno>
+#include <mutex>
+#include <cstring>
 #include <dlfunc.h>
 #include "helpers.h"
+#include "jni_cache.h"
+#include "struct_offsets.h"
 
 static bool init_done = false;
-static jmethodID nativeGetFlags = nullptr;
 void *libaudioclient_handle = nullptr;
 void* libpermission_handle = nullptr;
 void* libandroid_runtime_handle = nullptr;
@@ -71,9 +76,6 @@ typedef status_t(*ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17a
         LEGACY_audio_port_role_t, LEGACY_audio_port_type_t, unsigned int *, void *, unsigned int *);
 
 static ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3__t ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_ = nullptr;
-static intptr_t gIoHandleOffset = 0;
-static intptr_t gIoHandle2Offset = 0;
-static intptr_t gTrackFlagsOffset = 0;
 
 typedef bool(*ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi_t)(void* thisptr, uint32_t output);
 static ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi_t ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi = nullptr;
@@ -224,36 +226,125 @@ Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_getOutputInternal(
     return ZNK7android10AudioTrack9getOutputEv((void *) audioTrack);
 }
 
+// AudioTrack::dump() output is a few hundred bytes, which easily fits into a pipe's buffer, so it
+// can be written and read back on the calling thread without a reader thread. Both ends are
+// non-blocking: if a dump ever is larger than the pipe, it gets cut off instead of deadlocking.
+// The pipe is created once and emptied after every dump.
+static std::mutex gDumpLock;
+static int gDumpPipe[2] = { -1, -1 };
+static char gDumpBuffer[8192];
+
+// Must hold gDumpLock. Returns the length of the dump in gDumpBuffer (which is null-terminated),
+// or -1 on error.
+static ssize_t dumpTrackLocked(void* audioTrack) {
+    if (gDumpPipe[0] == -1) {
+        if (pipe2(gDumpPipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+            ALOGE("pipe2() syscall failed: %s", strerror(errno));
+            gDumpPipe[0] = gDumpPipe[1] = -1;
+            return -1;
+        }
+        // best effort, the default of 64KiB is plenty too
+        fcntl(gDumpPipe[1], F_SETPIPE_SZ, (int) sizeof(gDumpBuffer));
+    }
+    // last argument is not allowed to be null, but where will we get a vector?
+    ZNK7android10AudioTrack4dumpEiRKNS_6VectorINS_8String16EEE(audioTrack, gDumpPipe[1],
+                                                               (void *) 0xdeadbaad);
+    size_t length = 0;
+    while (true) {
+        char discard[256];
+        const bool full = length == sizeof(gDumpBuffer) - 1;
+        const ssize_t ret = full ? read(gDumpPipe[0], discard, sizeof(discard))
+                                 : read(gDumpPipe[0], gDumpBuffer + length,
+                                        sizeof(gDumpBuffer) - 1 - length);
+        if (ret > 0) {
+            if (!full) length += ret;
+            continue;
+        }
+        if (ret == -1 && errno == EINTR)
+            continue;
+        break; // EAGAIN means the pipe is empty
+    }
+    gDumpBuffer[length] = '\0';
+    return (ssize_t) length;
+}
+
 extern "C" JNIEXPORT jstring JNICALL
 Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_dumpInternal(
         JNIEnv *env, jobject, jlong audioTrack) {
     if (!initLib(env))
         return nullptr;
     DLSYM_OR_RETURN(libaudioclient, ZNK7android10AudioTrack4dumpEiRKNS_6VectorINS_8String16EEE, nullptr)
-    int pipe_fds[2];
-    if (pipe(pipe_fds) == -1) {
-        ALOGE("pipe() syscall failed");
+    std::lock_guard<std::mutex> guard(gDumpLock);
+    if (dumpTrackLocked((void *) audioTrack) < 0)
         return nullptr;
-    }
-
-    std::string result;
-    std::thread reader_thread([&] {
-        char buffer[128];
-        ssize_t bytes_read;
-        while ((bytes_read = read(pipe_fds[0], buffer, sizeof(buffer) - 1)) > 0) {
-            buffer[bytes_read] = '\0';
-            result += buffer;
-        }
-        close(pipe_fds[0]);
-    });
+    return env->NewStringUTF(gDumpBuffer);
+}
 
-    // last argument is not allowed to be null, but where will we get a vector?
-    ZNK7android10AudioTrack4dumpEiRKNS_6VectorINS_8String16EEE((void *) audioTrack, pipe_fds[1],
-                                                               (void *) 0xdeadbaad);
-    close(pipe_fds[1]);
+// Fields of dumpFieldsInternal, in the order of the output array. Must match AudioTrackHiddenApi.
+// Each one is found by the first occurrence of its label, which is why the labels which are also
+// the end of another one ("frame count(" / "req. frame count(", "latency (" / "AF latency (") come
+// first in the dump. Fields which don't exist on this Android version are INT64_MIN.
+static const struct {
+    const char* label;
+    int base; // 0 for the %#x fields, so that the %d which O and older print parses as well
+} gDumpFields[] = {
+        { "id(", 10 }, // Q+
+        { "status(", 10 },
+        { "state(", 10 },
+        { "session Id(", 10 },
+        { "flags(", 0 },
+        { "stream type(", 10 },
+        { "format(", 0 },
+        { "channel mask(", 0 },
+        { "channel count(", 10 },
+        { "sample rate(", 10 },
+        { "original sample rate(", 10 },
+        { "frame count(", 10 },
+        { "req. frame count(", 10 },
+        { "notif. frame count(", 10 },
+        { "latency (", 10 },
+        { "selected device Id(", 10 },
+        { "routed device Id(", 10 },
+        { "output(", 10 },
+        { "AF latency (", 10 },
+        { "AF frame count(", 10 },
+        { "AF SampleRate(", 10 },
+};
 
-    reader_thread.join();
-    return env->NewStringUTF(result.c_str());
+extern "C" JNIEXPORT jboolean JNICALL
+Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_dumpFieldsInternal(
+        JNIEnv *env, jobject, jlong audioTrack, jlongArray out) {
+    constexpr jsize count = sizeof(gDumpFields) / sizeof(gDumpFields[0]);
+    if (env->GetArrayLength(out) < count) {
+        ALOGE("dumpFields: out array too small");
+        return false;
+    }
+    if (!initLib(env))
+        return false;
+    DLSYM_OR_RETURN(libaudioclient, ZNK7android10AudioTrack4dumpEiRKNS_6VectorINS_8String16EEE, false)
+    jlong values[count];
+    {
+        std::lock_guard<std::mutex> guard(gDumpLock);
+        if (dumpTrackLocked((void *) audioTrack) < 0)
+            return false;
+        if (strstr(gDumpBuffer, "AudioTrack::dump") == nullptr) {
+            ALOGE("dumpFields: unexpected dump: %s", gDumpBuffer);
+            return false;
+        }
+        for (jsize i = 0; i < count; i++) {
+            values[i] = INT64_MIN;
+            const char* pos = strstr(gDumpBuffer, gDumpFields[i].label);
+            if (pos == nullptr)
+                continue;
+            pos += strlen(gDumpFields[i].label);
+            char* end = nullptr;
+            const long long value = strtoll(pos, &end, gDumpFields[i].base);
+            if (end != pos && *end == ')')
+                values[i] = value;
+        }
+    }
+    env->SetLongArrayRegion(out, 0, count, values);
+    return true;
 }
 
 struct audio_gain_config {
@@ -271,215 +362,312 @@ struct audio_gain_config {
     [[maybe_unused]] unsigned int ramp_duration_ms; /* ramp duration in ms */
 };
 
-extern "C"
-JNIEXPORT jintArray JNICALL
-Java_org_nift4_gramophone_hificore_AudioSystemHiddenApi_findAfFlagsForPortInternal(
-        JNIEnv *env, jobject, jint id, jint io) {
-    if (!initLib(env))
-        return nullptr;
-    jint out[6] = { 0, 0, 0, 0, 0, 0 };
-    if (android_get_device_api_level() >= 28) {
-        DLSYM_OR_ELSE(libaudioclient, ZN7android11AudioSystem12getAudioPortEP13audio_port_v7) {
-            ZN7android11AudioSystem12getAudioPortEP13audio_port_v7 =
-                    (ZN7android11AudioSystem12getAudioPortEP13audio_port_v7_t)
-                    dlsym(libaudioclient_handle, "_ZN7android11AudioSystem12getAudioPortEP10audio_port");
-            if (!ZN7android11AudioSystem12getAudioPortEP13audio_port_v7) {
-                ALOGE("dlsym returned nullptr for _ZN7android11AudioSystem12getAudioPortEP10audio_port: %s",
-                                    dlerror());
-                return nullptr;
-            }
+// Mix port info by (id, io handle), valid for one audio port generation. AudioPolicyManager bumps
+// the generation whenever a port is added, removed or reconfigured, so as long as the caller
+// passes the generation of the port list it got the ids from, entries can't go stale and repeated
+// queries (UI refreshes, routing changes to a known output) don't need any binder call.
+struct port_cache_entry {
+    jint id;
+    jint io;
+    jint out[6]; // sample rate, channel mask, format, flags, hw module, latency class
+};
+static struct {
+    std::mutex lock;
+    bool valid = false;
+    unsigned int generation = 0;
+    std::vector<port_cache_entry> entries;
+    uint8_t* buffer = nullptr; // for getAudioPort(), allocated on first use
+} gPortCache;
+
+// Must hold gPortCache.lock.
+static const port_cache_entry* portCacheFindLocked(jint id, jint io) {
+    for (const auto& entry : gPortCache.entries) {
+        if (entry.id == id && entry.io == io)
+            return &entry;
+    }
+    return nullptr;
+}
+
+// Must hold gPortCache.lock. Reads a single port, used on P+ where the layout of audio_port_v7 is
+// not known and has to be discovered with the io handle as anchor.
+static bool getAudioPortLocked(jint id, jint io, jint* out) {
+    DLSYM_OR_ELSE(libaudioclient, ZN7android11AudioSystem12getAudioPortEP13audio_port_v7) {
+        ZN7android11AudioSystem12getAudioPortEP13audio_port_v7 =
+                (ZN7android11AudioSystem12getAudioPortEP13audio_port_v7_t)
+                dlsym(libaudioclient_handle, "_ZN7android11AudioSystem12getAudioPortEP10audio_port");
+        if (!ZN7android11AudioSystem12getAudioPortEP13audio_port_v7) {
+            ALOGE("dlsym returned nullptr for _ZN7android11AudioSystem12getAudioPortEP10audio_port: %s",
+                                dlerror());
+            return false;
         }
+    }
 #define BUFFER_SIZE 114000
-        auto buffer = (uint8_t *) calloc(1, BUFFER_SIZE); // should be plenty
+    if (gPortCache.buffer == nullptr) {
+        gPortCache.buffer = (uint8_t *) malloc(BUFFER_SIZE); // should be plenty
+        if (gPortCache.buffer == nullptr) {
+            ALOGE("failed to allocate audio port buffer");
+            return false;
+        }
+    }
+    uint8_t *buffer = gPortCache.buffer;
+    auto readPort = [&](bool clear) {
+        // the offset discovery below relies on everything after the port being zero
+        if (clear) memset(buffer, 0, BUFFER_SIZE);
         *((int * /*audio_port_handle_t*/) buffer) = id;
         ZN7android11AudioSystem12getAudioPortEP13audio_port_v7(buffer);
-        uint8_t *pos = buffer;
-        if (gIoHandleOffset == 0) {
-            int i = 1; // skip over port.ext.mix.handle, we want port.active_config.ext.mix.handle
-            pos += BUFFER_SIZE;
-            while (buffer < pos) {
-                pos -= sizeof(unsigned int) / sizeof(uint8_t);
-                if (buffer < pos && *((unsigned int *) pos) == io) {
-                    if (i-- == 1) {
-						gIoHandle2Offset = buffer < pos ? pos - buffer : 0;
-                    } else
-                        break;
-                }
+    };
+    intptr_t ioHandleOffset = structOffsetGet(STRUCT_OFFSET_PORT_IO_HANDLE);
+    intptr_t ioHandle2Offset = structOffsetGet(STRUCT_OFFSET_PORT_EXT_IO_HANDLE);
+    bool known = ioHandleOffset > 0 && ioHandle2Offset > ioHandleOffset
+            && ioHandle2Offset + (intptr_t) sizeof(uint32_t) < BUFFER_SIZE;
+    readPort(!known);
+    if (known && (*((uint32_t *) (buffer + ioHandleOffset)) != (uint32_t) io
+            || *((uint32_t *) (buffer + ioHandle2Offset)) != (uint32_t) io)) {
+        ALOGW("cached io handle offsets %d %d don't match io(%d), probing again",
+              (int) ioHandleOffset, (int) ioHandle2Offset, io);
+        known = false;
+        readPort(true);
+    }
+    uint8_t *pos = buffer;
+    if (!known) {
+        ioHandle2Offset = 0;
+        int i = 1; // skip over port.ext.mix.handle, we want port.active_config.ext.mix.handle
+        pos += BUFFER_SIZE;
+        while (buffer < pos) {
+            pos -= sizeof(unsigned int) / sizeof(uint8_t);
+            if (buffer < pos && *((unsigned int *) pos) == io) {
+                if (i-- == 1) {
+					ioHandle2Offset = buffer < pos ? pos - buffer : 0;
+                } else
+                    break;
             }
-            gIoHandleOffset = buffer < pos ? pos - buffer : 0;
-        } else {
-            pos += gIoHandleOffset;
         }
-        if (gIoHandleOffset == 0 || gIoHandleOffset >= gIoHandle2Offset) {
-            ALOGE("bad gIoHandleOffset(%d) gIoHandle2Offset(%d) (BUFFER_SIZE(%d) id(%d) io(%d))",
-                  gIoHandleOffset, gIoHandle2Offset, BUFFER_SIZE, id, io);
-            gIoHandleOffset = 0;
-            free(buffer);
-            return nullptr;
-        }
-        if (buffer >= pos) {
-            ALOGE("buffer(%p) >= pos(%p) (BUFFER_SIZE(%d) id(%d) io(%d))",
-                  buffer, pos, BUFFER_SIZE, id, io);
-            gIoHandleOffset = 0;
-            free(buffer);
-            return nullptr;
+        ioHandleOffset = buffer < pos ? pos - buffer : 0;
+        if (ioHandleOffset == 0 || ioHandleOffset >= ioHandle2Offset) {
+            ALOGE("bad ioHandleOffset(%d) ioHandle2Offset(%d) (BUFFER_SIZE(%d) id(%d) io(%d))",
+                  (int) ioHandleOffset, (int) ioHandle2Offset, BUFFER_SIZE, id, io);
+            structOffsetSet(STRUCT_OFFSET_PORT_IO_HANDLE, STRUCT_OFFSET_UNKNOWN);
+            return false;
         }
-	    uint8_t *maxPos;
-	    if (android_get_device_api_level() < 33) {
-		    maxPos = buffer + gIoHandle2Offset + sizeof(uint32_t) / sizeof(uint8_t);
-	    } else {
-			maxPos = pos;
-		}
-	    if (maxPos >= buffer + BUFFER_SIZE) {
-		    ALOGE("maxPos(%p) >= buffer(%p) + BUFFER_SIZE(%d) (id(%d) io(%d))",
-		          maxPos, buffer, BUFFER_SIZE, id, io);
-		    gIoHandleOffset = 0;
-		    free(buffer);
-		    return nullptr;
-	    }
-#undef BUFFER_SIZE
-	    if (android_get_device_api_level() < 33) { // not populated by AudioAidlConversion on T+
-		    out[5] = (int32_t) (*((uint32_t *) maxPos)); // port.ext.mix.latency_class
-	    }
-        /*
-         * unsigned int             sample_rate;       <--- we want to go here
-         * audio_channel_mask_t     channel_mask;
-         * audio_format_t           format;
-         * struct audio_gain_config gain;
-         * union audio_io_flags     flags;  (only >=R)
-         * audio_module_handle_t    hw_module;
-         * audio_io_handle_t        handle;            <--- we are here
-         */
-        pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_io_handle_t (handle)
-        out[4] = (int32_t) (*((uint32_t *) pos));
-        if (android_get_device_api_level() >= 30) {
-            pos -= sizeof(uint32_t) / sizeof(uint8_t); // union audio_io_flags (flags)
-            // R added flags field to struct, but it is only populated since T.
-            out[3] = (int32_t) (*((uint32_t *) pos));
-        }
-        pos -= sizeof(struct audio_gain_config) / sizeof(uint8_t); // audio_gain_config (gain)
-        pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_format_t (format)
-        out[2] = (int32_t) (*((uint32_t *) pos));
-        pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_channel_mask_t (channel_mask)
-        out[1] = (int32_t) (*((uint32_t *) pos));
-        pos -= sizeof(unsigned int) / sizeof(uint8_t); // unsigned int (sample_rate)
-        out[0] = (int32_t) (*((uint32_t *) pos));
-        free(buffer);
+        structOffsetSet(STRUCT_OFFSET_PORT_IO_HANDLE, ioHandleOffset);
+        structOffsetSet(STRUCT_OFFSET_PORT_EXT_IO_HANDLE, ioHandle2Offset);
     } else {
-        DLSYM_OR_ELSE(libaudioclient, ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_) {
-            ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_ =
-                    (ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3__t)
-                    dlsym(libaudioclient_handle, "_ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP10audio_portS3_");
-            if (!ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_) {
-                ALOGE("dlsym returned nullptr for ZN7android11AudioSystem14listAudioPortsE17"
-                      "audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_: %s",
-                      dlerror());
-                return nullptr;
-            }
+        pos += ioHandleOffset;
+    }
+    uint8_t *maxPos;
+    if (android_get_device_api_level() < 33) {
+	    maxPos = buffer + ioHandle2Offset + sizeof(uint32_t) / sizeof(uint8_t);
+    } else {
+		maxPos = pos;
+	}
+    if (maxPos >= buffer + BUFFER_SIZE) {
+	    ALOGE("maxPos(%p) >= buffer(%p) + BUFFER_SIZE(%d) (id(%d) io(%d))",
+	          maxPos, buffer, BUFFER_SIZE, id, io);
+	    structOffsetSet(STRUCT_OFFSET_PORT_IO_HANDLE, STRUCT_OFFSET_UNKNOWN);
+	    return false;
+    }
+#undef BUFFER_SIZE
+    if (android_get_device_api_level() < 33) { // not populated by AudioAidlConversion on T+
+	    out[5] = (int32_t) (*((uint32_t *) maxPos)); // port.ext.mix.latency_class
+    }
+    /*
+     * unsigned int             sample_rate;       <--- we want to go here
+     * audio_channel_mask_t     channel_mask;
+     * audio_format_t           format;
+     * struct audio_gain_config gain;
+     * union audio_io_flags     flags;  (only >=R)
+     * audio_module_handle_t    hw_module;
+     * audio_io_handle_t        handle;            <--- we are here
+     */
+    pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_io_handle_t (handle)
+    out[4] = (int32_t) (*((uint32_t *) pos));
+    if (android_get_device_api_level() >= 30) {
+        pos -= sizeof(uint32_t) / sizeof(uint8_t); // union audio_io_flags (flags)
+        // R added flags field to struct, but it is only populated since T.
+        out[3] = (int32_t) (*((uint32_t *) pos));
+    }
+    pos -= sizeof(struct audio_gain_config) / sizeof(uint8_t); // audio_gain_config (gain)
+    pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_format_t (format)
+    out[2] = (int32_t) (*((uint32_t *) pos));
+    pos -= sizeof(uint32_t) / sizeof(uint8_t); // audio_channel_mask_t (channel_mask)
+    out[1] = (int32_t) (*((uint32_t *) pos));
+    pos -= sizeof(unsigned int) / sizeof(uint8_t); // unsigned int (sample_rate)
+    out[0] = (int32_t) (*((uint32_t *) pos));
+    return true;
+}
+
+// Must hold gPortCache.lock. Replaces the cache with all mix ports, used before P where the
+// layout of audio_port is known. The port array is kept between calls, so this usually is a single
+// listAudioPorts() round trip (the port count call of the AOSP code isn't needed as the
+// generation of one call is always consistent).
+template<typename T>
+static bool refreshMixPortsLocked() {
+    DLSYM_OR_ELSE(libaudioclient, ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_) {
+        ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_ =
+                (ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3__t)
+                dlsym(libaudioclient_handle, "_ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP10audio_portS3_");
+        if (!ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_) {
+            ALOGE("dlsym returned nullptr for ZN7android11AudioSystem14listAudioPortsE17"
+                  "audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_: %s",
+                  dlerror());
+            return false;
         }
-        // based on AOSP code
-        const bool oreo = android_get_device_api_level() >= 26;
-        status_t status;
-        unsigned int generation1 = 0;
+    }
+    // Tuck on double the space to prevent heap corruption if OEM made the audio_port bigger
+    static std::vector<T> ports(16 * 2);
+    for (int attempts = 5; attempts > 0; attempts--) {
+        unsigned int numPorts = ports.size() / 2;
         unsigned int generation = 0;
-        unsigned int numPorts = 0;
-        void* nPorts = nullptr;
-        int attempts = 5;
-        // get the port count and all the ports until they both return the same generation
-        do {
-            if (attempts-- < 0) {
-                ALOGE("AudioSystem::listAudioPorts no attempts left");
-                if (nPorts != nullptr) {
-                    if (oreo)
-                        delete (std::vector<audio_port_oreo>*)nPorts;
-                    else
-                        delete (std::vector<audio_port_legacy>*)nPorts;
-                }
-                return nullptr;
-            }
+        status_t status = ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_(
+                LEGACY_AUDIO_PORT_ROLE_SOURCE, LEGACY_AUDIO_PORT_TYPE_MIX, &numPorts,
+                ports.data(), &generation);
+        if (status != 0) {
+            ALOGE("AudioSystem::listAudioPorts error %d", status);
+            return false;
+        }
+        if (numPorts == 0) {
+            ALOGE("AudioSystem::listAudioPorts found no ports");
+            return false;
+        }
+        if (numPorts > ports.size() / 2) {
+            // only the first ports.size() / 2 were copied, try again with enough space
+            ports.resize(numPorts * 2);
+            continue;
+        }
+        gPortCache.entries.clear();
+        for (unsigned int i = 0; i < numPorts; i++) {
+            const T& port = ports[i];
+            if (port.active_config.ext.mix.handle != port.ext.mix.handle)
+                continue;
+            port_cache_entry entry = { port.id, port.ext.mix.handle, {
+                    (int32_t) port.active_config.sample_rate,
+                    (int32_t) port.active_config.channel_mask,
+                    (int32_t) port.active_config.format,
+                    0, // port.active_config.flags missing in action
+                    (int32_t) port.active_config.ext.mix.hw_module,
+                    (int32_t) port.ext.mix.latency_class } };
+            gPortCache.entries.push_back(entry);
+        }
+        gPortCache.generation = generation;
+        gPortCache.valid = true;
+        return true;
+    }
+    ALOGE("AudioSystem::listAudioPorts no attempts left");
+    return false;
+}
 
-            numPorts = 0;
-            status = ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_(
-                    LEGACY_AUDIO_PORT_ROLE_SOURCE, LEGACY_AUDIO_PORT_TYPE_MIX, &numPorts,
-                    nullptr, &generation1);
-            if (status != 0) {
-                ALOGE("AudioSystem::listAudioPorts error %d", status);
-                if (nPorts != nullptr) {
-                    if (oreo)
-                        delete (std::vector<audio_port_oreo>*)nPorts;
-                    else
-                        delete (std::vector<audio_port_legacy>*)nPorts;
-                }
-                return nullptr;
-            }
-            if (numPorts == 0) {
-                ALOGE("AudioSystem::listAudioPorts found no ports");
-                if (nPorts != nullptr) {
-                    if (oreo)
-                        delete (std::vector<audio_port_oreo>*)nPorts;
-                    else
-                        delete (std::vector<audio_port_legacy>*)nPorts;
-                }
-                return nullptr;
-            }
-            // Tuck on double the space to prevent heap corruption if OEM made the audio_port bigger
-            if (nPorts == nullptr) {
-                if (oreo)
-                    nPorts = new std::vector<audio_port_oreo>(numPorts * 2);
-                else
-                    nPorts = new std::vector<audio_port_legacy>(numPorts * 2);
-            } else {
-                if (oreo)
-                    ((std::vector<audio_port_oreo> *) nPorts)->resize(numPorts * 2);
-                else
-                    ((std::vector<audio_port_legacy>*)nPorts)->resize(numPorts * 2);
-            }
-            status = ZN7android11AudioSystem14listAudioPortsE17audio_port_role_t17audio_port_type_tPjP13audio_port_v7S3_(
-                    LEGACY_AUDIO_PORT_ROLE_SOURCE, LEGACY_AUDIO_PORT_TYPE_MIX, &numPorts,
-                    oreo ? (void*)&((*(std::vector<audio_port_oreo>*)nPorts)[0]) :
-                    (void*)&((*(std::vector<audio_port_legacy>*)nPorts)[0]), &generation);
-        } while (generation1 != generation && status == 0);
-
-        int i = 0;
-        bool found = false;
-        if (oreo) {
-            for (auto port: *(std::vector<audio_port_oreo>*)nPorts) {
-                if (i++ == numPorts) break; // needed because vector size > numPorts
-                if (port.id == id && port.active_config.ext.mix.handle == io && port.ext.mix.handle == io) {
-                    out[0] = (int32_t) port.active_config.sample_rate;
-                    out[1] = (int32_t) port.active_config.format;
-                    out[2] = (int32_t) port.active_config.channel_mask;
-                    // out[3] / port.active_config.flags missing in action
-                    out[4] = (int32_t) port.active_config.ext.mix.hw_module;
-                    out[5] = (int32_t) port.ext.mix.latency_class;
-                    found = true;
-                    break;
-                }
+// Must hold gPortCache.lock. Drops the cache if it belongs to another generation.
+static void portCacheCheckGenerationLocked(jint generation) {
+    if (gPortCache.valid && gPortCache.generation != (unsigned int) generation) {
+        gPortCache.entries.clear();
+        gPortCache.valid = false;
+    }
+}
+
+// Must hold gPortCache.lock.
+static bool refreshMixPortsLocked() {
+    return android_get_device_api_level() >= 26
+           ? refreshMixPortsLocked<audio_port_oreo>()
+           : refreshMixPortsLocked<audio_port_legacy>();
+}
+
+// Must hold gPortCache.lock. Fills out with sample rate, channel mask, format, flags, hw module
+// and latency class.
+static bool findPortLocked(jint id, jint io, jint generation, jint* out) {
+    const port_cache_entry* entry = portCacheFindLocked(id, io);
+    if (entry == nullptr) {
+        if (android_get_device_api_level() >= 28) {
+            if (!getAudioPortLocked(id, io, out))
+                return false;
+            port_cache_entry newEntry = { id, io, {} };
+            memcpy(newEntry.out, out, sizeof(newEntry.out));
+            gPortCache.entries.push_back(newEntry);
+            gPortCache.generation = generation;
+            gPortCache.valid = true;
+            return true;
+        }
+        // the ports may have changed since the caller listed them, then this returns the
+        // latest state and the next call with the old generation refreshes again
+        if (!refreshMixPortsLocked())
+            return false;
+        entry = portCacheFindLocked(id, io);
+        if (entry == nullptr)
+            return false;
+    }
+    memcpy(out, entry->out, sizeof(entry->out));
+    return true;
+}
+
+// Layout of listMixPortsInternal's result: the port count n, followed by one block of n values
+// per field in this order (struct of arrays). Must match AudioSystemHiddenApi.
+#define MIX_PORT_ID 0
+#define MIX_PORT_IO_HANDLE 1
+#define MIX_PORT_SAMPLE_RATE 2
+#define MIX_PORT_FORMAT 3
+#define MIX_PORT_CHANNEL_MASK 4
+#define MIX_PORT_FLAGS 5
+#define MIX_PORT_HW_MODULE 6
+#define MIX_PORT_LATENCY_CLASS 7
+#define MIX_PORT_FIELD_COUNT 8
+
+// Before P, ids and ios are ignored and all mix ports come from a single listAudioPorts() call.
+// From P on, ports can only be read one by one (see getAudioPortLocked), so the caller passes
+// the ids and io handles of its own port list and only ports missing from the cache are read.
+// Ports which can't be read are left out.
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_org_nift4_gramophone_hificore_AudioSystemHiddenApi_listMixPortsInternal(
+        JNIEnv *env, jobject, jintArray ids, jintArray ios, jint generation) {
+    if (!initLib(env))
+        return nullptr;
+    std::vector<jint> wanted;
+    if (android_get_device_api_level() >= 28) {
+        const jsize count = env->GetArrayLength(ids);
+        if (env->GetArrayLength(ios) != count) {
+            ALOGE("listMixPorts: got %d ids but %d io handles", count, env->GetArrayLength(ios));
+            return nullptr;
+        }
+        wanted.resize(count * 2);
+        env->GetIntArrayRegion(ids, 0, count, wanted.data());
+        env->GetIntArrayRegion(ios, 0, count, wanted.data() + count);
+    }
+    std::vector<port_cache_entry> ports;
+    {
+        std::lock_guard<std::mutex> guard(gPortCache.lock);
+        portCacheCheckGenerationLocked(generation);
+        if (android_get_device_api_level() >= 28) {
+            const size_t count = wanted.size() / 2;
+            for (size_t i = 0; i < count; i++) {
+                port_cache_entry entry = { wanted[i], wanted[count + i], {} };
+                if (findPortLocked(entry.id, entry.io, generation, entry.out))
+                    ports.push_back(entry);
             }
-            delete (std::vector<audio_port_oreo>*)nPorts;
         } else {
-            for (auto port: *(std::vector<audio_port_legacy>*)nPorts) {
-                if (i++ == numPorts) break; // needed because vector size > numPorts
-                if (port.id == id && port.active_config.ext.mix.handle == io && port.ext.mix.handle == io) {
-                    out[0] = (int32_t) port.active_config.sample_rate;
-                    out[1] = (int32_t) port.active_config.format;
-                    out[2] = (int32_t) port.active_config.channel_mask;
-                    // out[3] / port.active_config.flags missing in action
-                    out[4] = (int32_t) port.active_config.ext.mix.hw_module;
-                    out[5] = (int32_t) port.ext.mix.latency_class;
-                    found = true;
-                    break;
-                }
-            }
-            delete (std::vector<audio_port_legacy>*)nPorts;
+            if (!gPortCache.valid && !refreshMixPortsLocked())
+                return nullptr;
+            ports = gPortCache.entries;
         }
-        if (!found) return nullptr;
     }
-    jintArray theOut = env->NewIntArray(sizeof(out)/sizeof(out[0]));
+    const auto n = (jsize) ports.size();
+    std::vector<jint> out(1 + n * MIX_PORT_FIELD_COUNT);
+    out[0] = n;
+    for (jsize i = 0; i < n; i++) {
+        const port_cache_entry& port = ports[i];
+        jint* base = out.data() + 1 + i;
+        base[MIX_PORT_ID * n] = port.id;
+        base[MIX_PORT_IO_HANDLE * n] = port.io;
+        base[MIX_PORT_SAMPLE_RATE * n] = port.out[0];
+        base[MIX_PORT_CHANNEL_MASK * n] = port.out[1];
+        base[MIX_PORT_FORMAT * n] = port.out[2];
+        base[MIX_PORT_FLAGS * n] = port.out[3];
+        base[MIX_PORT_HW_MODULE * n] = port.out[4];
+        base[MIX_PORT_LATENCY_CLASS * n] = port.out[5];
+    }
+    jintArray theOut = env->NewIntArray((jsize) out.size());
     if (theOut == nullptr) {
         return nullptr;
     }
-    env->SetIntArrayRegion(theOut, 0, sizeof(out)/sizeof(out[0]), &out[0]);
+    env->SetIntArrayRegion(theOut, 0, (jsize) out.size(), out.data());
     return theOut;
 }
 
@@ -507,9 +695,22 @@ Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_findAfTrackFlagsInternal(
     uint32_t mAfSampleRate = in_af_sample_rate;
     uint32_t mFormat = in_format;
     uint8_t *pos = pointer;
-    if (gTrackFlagsOffset == INT32_MIN) {
+    intptr_t trackFlagsOffset = structOffsetGet(STRUCT_OFFSET_TRACK_AF_FLAGS);
+    if (trackFlagsOffset > 0) {
+        // the fields around it are known, so check them before trusting the cached offset
+        auto structptr = (audio_track_partial *) (pointer + trackFlagsOffset
+                - offsetof(audio_track_partial, mAfTrackFlags));
+        if (structptr->mAfLatency != mAfLatency || structptr->mAfFrameCount != mAfFrameCount
+                || structptr->mAfSampleRate != mAfSampleRate) {
+            ALOGW("cached mAfTrackFlags offset %d doesn't match, probing again",
+                  (int) trackFlagsOffset);
+            trackFlagsOffset = STRUCT_OFFSET_UNKNOWN;
+            structOffsetSet(STRUCT_OFFSET_TRACK_AF_FLAGS, trackFlagsOffset);
+        }
+    }
+    if (trackFlagsOffset == STRUCT_OFFSET_INVALID) {
         return INT32_MIN;
-    } else if (gTrackFlagsOffset == 0) {
+    } else if (trackFlagsOffset == STRUCT_OFFSET_UNKNOWN) {
         // arbitrary approximation
 #define BUFFER_SIZE 800
         while (pos - pointer < BUFFER_SIZE) {
@@ -558,7 +759,7 @@ Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_findAfTrackFlagsInternal(
                               pos, pointer, (int) (pos - pointer), BUFFER_SIZE, mFormat,
                               structptr->mFormat, mAfLatency, mLatency, (int) mAfFrameCount,
                               mAfSampleRate);
-                        gTrackFlagsOffset = INT32_MIN;
+                        structOffsetSet(STRUCT_OFFSET_TRACK_AF_FLAGS, STRUCT_OFFSET_INVALID);
                         return INT32_MIN;
                     }
                     ALOGE("pos(%p) pointer(%p) pos-pointer(%d) BUFFER_SIZE(%d) wrong mFormat(%d) "
@@ -579,92 +780,52 @@ Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_findAfTrackFlagsInternal(
                   (int) mAfFrameCount, mAfSampleRate);
             return INT32_MIN;
         }
-        gTrackFlagsOffset = pos - pointer;
+        structOffsetSet(STRUCT_OFFSET_TRACK_AF_FLAGS, pos - pointer);
 #undef BUFFER_SIZE
     } else {
-        pos += gTrackFlagsOffset;
+        pos += trackFlagsOffset;
     }
     return (int32_t) (*((uint32_t * /*audio_output_flags_t*/) pos));
 }
 
-extern "C"
-JNIEXPORT jint JNICALL
-Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_getFlagsInternal(JNIEnv *env, jobject,
-                                                                        jobject audio_track,
-                                                                        jlong audio_track_ptr) {
-    if (android_get_device_api_level() >= 26) {
-        if (audio_track == nullptr) {
-            ALOGE("flagsFromOffset: O+ but audio_track is null");
-            return INT32_MIN;
-        }
-        if (!nativeGetFlags) {
-            jclass at = env->GetObjectClass(audio_track);
-            nativeGetFlags = env->GetMethodID(at, "native_get_flags", "()I");
-            env->DeleteLocalRef(at);
-            if (nativeGetFlags == nullptr) {
-                ALOGE("getProxy: didn't find android/media/AudioTrack.native_get_flags()I");
-                return INT32_MIN;
-            }
-        }
-        return env->CallIntMethod(audio_track, nativeGetFlags);
-    }
+// Hard-coded offset of AudioTrack::mFlags before O, or 0 if we don't know it for this version.
+static intptr_t trackFlagsOffsetHint() {
     size_t extra;
     switch (android_get_device_api_level()) {
 #if 0
         case 27:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x338); // aarch64, x86_64
+            return 0x338; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2cc);
+            return 0x2cc;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2d8);
+            return 0x2d8;
 #endif
         case 26:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x330); // aarch64, x86_64
+            return 0x330; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2c4);
+            return 0x2c4;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2d0);
+            return 0x2d0;
 #endif
 #endif
         case 25:
         case 24:
 #ifdef i386
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x23c);
-#elif defined(__x86_64)
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2a0);
+            return 0x23c;
+#elif defined(__LP64__)
+            return 0x2a0; // aarch64, x86_64
 #else
-        {
-#ifdef __LP64__
-            auto result = (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x2a0);
-#else
-            auto result = (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x248);
-#endif
-            if (libavenhancements_handle) {
-                DLSYM_OR_ELSE(libavenhancements, ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi) {
-                    ALOGE("dlsym ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi failed: %s", dlerror());
-                }
-            }
-            if (ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi) {
-                uint32_t output = ZNK7android10AudioTrack9getOutputEv((void*) audio_track_ptr);
-                bool isDirectPcm = ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi((void*) 0xcafebabe, output);
-                if ((result & 0x11) == 0x1 && !isDirectPcm) {
-                    result &= ~0x1;
-                } else if (!(result & 0x11) && isDirectPcm) {
-                    result |= 0x1; // TODO: should this live here or add separate method for server flags?
-                }
-            }
-            return result;
-        }
+            return 0x248;
 #endif
         case 23:
 #ifdef __LP64__
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x280); // aarch64, x86_64
+            return 0x280; // aarch64, x86_64
 #elif defined(i386)
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x218);
+            return 0x218;
 #else
-            return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x220);
+            return 0x220;
 #endif
         case 22:
             extra =
@@ -689,15 +850,72 @@ Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_getFlagsInternal(JNIEnv *
                     (0);
             break;
         default:
-            return INT32_MAX;
+            return 0;
     }
 #ifdef __LP64__
-    return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x228 + extra); // aarch64, x86_64
+    return 0x228 + extra; // aarch64, x86_64
 #elif defined(i386)
-    return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x1e0 + extra);
+    return 0x1e0 + extra;
 #else
-    return (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + 0x1e8 + extra);
+    return 0x1e8 + extra;
+#endif
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_org_nift4_gramophone_hificore_AudioTrackHiddenApi_getFlagsInternal(JNIEnv *env, jobject,
+                                                                        jobject audio_track,
+                                                                        jlong audio_track_ptr) {
+    if (android_get_device_api_level() >= 26) {
+        if (audio_track == nullptr) {
+            ALOGE("flagsFromOffset: O+ but audio_track is null");
+            return INT32_MIN;
+        }
+        jmethodID getFlags = jniCacheAudioTrackGetFlags(env);
+        if (!getFlags) {
+            ALOGE("getProxy: didn't find android/media/AudioTrack.native_get_flags()I");
+            return INT32_MIN;
+        }
+        return env->CallIntMethod(audio_track, getFlags);
+    }
+    intptr_t offset = structOffsetGet(STRUCT_OFFSET_TRACK_FLAGS);
+    if (offset == STRUCT_OFFSET_UNKNOWN) {
+        offset = trackFlagsOffsetHint();
+        if (offset == 0)
+            return INT32_MAX;
+        // there is no other source of the flags before O, so only check that it's a plausible
+        // audio_output_flags_t to catch reading e.g. a pointer or a float on an odd ROM
+        const uint32_t value = *(uint32_t*)((uintptr_t)audio_track_ptr + offset);
+        if (value >= 0x100000) {
+            ALOGE("mFlags at hard-coded offset %d is %#x, this ROM may have a different layout",
+                  (int) offset, value);
+            structOffsetReject(STRUCT_OFFSET_TRACK_FLAGS);
+            return INT32_MAX;
+        }
+        structOffsetSet(STRUCT_OFFSET_TRACK_FLAGS, offset);
+    }
+    if (offset == STRUCT_OFFSET_INVALID)
+        return INT32_MAX;
+    auto result = (int32_t)*(uint32_t*)((uintptr_t)audio_track_ptr + offset);
+#if !defined(i386) && !defined(__x86_64)
+    if (android_get_device_api_level() == 24 || android_get_device_api_level() == 25) {
+        if (libavenhancements_handle) {
+            DLSYM_OR_ELSE(libavenhancements, ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi) {
+                ALOGE("dlsym ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi failed: %s", dlerror());
+            }
+        }
+        if (ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi) {
+            uint32_t output = ZNK7android10AudioTrack9getOutputEv((void*) audio_track_ptr);
+            bool isDirectPcm = ZN7android18ExtendedMediaUtils26AudioTrackIsTrackOffloadedEi((void*) 0xcafebabe, output);
+            if ((result & 0x11) == 0x1 && !isDirectPcm) {
+                result &= ~0x1;
+            } else if (!(result & 0x11) && isDirectPcm) {
+                result |= 0x1; // TODO: should this live here or add separate method for server flags?
+            }
+        }
+    }
 #endif
+    return result;
 }
 
 struct audio_config_base {
@@ -18,13 +18,17 @@
 #ifndef GRAMOPHONE_HELPERS_H
 #define GRAMOPHONE_HELPERS_H
 
-#define DLSYM_OR_ELSE(LIB, FUNC) if (!FUNC) { \
+#include "symbol_cache.h"
+
+// For optional symbols. Symbols which were found missing before are skipped, see symbol_cache.h
+#define DLSYM_OR_ELSE(LIB, FUNC) if (!FUNC && !symbolCacheIsMissing("_" #FUNC)) { \
     if (!LIB##_handle) { \
         ALOGE("dlsym handle of " #LIB ".so is not open - code bug"); \
     } else { \
         FUNC = (FUNC##_t) dlsym(LIB##_handle, "_" #FUNC); \
         if (!FUNC) { \
             ALOGI("dlsym returned nullptr for _" #FUNC " in " #LIB ".so: %s", dlerror()); \
+            symbolCacheSetMissing("_" #FUNC); \
         } \
     } \
 } \
@@ -0,0 +1,162 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define LOG_TAG "JniCache"
+
+#include <jni.h>
+#include <android/api-level.h>
+#include <android/log_macros.h>
+#include <mutex>
+#include "jni_cache.h"
+
+jni_cache gJniCache;
+static std::mutex gAudioTrackLock;
+
+static jclass findGlobalClass(JNIEnv* env, const char* name) {
+    jclass local = env->FindClass(name);
+    if (local == nullptr) {
+        ALOGE("class %s does not exist", name);
+        env->ExceptionClear();
+        return nullptr;
+    }
+    auto global = (jclass) env->NewGlobalRef(local);
+    env->DeleteLocalRef(local);
+    return global;
+}
+
+static jmethodID findMethod(JNIEnv* env, jclass clazz, const char* name, const char* signature) {
+    if (clazz == nullptr) return nullptr;
+    jmethodID method = env->GetMethodID(clazz, name, signature);
+    if (method == nullptr) {
+        ALOGI("method %s%s not found", name, signature);
+        env->ExceptionClear();
+    }
+    return method;
+}
+
+static jfieldID findField(JNIEnv* env, jclass clazz, const char* name, const char* signature) {
+    if (clazz == nullptr) return nullptr;
+    jfieldID field = env->GetFieldID(clazz, name, signature);
+    if (field == nullptr) {
+        ALOGI("field %s %s not found", signature, name);
+        env->ExceptionClear();
+    }
+    return field;
+}
+
+// Must hold gAudioTrackLock.
+static void resolveAudioTrackLocked(JNIEnv* env) {
+    auto& c = gJniCache;
+    if (c.audioTrack == nullptr) {
+        c.audioTrack = findGlobalClass(env, "android/media/AudioTrack");
+        if (c.audioTrack == nullptr) return;
+    }
+    const int api = android_get_device_api_level();
+    if (api >= 24) {
+        c.audioTrackCtor = findMethod(env, c.audioTrack, "<init>", "(J)V");
+        c.audioTrackDeferredConnect = findMethod(env, c.audioTrack, "deferred_connect", "(J)V");
+        c.audioTrackBaseRegisterPlayer = findMethod(env, c.audioTrack, "baseRegisterPlayer", "(I)V");
+        c.audioTrackSetPlayerIId = findMethod(env, c.audioTrack, "native_setPlayerIId", "(I)V");
+        c.audioTrackPlayerIId = findField(env, c.audioTrack, "mPlayerIId", "I");
+    }
+    if (api >= 26) {
+        c.audioTrackGetFlags = findMethod(env, c.audioTrack, "native_get_flags", "()I");
+    }
+}
+
+bool jniCacheEnsureAudioTrack(JNIEnv* env) {
+    std::lock_guard<std::mutex> guard(gAudioTrackLock);
+    if (gJniCache.audioTrackCtor == nullptr) {
+        resolveAudioTrackLocked(env);
+    }
+    return gJniCache.audioTrackCtor != nullptr;
+}
+
+jmethodID jniCacheAudioTrackGetFlags(JNIEnv* env) {
+    std::lock_guard<std::mutex> guard(gAudioTrackLock);
+    if (gJniCache.audioTrackCtor == nullptr) {
+        resolveAudioTrackLocked(env);
+    }
+    return gJniCache.audioTrackGetFlags;
+}
+
+static void resolveNativeTrack(JNIEnv* env) {
+    auto& c = gJniCache;
+    c.nativeTrack = findGlobalClass(env, "org/nift4/gramophone/hificore/NativeTrack");
+    if (c.nativeTrack == nullptr) return;
+    c.onUnderrun = findMethod(env, c.nativeTrack, "onUnderrun", "()V");
+    c.onMarker = findMethod(env, c.nativeTrack, "onMarker", "(I)V");
+    c.onNewPos = findMethod(env, c.nativeTrack, "onNewPos", "(I)V");
+    c.onStreamEnd = findMethod(env, c.nativeTrack, "onStreamEnd", "()V");
+    c.onNewIAudioTrack = findMethod(env, c.nativeTrack, "onNewIAudioTrack", "()V");
+    c.onNewTimestamp = findMethod(env, c.nativeTrack, "onNewTimestamp", "(IJ)V");
+    c.onLoopEnd = findMethod(env, c.nativeTrack, "onLoopEnd", "(I)V");
+    c.onBufferEnd = findMethod(env, c.nativeTrack, "onBufferEnd", "()V");
+    c.onMoreData = findMethod(env, c.nativeTrack, "onMoreData", "(JLjava/nio/ByteBuffer;)J");
+    c.onMoreDataStaged = findMethod(env, c.nativeTrack, "onMoreDataStaged",
+                                    "(JLjava/nio/ByteBuffer;I)J");
+    c.onCanWriteMoreData = findMethod(env, c.nativeTrack, "onCanWriteMoreData", "(JJ)V");
+    c.onAudioDeviceUpdate = findMethod(env, c.nativeTrack, "onAudioDeviceUpdate", "(I[I)V");
+    c.onPullDataNeeded = findMethod(env, c.nativeTrack, "onPullDataNeeded", "(J)V");
+    if (!registerNativeTrackNatives(env, c.nativeTrack)) {
+        ALOGW("RegisterNatives failed for NativeTrack, falling back to symbol lookup");
+        env->ExceptionClear();
+    }
+}
+
+static void resolveLoudnessScanner(JNIEnv* env) {
+    auto& c = gJniCache;
+    // method IDs of the interface are valid for all implementations
+    jclass producer = env->FindClass("org/nift4/gramophone/hificore/LoudnessScanner$PcmProducer");
+    if (producer == nullptr) {
+        ALOGE("could not find PcmProducer class");
+        env->ExceptionClear();
+    } else {
+        c.producerGetSampleRate = findMethod(env, producer, "getSampleRate", "()I");
+        c.producerGetChannelCount = findMethod(env, producer, "getChannelCount", "()I");
+        c.producerRead = findMethod(env, producer, "read", "(Ljava/nio/ByteBuffer;)I");
+        c.producerClose = findMethod(env, producer, "close", "()V");
+        env->DeleteLocalRef(producer);
+    }
+    jclass scanner = env->FindClass("org/nift4/gramophone/hificore/LoudnessScanner");
+    if (scanner == nullptr) {
+        ALOGE("could not find LoudnessScanner class");
+        env->ExceptionClear();
+    } else {
+        c.scannerOnTrackDone = findMethod(env, scanner, "onTrackDone", "(IIZFFFF)V");
+        c.scannerProducerAt = findMethod(env, scanner, "producerAt",
+                                         "(I)Lorg/nift4/gramophone/hificore/LoudnessScanner$PcmProducer;");
+        env->DeleteLocalRef(scanner);
+    }
+}
+
+// Nothing in here is fatal, missing entries only disable the features which need them.
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void*) {
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv((void**) &env, JNI_VERSION_1_6) != JNI_OK) {
+        ALOGE("could not get JNIEnv in JNI_OnLoad");
+        return JNI_ERR;
+    }
+    gJniCache.vm = vm;
+    {
+        std::lock_guard<std::mutex> guard(gAudioTrackLock);
+        resolveAudioTrackLocked(env);
+    }
+    resolveNativeTrack(env);
+    resolveLoudnessScanner(env);
+    return JNI_VERSION_1_6;
+}
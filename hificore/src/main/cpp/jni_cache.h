@@ -0,0 +1,74 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_JNI_CACHE_H
+#define GRAMOPHONE_JNI_CACHE_H
+
+#include <jni.h>
+
+// Classes, methods and fields used by the native code, resolved once in JNI_OnLoad (which runs
+// with the app class loader, so app classes can be found even if they are later used from native
+// threads). Entries are nullptr if they don't exist, most of the AudioTrack ones are hidden API
+// which only exists on some versions - callers must check them before use.
+struct jni_cache {
+    JavaVM* vm = nullptr;
+    // android/media/AudioTrack
+    jclass audioTrack = nullptr;
+    jmethodID audioTrackCtor = nullptr; // <init>(J)V
+    jmethodID audioTrackDeferredConnect = nullptr; // N+
+    jmethodID audioTrackBaseRegisterPlayer = nullptr; // N+
+    jmethodID audioTrackSetPlayerIId = nullptr; // S+
+    jfieldID audioTrackPlayerIId = nullptr; // S+
+    jmethodID audioTrackGetFlags = nullptr; // O+
+    // org/nift4/gramophone/hificore/NativeTrack, see MyCallback
+    jclass nativeTrack = nullptr;
+    jmethodID onUnderrun = nullptr;
+    jmethodID onMarker = nullptr;
+    jmethodID onNewPos = nullptr;
+    jmethodID onStreamEnd = nullptr;
+    jmethodID onNewIAudioTrack = nullptr;
+    jmethodID onNewTimestamp = nullptr;
+    jmethodID onLoopEnd = nullptr;
+    jmethodID onBufferEnd = nullptr;
+    jmethodID onMoreData = nullptr;
+    jmethodID onMoreDataStaged = nullptr;
+    jmethodID onCanWriteMoreData = nullptr;
+    jmethodID onAudioDeviceUpdate = nullptr;
+    jmethodID onPullDataNeeded = nullptr;
+    // org/nift4/gramophone/hificore/LoudnessScanner and its PcmProducer interface
+    jmethodID scannerOnTrackDone = nullptr;
+    jmethodID scannerProducerAt = nullptr;
+    jmethodID producerGetSampleRate = nullptr;
+    jmethodID producerGetChannelCount = nullptr;
+    jmethodID producerRead = nullptr;
+    jmethodID producerClose = nullptr;
+};
+extern jni_cache gJniCache;
+
+// Resolves the AudioTrack entries again if the constructor is still missing, in case the hidden API
+// exemptions were only set up after the library was loaded. Returns whether the constructor exists.
+bool jniCacheEnsureAudioTrack(JNIEnv* env);
+
+// AudioTrack.native_get_flags() (O+) after jniCacheEnsureAudioTrack, read under the same lock that
+// guards its lazy resolution. nullptr if it doesn't exist.
+jmethodID jniCacheAudioTrackGetFlags(JNIEnv* env);
+
+// Binds the natives of NativeTrack with RegisterNatives, defined in NativeTrack.cpp. The exported
+// Java_* symbols stay, so if this fails the runtime falls back to looking them up by name.
+bool registerNativeTrackNatives(JNIEnv* env, jclass clazz);
+
+#endif //GRAMOPHONE_JNI_CACHE_H
@@ -0,0 +1,120 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_LATENCY_HISTOGRAM_H
+#define GRAMOPHONE_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Lock-free log-linear histogram of durations in microseconds, safe to record into from any
+// amount of threads (including the audio callback thread, it never blocks or allocates).
+//
+// Values below kSubBuckets get one bucket each. Above that, every power of two is split into
+// kSubBuckets linear buckets, so the relative error is at most 1 / kSubBuckets (12.5%) over the
+// whole range up to 2^32 us (about 71 minutes), which is far more than any audio call should take.
+// Larger values are clamped into the last bucket, but still count towards the sum and maximum.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr uint64_t kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxBits = 32;
+    static constexpr size_t kBuckets = kSubBuckets + (kMaxBits - kSubBits) * kSubBuckets;
+
+    LatencyHistogram() = default;
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(uint64_t us) {
+        mBuckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSum.fetch_add(us, std::memory_order_relaxed);
+        uint64_t max = mMax.load(std::memory_order_relaxed);
+        while (us > max && !mMax.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+    }
+
+    // Not atomic as a whole, concurrent records may or may not be counted.
+    void reset() {
+        for (auto& bucket : mBuckets) bucket.store(0, std::memory_order_relaxed);
+        mCount.store(0, std::memory_order_relaxed);
+        mSum.store(0, std::memory_order_relaxed);
+        mMax.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return mSum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return mMax.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket which contains the given fraction (0..1) of all values, or 0 if
+    // nothing was recorded.
+    uint64_t percentile(double fraction) const {
+        uint64_t counts[kBuckets];
+        uint64_t total = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) return 0;
+        const auto target = (uint64_t) (fraction * (double) total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += counts[i];
+            if (seen > target) return std::min(upperBound(i), max());
+        }
+        return max();
+    }
+
+    // One line per non-empty bucket, "  [from, to) us: count".
+    void dumpBuckets(std::string& out) const {
+        char line[96];
+        for (size_t i = 0; i < kBuckets; i++) {
+            const uint32_t count = mBuckets[i].load(std::memory_order_relaxed);
+            if (count == 0) continue;
+            snprintf(line, sizeof(line), "  [%llu, %llu) us: %u\n",
+                     (unsigned long long) lowerBound(i), (unsigned long long) upperBound(i), count);
+            out += line;
+        }
+    }
+
+private:
+    static size_t bucketOf(uint64_t us) {
+        if (us < kSubBuckets) return us;
+        const int bits = 63 - __builtin_clzll(us);
+        if (bits >= kMaxBits) return kBuckets - 1;
+        const uint64_t sub = (us >> (bits - kSubBits)) & (kSubBuckets - 1);
+        return kSubBuckets + (bits - kSubBits) * kSubBuckets + sub;
+    }
+    static uint64_t lowerBound(size_t bucket) {
+        if (bucket < kSubBuckets) return bucket;
+        const size_t bits = (bucket - kSubBuckets) / kSubBuckets + kSubBits;
+        const uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+        return (uint64_t(1) << bits) + (sub << (bits - kSubBits));
+    }
+    static uint64_t upperBound(size_t bucket) {
+        return bucket + 1 < kBuckets ? lowerBound(bucket + 1) : UINT64_MAX;
+    }
+
+    std::atomic<uint32_t> mBuckets[kBuckets] = {};
+    std::atomic<uint64_t> mCount = 0;
+    std::atomic<uint64_t> mSum = 0;
+    std::atomic<uint64_t> mMax = 0;
+};
+
+#endif //GRAMOPHONE_LATENCY_HISTOGRAM_H
@@ -0,0 +1,146 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_PCM_RING_BUFFER_H
+#define GRAMOPHONE_PCM_RING_BUFFER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+// Lock-free byte ring buffer for exactly one producer thread and one consumer thread.
+//
+// Both positions only ever grow and are masked on access, so full and empty can be told apart
+// without wasting a slot. Each side keeps its own position and a cached copy of the other side's
+// position on its own cache line, and only reloads the other side's atomic when the cached value
+// says there's no room (or no data), which keeps the cache line ping-pong down to roughly once
+// per lap instead of once per call.
+class PcmRingBuffer {
+public:
+    PcmRingBuffer() = default;
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    // Not thread safe. Capacity is rounded up to the next power of two.
+    bool init(size_t capacity) {
+        if (capacity == 0 || capacity > kMaxCapacity) return false;
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mData = std::make_unique<uint8_t[]>(size);
+        mMask = size - 1;
+        mProducer.pos.store(0, std::memory_order_relaxed);
+        mProducer.otherCache = 0;
+        mConsumer.pos.store(0, std::memory_order_relaxed);
+        mConsumer.otherCache = 0;
+        return true;
+    }
+
+    size_t capacity() const { return mMask + 1; }
+
+    // Any thread, only a snapshot.
+    size_t size() const {
+        return mProducer.pos.load(std::memory_order_acquire)
+                - mConsumer.pos.load(std::memory_order_acquire);
+    }
+
+    // Producer only. Copies as much of data as fits and returns the amount of bytes copied.
+    size_t write(const void* data, size_t size) {
+        const size_t writePos = mProducer.pos.load(std::memory_order_relaxed);
+        size_t free = capacity() - (writePos - mProducer.otherCache);
+        if (free < size) {
+            mProducer.otherCache = mConsumer.pos.load(std::memory_order_acquire);
+            free = capacity() - (writePos - mProducer.otherCache);
+        }
+        size = std::min(size, free);
+        if (size == 0) return 0;
+        const size_t offset = writePos & mMask;
+        const size_t first = std::min(size, capacity() - offset);
+        memcpy(mData.get() + offset, data, first);
+        memcpy(mData.get(), (const uint8_t*) data + first, size - first);
+        mProducer.pos.store(writePos + size, std::memory_order_release);
+        return size;
+    }
+
+    // Consumer only. Returns the amount of readable bytes, and points data at the ones which
+    // are contiguous in memory (which may be fewer if they wrap around).
+    size_t peek(const uint8_t** data, size_t* contiguous) {
+        const size_t readPos = mConsumer.pos.load(std::memory_order_relaxed);
+        size_t available = mConsumer.otherCache - readPos;
+        if (available == 0) {
+            mConsumer.otherCache = mProducer.pos.load(std::memory_order_acquire);
+            available = mConsumer.otherCache - readPos;
+        }
+        const size_t offset = readPos & mMask;
+        *data = mData.get() + offset;
+        *contiguous = std::min(available, capacity() - offset);
+        return available;
+    }
+
+    // Consumer only. Copies size bytes, which must have been reported as readable by peek().
+    void copyOut(void* out, size_t size) const {
+        const size_t offset = mConsumer.pos.load(std::memory_order_relaxed) & mMask;
+        const size_t first = std::min(size, capacity() - offset);
+        memcpy(out, mData.get() + offset, first);
+        memcpy((uint8_t*) out + first, mData.get(), size - first);
+    }
+
+    // Consumer only. Frees size bytes, which must have been reported as readable by peek().
+    void consume(size_t size) {
+        mConsumer.pos.store(mConsumer.pos.load(std::memory_order_relaxed) + size,
+                            std::memory_order_release);
+    }
+
+    // Consumer only. Drops everything that has been written so far.
+    void clear() {
+        mConsumer.otherCache = mProducer.pos.load(std::memory_order_acquire);
+        mConsumer.pos.store(mConsumer.otherCache, std::memory_order_release);
+    }
+
+    // Producer only. Total amount of bytes written so far, see dropUntil().
+    size_t writePosition() const {
+        return mProducer.pos.load(std::memory_order_relaxed);
+    }
+
+    // Consumer only. Drops everything before pos, a writePosition() which the producer handed
+    // over, so that the producer can flush without touching the consumer's side.
+    void dropUntil(size_t pos) {
+        const size_t readPos = mConsumer.pos.load(std::memory_order_relaxed);
+        if ((ptrdiff_t) (pos - readPos) <= 0) return; // already consumed
+        mConsumer.otherCache = mProducer.pos.load(std::memory_order_acquire);
+        mConsumer.pos.store(pos, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+    static constexpr size_t kMaxCapacity = SIZE_MAX / 4 + 1;
+
+    struct alignas(kCacheLine) Side {
+        std::atomic<size_t> pos = 0;
+        // last seen position of the other side, only touched by the owning thread
+        size_t otherCache = 0;
+    };
+
+    Side mProducer;
+    Side mConsumer;
+    alignas(kCacheLine) std::unique_ptr<uint8_t[]> mData;
+    size_t mMask = 0;
+};
+
+#endif //GRAMOPHONE_PCM_RING_BUFFER_H
@@ -0,0 +1,124 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_STRUCT_OFFSETS_H
+#define GRAMOPHONE_STRUCT_OFFSETS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "symbol_cache.h"
+
+// Offsets of fields in system structs and classes which we don't have headers for. They are
+// discovered (or, where we have a hard-coded offset, checked) once against values that are known
+// by other means, and remembered in a file keyed like the symbol cache, so that the next process
+// on the same build doesn't have to probe again and reads are a single load.
+//
+// Callers re-check a cached offset against a known value whenever they have one at hand, and
+// forget it if that fails, so that a wrong entry (e.g. after an update the key didn't catch)
+// heals itself.
+#define STRUCT_OFFSET_PORT_IO_HANDLE 0 // audio_port_v7 active_config.ext.mix.handle (P+)
+#define STRUCT_OFFSET_PORT_EXT_IO_HANDLE 1 // audio_port_v7 ext.mix.handle (P+)
+#define STRUCT_OFFSET_TRACK_AF_FLAGS 2 // AudioTrack::mAfTrackFlags (U QPR2+)
+#define STRUCT_OFFSET_TRACK_FLAGS 3 // AudioTrack::mFlags (before O)
+#define STRUCT_OFFSET_TRACK_NOTIFICATION_FRAMES 4 // AudioTrack::mNotificationFramesAct (before P)
+#define STRUCT_OFFSET_COUNT 5
+
+#define STRUCT_OFFSET_UNKNOWN 0 // not probed yet
+#define STRUCT_OFFSET_INVALID INTPTR_MIN // probed, but doesn't exist or can't be found on this build
+#define STRUCT_OFFSET_MAX_REJECTS 3
+
+struct struct_offsets {
+    std::atomic<intptr_t> offsets[STRUCT_OFFSET_COUNT] = {};
+    std::atomic<int> rejects[STRUCT_OFFSET_COUNT] = {}; // see structOffsetReject, not persisted
+    std::mutex lock;
+    std::string path; // empty until structOffsetsInit, then nothing is persisted
+    std::string key;
+};
+inline struct_offsets gStructOffsets;
+
+// Loads the offsets from path if they were written on the same build. Only the first call does
+// anything, and it must happen before the first probe to be of any use.
+static inline void structOffsetsInit(const char* path, const char* fingerprint) {
+    std::lock_guard<std::mutex> guard(gStructOffsets.lock);
+    if (!gStructOffsets.path.empty())
+        return;
+    gStructOffsets.path = path;
+    gStructOffsets.key = symbolCacheKey(fingerprint);
+    FILE* f = fopen(path, "re");
+    if (f == nullptr)
+        return;
+    char line[1024];
+    if (fgets(line, sizeof(line), f) != nullptr) {
+        line[strcspn(line, "\n")] = '\0';
+        if (gStructOffsets.key == line) {
+            int id;
+            long long offset;
+            while (fscanf(f, "%d %lld\n", &id, &offset) == 2) {
+                if (id >= 0 && id < STRUCT_OFFSET_COUNT)
+                    gStructOffsets.offsets[id].store((intptr_t) offset, std::memory_order_relaxed);
+            }
+        }
+    }
+    fclose(f);
+}
+
+static inline intptr_t structOffsetGet(int id) {
+    return gStructOffsets.offsets[id].load(std::memory_order_relaxed);
+}
+
+// Must hold the lock. Failures are not fatal, the offsets are just probed again next time.
+static inline void structOffsetsFlushLocked() {
+    if (gStructOffsets.path.empty())
+        return;
+    const std::string tmp = gStructOffsets.path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "we");
+    if (f == nullptr)
+        return;
+    bool ok = fprintf(f, "%s\n", gStructOffsets.key.c_str()) > 0;
+    for (int id = 0; id < STRUCT_OFFSET_COUNT; id++) {
+        const intptr_t offset = structOffsetGet(id);
+        if (offset != STRUCT_OFFSET_UNKNOWN)
+            ok = ok && fprintf(f, "%d %lld\n", id, (long long) offset) > 0;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), gStructOffsets.path.c_str()) != 0)
+        remove(tmp.c_str());
+}
+
+// Remembers the result of a probe, which may be STRUCT_OFFSET_INVALID or STRUCT_OFFSET_UNKNOWN
+// (to forget an offset which failed verification).
+static inline void structOffsetSet(int id, intptr_t offset) {
+    std::lock_guard<std::mutex> guard(gStructOffsets.lock);
+    if (gStructOffsets.offsets[id].exchange(offset, std::memory_order_relaxed) != offset)
+        structOffsetsFlushLocked();
+}
+
+// Notes that a hard-coded offset failed a plausibility check. A single implausible sample may
+// just be a field that isn't set up yet, so the offset is only remembered as invalid after
+// STRUCT_OFFSET_MAX_REJECTS failures in this process, and probed again until then.
+static inline void structOffsetReject(int id) {
+    if (gStructOffsets.rejects[id].fetch_add(1, std::memory_order_relaxed) + 1
+            == STRUCT_OFFSET_MAX_REJECTS)
+        structOffsetSet(id, STRUCT_OFFSET_INVALID);
+}
+
+#endif //GRAMOPHONE_STRUCT_OFFSETS_H
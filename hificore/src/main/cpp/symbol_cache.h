@@ -0,0 +1,165 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_SYMBOL_CACHE_H
+#define GRAMOPHONE_SYMBOL_CACHE_H
+
+#include <sys/stat.h>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Remembers which optional symbols (the ones probed with DLSYM_OR_ELSE, mostly alternative manglings
+// for vendor or version specific variants) don't exist, so that they are not probed again - neither
+// on the next initDlsym() call in this process, nor after the next process start, as the list is
+// persisted to a file. The file is keyed by the build fingerprint and the identity of the system
+// libraries, so it is thrown away after an OTA. Symbols which must exist are never cached, so that
+// their absence is still logged as an error.
+struct symbol_cache {
+    std::mutex lock;
+    std::string path; // empty until symbolCacheInit, then nothing is persisted
+    std::string key;
+    std::vector<std::string> missing;
+    bool dirty = false;
+    int batches = 0; // while > 0, new entries are only flushed by symbolCacheEndBatch
+    bool loaded = false; // the file was valid for this build
+    // statistics for getInitStatsInternal
+    std::atomic<int64_t> initLibNs = 0;
+    std::atomic<int64_t> dlsymNs = 0;
+    std::atomic<uint32_t> skippedProbes = 0;
+    std::atomic<uint32_t> failedProbes = 0;
+};
+inline symbol_cache gSymbolCache;
+
+static inline int64_t symbolCacheNowNs() {
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static inline std::string symbolCacheKey(const char* fingerprint) {
+#ifdef __LP64__
+    static const char* dir = "/system/lib64/";
+#else
+    static const char* dir = "/system/lib/";
+#endif
+    static const char* libs[] = { "libaudioclient.so", "libmedia.so", "libutils.so",
+                                  "libbinder.so", "libavenhancements.so" };
+    std::string key = fingerprint;
+    char part[96];
+    for (const char* lib : libs) {
+        struct stat st = {};
+        const std::string path = std::string(dir) + lib;
+        if (stat(path.c_str(), &st) == 0) {
+            snprintf(part, sizeof(part), "|%s:%llu:%lld:%lld", lib, (unsigned long long) st.st_ino,
+                     (long long) st.st_mtime, (long long) st.st_size);
+        } else {
+            snprintf(part, sizeof(part), "|%s:-", lib);
+        }
+        key += part;
+    }
+    return key;
+}
+
+// Loads the list from path if it was written on the same build. Only the first call does anything.
+static inline void symbolCacheInit(const char* path, const char* fingerprint) {
+    std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+    if (!gSymbolCache.path.empty())
+        return;
+    gSymbolCache.path = path;
+    gSymbolCache.key = symbolCacheKey(fingerprint);
+    FILE* f = fopen(path, "re");
+    if (f == nullptr)
+        return;
+    std::vector<std::string> lines;
+    char line[1024];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        line[strcspn(line, "\n")] = '\0';
+        lines.emplace_back(line);
+    }
+    fclose(f);
+    if (lines.empty() || lines[0] != gSymbolCache.key) {
+        gSymbolCache.dirty = true; // rewrite it for this build
+        return;
+    }
+    for (size_t i = 1; i < lines.size(); i++) {
+        if (!lines[i].empty()) gSymbolCache.missing.push_back(lines[i]);
+    }
+    gSymbolCache.loaded = true;
+}
+
+static inline bool symbolCacheIsMissing(const char* name) {
+    std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+    for (const auto& symbol : gSymbolCache.missing) {
+        if (symbol == name) {
+            gSymbolCache.skippedProbes++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writes the list if it changed. Failures are not fatal, the symbols are just probed next time.
+// Must hold the lock.
+static inline void symbolCacheFlushLocked() {
+    if (!gSymbolCache.dirty || gSymbolCache.path.empty())
+        return;
+    const std::string tmp = gSymbolCache.path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "we");
+    if (f == nullptr)
+        return;
+    bool ok = fprintf(f, "%s\n", gSymbolCache.key.c_str()) > 0;
+    for (const auto& symbol : gSymbolCache.missing) {
+        ok = ok && fprintf(f, "%s\n", symbol.c_str()) > 0;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (ok && rename(tmp.c_str(), gSymbolCache.path.c_str()) == 0) {
+        gSymbolCache.dirty = false;
+    } else {
+        remove(tmp.c_str());
+    }
+}
+
+// Symbols which go missing between these two calls (i.e. in initDlsym()) are written with one
+// flush at the end, instead of rewriting the whole file for every one of them.
+static inline void symbolCacheBeginBatch() {
+    std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+    gSymbolCache.batches++;
+}
+
+static inline void symbolCacheEndBatch() {
+    std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+    if (--gSymbolCache.batches == 0)
+        symbolCacheFlushLocked();
+}
+
+// Outside of a batch this is persisted right away, as some optional symbols are only probed
+// lazily after initDlsym(), one at a time.
+static inline void symbolCacheSetMissing(const char* name) {
+    std::lock_guard<std::mutex> guard(gSymbolCache.lock);
+    gSymbolCache.failedProbes++;
+    gSymbolCache.missing.emplace_back(name);
+    gSymbolCache.dirty = true;
+    if (gSymbolCache.batches == 0)
+        symbolCacheFlushLocked();
+}
+
+#endif //GRAMOPHONE_SYMBOL_CACHE_H
@@ -8,26 +8,80 @@ class AdaptiveDynamicRangeCompression {
 		private const val TAG = "AdaptiveDRCSw"
 		var libLoaded = false
 			private set
+
+		internal fun loadLib() {
+			if (libLoaded) return
+			if (!AudioTrackHiddenApi.libLoaded) {
+				try {
+					Log.d(TAG, "Loading libhificore.so")
+					System.loadLibrary("hificore")
+					Log.d(TAG, "Done loading libhificore.so")
+				} catch (e: Throwable) {
+					throw IllegalStateException("can't load lib for AdaptiveDRC", e)
+				}
+			}
+			// don't set the hidden api one to true, .so is shared for simplicity but hidden api
+			// may not wish or be allowed to load/use the library.
+			libLoaded = true
+		}
+
+		private external fun applyGainNative(channelCount: Int, fromGain: FloatArray,
+		                                     toGain: FloatArray, `in`: ByteBuffer,
+		                                     `out`: ByteBuffer, frameCount: Int): Boolean
+
+		/**
+		 * Multiply float PCM in [in] by a gain and write it to [out], which may be the same buffer.
+		 * Like [compress], this uses the buffers from their start, ignoring position and limit.
+		 *
+		 * [fromGain] and [toGain] have either one element, or one element per channel. The gain
+		 * ramps linearly from [fromGain] at the first frame towards [toGain], which is reached
+		 * right after the last frame, so that the next buffer can continue at [toGain].
+		 */
+		fun applyGain(channelCount: Int, fromGain: FloatArray, toGain: FloatArray,
+		              `in`: ByteBuffer, `out`: ByteBuffer, frameCount: Int) {
+			if (!`in`.isDirect) {
+				throw IllegalArgumentException("in buffer not direct")
+			}
+			if (!`out`.isDirect) {
+				throw IllegalArgumentException("out buffer not direct")
+			}
+			if (`out`.isReadOnly) {
+				throw IllegalArgumentException("out buffer read only")
+			}
+			if (fromGain.size != toGain.size || (fromGain.size != 1 && fromGain.size != channelCount)) {
+				throw IllegalArgumentException("need one gain or one gain per channel")
+			}
+			loadLib()
+			val ret = try {
+				applyGainNative(channelCount,
+					if (fromGain.size == channelCount) fromGain else FloatArray(channelCount) { fromGain[0] },
+					if (toGain.size == channelCount) toGain else FloatArray(channelCount) { toGain[0] },
+					`in`, `out`, frameCount)
+			} catch (e: Throwable) {
+				throw IllegalStateException("applyGainNative failed", e)
+			}
+			if (!ret) {
+				throw IllegalArgumentException("applyGainNative failed, see logcat")
+			}
+		}
+
+		fun applyGain(channelCount: Int, gain: Float, `in`: ByteBuffer, `out`: ByteBuffer,
+		              frameCount: Int) {
+			val gains = floatArrayOf(gain)
+			applyGain(channelCount, gains, gains, `in`, `out`, frameCount)
+		}
 	}
-	private var ptr: Long
-	private var inited = false
+	internal var ptr: Long
+		private set
+	internal var inited = false
+		private set
 	private var samplingRate: Int? = null
 	private var tauAttack: Float? = null
 	private var tauRelease: Float? = null
 	private var compressionRatio: Float? = null
+	private var blockSize = 1
 	init {
-		if (!AudioTrackHiddenApi.libLoaded) {
-			try {
-				Log.d(TAG, "Loading libhificore.so")
-				System.loadLibrary("hificore")
-				Log.d(TAG, "Done loading libhificore.so")
-			} catch (e: Throwable) {
-				throw IllegalStateException("can't load lib for AdaptiveDRC", e)
-			}
-		}
-		// don't set the hidden api one to true, .so is shared for simplicity but hidden api
-		// may not wish or be allowed to load/use the library.
-		libLoaded = true
+		loadLib()
 		try {
 			ptr = create()
 		} catch (e: Throwable) {
@@ -40,21 +94,30 @@ class AdaptiveDynamicRangeCompression {
 	private external fun create(): Long
 	private external fun releaseNative(ptr: Long)
 	private external fun initNative(ptr: Long, samplingRate: Float, tauAttack: Float,
-	                                tauRelease: Float, compressionRatio: Float)
+	                                tauRelease: Float, compressionRatio: Float, blockSize: Int)
+	private external fun setGainRampNative(ptr: Long, rampFrames: Int)
+	private external fun setTruePeakNative(ptr: Long, enabled: Boolean)
 	private external fun compressNative(ptr: Long, channelCount: Int, inputAmp: Float,
 	                                    kneeThresholdLog: Float, postAmp: Float, `in`: ByteBuffer,
 	                                    `out`: ByteBuffer, frameCount: Int)
 	// (re-)init, resets cached state such as current energy. should be done when switching songs
-	fun init(samplingRate: Int, tauAttack: Float, tauRelease: Float, compressionRatio: Float) {
+	// blockSize > 1 updates the envelope once per blockSize frames (max 64) and interpolates the
+	// gain in between, which is cheaper but may attenuate slightly ahead of transients.
+	fun init(samplingRate: Int, tauAttack: Float, tauRelease: Float, compressionRatio: Float,
+	         blockSize: Int = 1) {
+		if (blockSize < 1 || blockSize > 64) {
+			throw IllegalArgumentException("blockSize $blockSize out of range")
+		}
 		this.samplingRate = samplingRate
 		this.tauAttack = tauAttack
 		this.tauRelease = tauRelease
 		this.compressionRatio = compressionRatio
+		this.blockSize = blockSize
 		if (ptr == 0L) {
 			throw IllegalStateException("called release() before init()")
 		}
 		try {
-			initNative(ptr, samplingRate.toFloat(), tauAttack, tauRelease, compressionRatio)
+			initNative(ptr, samplingRate.toFloat(), tauAttack, tauRelease, compressionRatio, blockSize)
 		} catch (e: Throwable) {
 			throw IllegalStateException("initNative failed", e)
 		}
@@ -66,7 +129,35 @@ class AdaptiveDynamicRangeCompression {
 			throw IllegalStateException("flush() called before init()")
 		}
 		init(samplingRate!!, tauAttack!!, tauRelease!!,
-			compressionRatio!!)
+			compressionRatio!!, blockSize)
+	}
+	// when inputAmp or postAmp change between compress() calls, move to the new values over
+	// rampFrames frames instead of jumping, so that gain can be changed without clicks and
+	// without init(). 0 (the default) applies them immediately. kept across init().
+	fun setGainRamp(rampFrames: Int) {
+		if (rampFrames < 0) {
+			throw IllegalArgumentException("rampFrames $rampFrames is negative")
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before setGainRamp()")
+		}
+		try {
+			setGainRampNative(ptr, rampFrames)
+		} catch (e: Throwable) {
+			throw IllegalStateException("setGainRampNative failed", e)
+		}
+	}
+	// also compress inter-sample peaks, using a 4x oversampling true peak detector in the
+	// envelope. costs about 48 multiply-adds per frame and channel. kept across init().
+	fun setTruePeak(enabled: Boolean) {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before setTruePeak()")
+		}
+		try {
+			setTruePeakNative(ptr, enabled)
+		} catch (e: Throwable) {
+			throw IllegalStateException("setTruePeakNative failed", e)
+		}
 	}
 	fun compress(channelCount: Int, inputAmp: Float, kneeThresholdLog: Float,
 	             postAmp: Float, `in`: ByteBuffer, `out`: ByteBuffer, frameCount: Int) {
@@ -167,74 +167,93 @@ object AudioSystemHiddenApi {
         return ports.filterNotNull() to generation[0]
     }
 
-    private fun getMixPort(port: Any): MixPort {
-        val ioHandle = port.javaClass.getMethod("ioHandle").invoke(port) as Int
-        val id = port.javaClass.getMethod("id").invoke(port) as Int
-        val name = port.javaClass.getMethod("name").invoke(port) as String?
-        val mixPortData = getMixPortMetadata(id, ioHandle)
-        // flags exposed to app process since below commit which first appeared in T release.
-        // https://cs.android.com/android/_/android/platform/frameworks/av/+/99809024b36b243ad162c780c1191bb503a8df47
-        // https://cs.android.com/android/_/android/platform/frameworks/av/+/0805de160715e82fcf59f9367a43b96a352abd11
-        return MixPort(id, ioHandle, name, flags = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU)
-            mixPortData?.get(3) else null, channelMask = mixPortData?.get(2),
-            format = mixPortData?.get(1)?.toUInt(), sampleRate = mixPortData?.get(0)?.toUInt(),
-            hwModule = mixPortData?.get(4), fast = if (Build.VERSION.SDK_INT < Build.VERSION_CODES.TIRAMISU)
-                mixPortData?.let { it[5] == 0 } else null)
+    // field order of listMixPortsInternal's struct of arrays, must match gramophone.cpp
+    private const val MIX_PORT_ID = 0
+    private const val MIX_PORT_IO_HANDLE = 1
+    private const val MIX_PORT_SAMPLE_RATE = 2
+    private const val MIX_PORT_FORMAT = 3
+    private const val MIX_PORT_CHANNEL_MASK = 4
+    private const val MIX_PORT_FLAGS = 5
+    private const val MIX_PORT_HW_MODULE = 6
+    private const val MIX_PORT_LATENCY_CLASS = 7
+
+    /**
+     * All source mix ports, with their metadata read in one native call. Ports for which the
+     * metadata can't be read have null fields.
+     */
+    fun getMixPorts(): List<MixPort>? = getMixPorts(null)
+
+    // With onlyIoHandle, only that port's metadata is read. From P on, every port costs a
+    // getAudioPort() binder call on a cache miss, so this matters for single lookups.
+    private fun getMixPorts(onlyIoHandle: Int?): List<MixPort>? {
+        val ports = listAudioPorts() ?: return null
+        val mixPorts = ports.first.mapNotNull { port ->
+            try {
+                if (port.javaClass.canonicalName != "android.media.AudioMixPort") return@mapNotNull null
+                val io = port.javaClass.getMethod("ioHandle").invoke(port) as Int
+                if (onlyIoHandle != null && io != onlyIoHandle) return@mapNotNull null
+                Triple(port.javaClass.getMethod("id").invoke(port) as Int, io,
+                    port.javaClass.getMethod("name").invoke(port) as String?)
+            } catch (t: Throwable) {
+                Log.e(TAG, Log.getThrowableString(t)!!)
+                null
+            }
+        }
+        if (mixPorts.isEmpty())
+            return emptyList()
+        val data = getMixPortsMetadata(IntArray(mixPorts.size) { mixPorts[it].first },
+            IntArray(mixPorts.size) { mixPorts[it].second }, ports.second)
+        val n = data?.get(0) ?: 0
+        return mixPorts.map { (id, ioHandle, name) ->
+            var i = 0
+            while (i < n && (data!![1 + MIX_PORT_ID * n + i] != id ||
+                        data[1 + MIX_PORT_IO_HANDLE * n + i] != ioHandle))
+                i++
+            if (i == n)
+                return@map MixPort(id, ioHandle, name, null, null, null, null, null, null)
+            fun field(f: Int) = data!![1 + f * n + i]
+            // flags exposed to app process since below commit which first appeared in T release.
+            // https://cs.android.com/android/_/android/platform/frameworks/av/+/99809024b36b243ad162c780c1191bb503a8df47
+            // https://cs.android.com/android/_/android/platform/frameworks/av/+/0805de160715e82fcf59f9367a43b96a352abd11
+            MixPort(id, ioHandle, name, flags = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU)
+                field(MIX_PORT_FLAGS) else null, channelMask = field(MIX_PORT_CHANNEL_MASK),
+                format = field(MIX_PORT_FORMAT).toUInt(), sampleRate = field(MIX_PORT_SAMPLE_RATE).toUInt(),
+                hwModule = field(MIX_PORT_HW_MODULE), fast = if (Build.VERSION.SDK_INT < Build.VERSION_CODES.TIRAMISU)
+                    field(MIX_PORT_LATENCY_CLASS) == 0 else null)
+        }
     }
 
     fun getMixPortForThread(oid: Int?): MixPort? {
         if (oid == null)
             return null
-        val ports = listAudioPorts()
-        if (ports != null)
-            for (port in ports.first) {
-                try {
-                    if (port.javaClass.canonicalName != "android.media.AudioMixPort") continue
-                    val ioHandle = port.javaClass.getMethod("ioHandle").invoke(port) as Int
-                    if (ioHandle != oid) continue
-                    return getMixPort(port)
-                } catch (t: Throwable) {
-                    Log.e(TAG, Log.getThrowableString(t)!!)
-                }
-            }
-        return null
+        return getMixPorts(oid)?.firstOrNull()
     }
 
     fun getPrimaryMixPort(): MixPort? {
-        val ports = listAudioPorts()
-        if (ports != null)
-            for (port in ports.first) {
-                try {
-                    if (port.javaClass.canonicalName != "android.media.AudioMixPort") continue
-                    val mixPort = getMixPort(port)
-                    // TODO: support android below T where flags is null
-                    if (mixPort.flags != null && (mixPort.flags and 2 /* AUDIO_OUTPUT_FLAG_PRIMARY */) != 0)
-                        return mixPort
-                } catch (t: Throwable) {
-                    Log.e(TAG, Log.getThrowableString(t)!!)
-                }
-            }
-        return null
+        // TODO: support android below T where flags is null
+        return getMixPorts()?.firstOrNull {
+            it.flags != null && (it.flags and 2 /* AUDIO_OUTPUT_FLAG_PRIMARY */) != 0
+        }
     }
 
-    private fun getMixPortMetadata(id: Int, io: Int): IntArray? {
+    // generation is the one of the port list which ids and ios come from, the native side caches
+    // the result until it changes
+    private fun getMixPortsMetadata(ids: IntArray, ios: IntArray, generation: Int): IntArray? {
         if (!libLoaded)
             return null
         if (Build.VERSION.SDK_INT < Build.VERSION_CODES.M)
             return null // need listAudioPorts or getAudioPort
         return try {
-            Log.d(TRACE_TAG, "calling native findAfFlagsForPortInternal")
-            val result = findAfFlagsForPortInternal(id, io)
-                .also { Log.d(TRACE_TAG, "native findAfFlagsForPortInternal is done: $it") }
-            if (result == null) return null // something went wrong. native layer logged reason to logcat
-            return result
+            Log.d(TRACE_TAG, "calling native listMixPortsInternal")
+            listMixPortsInternal(ids, ios, generation)
+                .also { Log.d(TRACE_TAG, "native listMixPortsInternal is done: $it") }
+            // if null, something went wrong. native layer logged reason to logcat
         } catch (e: Throwable) {
             Log.e(TAG, Log.getThrowableString(e)!!)
             null
         }
     }
-    @Suppress("unused") // for parameters
-    private external fun findAfFlagsForPortInternal(id: Int, sr: Int): IntArray?
+    private external fun listMixPortsInternal(ids: IntArray, ios: IntArray, generation: Int): IntArray?
 
     // ====== MISC ======
 
@@ -232,6 +232,49 @@ object AudioTrackHiddenApi {
     }
     /*private*/ external fun dumpInternal(@Suppress("unused") audioTrackPtr: Long): String
 
+    // indices into the array filled by dumpFields(), must match gramophone.cpp
+    const val DUMP_ID = 0
+    const val DUMP_STATUS = 1
+    const val DUMP_STATE = 2
+    const val DUMP_SESSION_ID = 3
+    const val DUMP_FLAGS = 4
+    const val DUMP_STREAM_TYPE = 5
+    const val DUMP_FORMAT = 6
+    const val DUMP_CHANNEL_MASK = 7
+    const val DUMP_CHANNEL_COUNT = 8
+    const val DUMP_SAMPLE_RATE = 9
+    const val DUMP_ORIGINAL_SAMPLE_RATE = 10
+    const val DUMP_FRAME_COUNT = 11
+    const val DUMP_REQ_FRAME_COUNT = 12
+    const val DUMP_NOTIFICATION_FRAMES = 13
+    const val DUMP_LATENCY = 14
+    const val DUMP_SELECTED_DEVICE = 15
+    const val DUMP_ROUTED_DEVICE = 16
+    const val DUMP_OUTPUT = 17
+    const val DUMP_AF_LATENCY = 18
+    const val DUMP_AF_FRAME_COUNT = 19
+    const val DUMP_AF_SAMPLE_RATE = 20
+    const val DUMP_FIELD_COUNT = 21
+
+    /**
+     * The numbers of [dump], parsed natively into [into] at the DUMP_* indices, so that it can be
+     * polled without building and parsing strings. Fields which this Android version doesn't print
+     * are [Long.MIN_VALUE]. Returns null on failure.
+     */
+    fun dumpFields(audioTrack: AudioTrack, into: LongArray = LongArray(DUMP_FIELD_COUNT)): LongArray? {
+        if (!libLoaded)
+            return null
+        if (audioTrack.state == AudioTrack.STATE_UNINITIALIZED)
+            throw IllegalArgumentException("cannot dump released AudioTrack")
+        return try {
+            if (dumpFieldsInternal(getAudioTrackPtr(audioTrack), into)) into else null
+        } catch (e: Throwable) {
+            Log.e(TAG, Log.getThrowableString(e)!!)
+            null
+        }
+    }
+    /*private*/ external fun dumpFieldsInternal(audioTrackPtr: Long, out: LongArray): Boolean
+
     private val idRegex = Regex(".*id\\((.*)\\) .*")
     fun getPortIdFromDump(dump: String?): Int? {
         if (dump == null)
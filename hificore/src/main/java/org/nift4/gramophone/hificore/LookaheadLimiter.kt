@@ -0,0 +1,134 @@
+package org.nift4.gramophone.hificore
+
+import java.nio.ByteBuffer
+
+/**
+ * Brick-wall peak limiter for float PCM. No output sample exceeds the ceiling passed to [init].
+ * The output is delayed by [latencyFrames] frames, so the caller needs to account for that
+ * in its position reporting and push that many extra frames out at the end of the stream.
+ */
+class LookaheadLimiter {
+	companion object {
+		const val MIN_LOOKAHEAD = 0.001f
+		const val MAX_LOOKAHEAD = 0.005f
+	}
+	internal var ptr: Long
+		private set
+	internal var inited = false
+		private set
+	internal var samplingRate: Int? = null
+		private set
+	internal var channelCount: Int? = null
+		private set
+	private var lookahead: Float? = null
+	private var tauRelease: Float? = null
+	private var ceilingDb: Float? = null
+	var latencyFrames = 0
+		private set
+	init {
+		AdaptiveDynamicRangeCompression.loadLib()
+		try {
+			ptr = create()
+		} catch (e: Throwable) {
+			throw IllegalStateException("create failed", e)
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("create failed: NULL")
+		}
+	}
+	private external fun create(): Long
+	private external fun releaseNative(ptr: Long)
+	private external fun initNative(ptr: Long, samplingRate: Float, channelCount: Int,
+	                                lookahead: Float, tauRelease: Float, ceilingDb: Float): Boolean
+	private external fun getLatencyNative(ptr: Long): Int
+	private external fun setTruePeakNative(ptr: Long, enabled: Boolean)
+	private external fun processNative(ptr: Long, `in`: ByteBuffer, `out`: ByteBuffer,
+	                                   frameCount: Int)
+	// (re-)init, resets the delay line and gain state. lookahead is in seconds and is clamped
+	// to [MIN_LOOKAHEAD, MAX_LOOKAHEAD].
+	fun init(samplingRate: Int, channelCount: Int, lookahead: Float, tauRelease: Float,
+	         ceilingDb: Float) {
+		this.samplingRate = samplingRate
+		this.channelCount = channelCount
+		this.lookahead = lookahead
+		this.tauRelease = tauRelease
+		this.ceilingDb = ceilingDb
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before init()")
+		}
+		val ret = try {
+			initNative(ptr, samplingRate.toFloat(), channelCount, lookahead, tauRelease, ceilingDb)
+		} catch (e: Throwable) {
+			throw IllegalStateException("initNative failed", e)
+		}
+		if (!ret) {
+			throw IllegalArgumentException("initNative failed, see logcat")
+		}
+		latencyFrames = getLatencyNative(ptr)
+		inited = true
+	}
+	fun flush() {
+		if (samplingRate == null || channelCount == null || lookahead == null ||
+			tauRelease == null || ceilingDb == null) {
+			throw IllegalStateException("flush() called before init()")
+		}
+		init(samplingRate!!, channelCount!!, lookahead!!, tauRelease!!, ceilingDb!!)
+	}
+	// also keep inter-sample peaks below the ceiling, using a 4x oversampling true peak
+	// detector. costs about 48 multiply-adds per frame and channel. kept across init().
+	// the detector reports peaks 6 frames late, so enabling it adds 6 frames to latencyFrames.
+	// changing it resets the delay line and gain state like flush().
+	fun setTruePeak(enabled: Boolean) {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before setTruePeak()")
+		}
+		try {
+			setTruePeakNative(ptr, enabled)
+		} catch (e: Throwable) {
+			throw IllegalStateException("setTruePeakNative failed", e)
+		}
+		if (inited) {
+			latencyFrames = getLatencyNative(ptr)
+		}
+	}
+	// channel count is the one passed to init()
+	fun process(`in`: ByteBuffer, `out`: ByteBuffer, frameCount: Int) {
+		if (!`in`.isDirect) {
+			throw IllegalArgumentException("in buffer not direct")
+		}
+		if (!`out`.isDirect) {
+			throw IllegalArgumentException("out buffer not direct")
+		}
+		if (`out`.isReadOnly) {
+			throw IllegalArgumentException("out buffer read only")
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before process()")
+		}
+		if (!inited) {
+			throw IllegalStateException("called process() before init()")
+		}
+		try {
+			processNative(ptr, `in`, `out`, frameCount)
+		} catch (e: Throwable) {
+			throw IllegalStateException("processNative failed", e)
+		}
+	}
+	fun reset() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before reset()")
+		}
+		inited = false
+	}
+	fun release() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() already")
+		}
+		try {
+			releaseNative(ptr)
+		} catch (e: Throwable) {
+			throw IllegalStateException("releaseNative failed", e)
+		}
+		ptr = 0L
+	}
+}
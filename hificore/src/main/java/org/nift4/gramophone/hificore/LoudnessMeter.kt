@@ -0,0 +1,103 @@
+package org.nift4.gramophone.hificore
+
+import java.nio.ByteBuffer
+
+/**
+ * Streaming EBU R128 / ITU-R BS.1770 loudness meter for float PCM. Feed the whole track through
+ * [process], then read the results with [getResult]. Can also be queried while feeding, but it
+ * is not thread safe.
+ */
+class LoudnessMeter {
+	data class Result(
+		// gated integrated loudness in LUFS, negative infinity for silence
+		val integratedLoudness: Float,
+		// loudness range in LU
+		val loudnessRange: Float,
+		// linear
+		val truePeak: Float,
+		// linear
+		val samplePeak: Float
+	)
+
+	private var ptr: Long
+	private var inited = false
+	private var channelCount = 0
+	init {
+		AdaptiveDynamicRangeCompression.loadLib()
+		try {
+			ptr = create()
+		} catch (e: Throwable) {
+			throw IllegalStateException("create failed", e)
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("create failed: NULL")
+		}
+	}
+	private external fun create(): Long
+	private external fun releaseNative(ptr: Long)
+	private external fun initNative(ptr: Long, samplingRate: Float, channelCount: Int): Boolean
+	private external fun processNative(ptr: Long, `in`: ByteBuffer, frameCount: Int)
+	private external fun getResultsNative(ptr: Long, out: FloatArray)
+	// (re-)init, resets all measurements. should be done when switching songs
+	fun init(samplingRate: Int, channelCount: Int) {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before init()")
+		}
+		val ret = try {
+			initNative(ptr, samplingRate.toFloat(), channelCount)
+		} catch (e: Throwable) {
+			throw IllegalStateException("initNative failed", e)
+		}
+		if (!ret) {
+			throw IllegalArgumentException("initNative failed, see logcat")
+		}
+		this.channelCount = channelCount
+		inited = true
+	}
+	// uses the buffer from its start, ignoring position and limit, like compress()
+	fun process(`in`: ByteBuffer, frameCount: Int) {
+		if (!`in`.isDirect) {
+			throw IllegalArgumentException("in buffer not direct")
+		}
+		if (`in`.capacity() < frameCount * channelCount * 4) {
+			throw IllegalArgumentException("in buffer too small for $frameCount frames")
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before process()")
+		}
+		if (!inited) {
+			throw IllegalStateException("called process() before init()")
+		}
+		try {
+			processNative(ptr, `in`, frameCount)
+		} catch (e: Throwable) {
+			throw IllegalStateException("processNative failed", e)
+		}
+	}
+	fun getResult(): Result {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before getResult()")
+		}
+		if (!inited) {
+			throw IllegalStateException("called getResult() before init()")
+		}
+		val out = FloatArray(4)
+		try {
+			getResultsNative(ptr, out)
+		} catch (e: Throwable) {
+			throw IllegalStateException("getResultsNative failed", e)
+		}
+		return Result(out[0], out[1], out[2], out[3])
+	}
+	fun release() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() already")
+		}
+		try {
+			releaseNative(ptr)
+		} catch (e: Throwable) {
+			throw IllegalStateException("releaseNative failed", e)
+		}
+		ptr = 0L
+	}
+}
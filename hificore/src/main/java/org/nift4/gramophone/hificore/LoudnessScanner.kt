@@ -0,0 +1,123 @@
+package org.nift4.gramophone.hificore
+
+import java.nio.ByteBuffer
+
+/**
+ * Measures the loudness of many tracks in parallel, on native threads. Tracks are handed out
+ * by a work stealing pool with one thread per big core by default.
+ *
+ * [Callback.onTrackScanned] is called once per track, on one of the scan threads, never
+ * concurrently. Producers are called on the scan threads, each one from only one thread.
+ */
+class LoudnessScanner(private val producers: List<PcmProducer>, private val callback: Callback) {
+	companion object {
+		// ReplayGain 2.0 reference level
+		const val REFERENCE_LOUDNESS = -18f
+	}
+
+	/**
+	 * Decoded audio of one track. Must produce 32-bit float PCM in native byte order.
+	 */
+	interface PcmProducer {
+		val sampleRate: Int
+		val channelCount: Int
+		// write the next frames to the start of buffer, ignoring position and limit, and
+		// return the amount of frames written. return 0 at the end of the track.
+		fun read(buffer: ByteBuffer): Int
+		// called once the track is done or failed, even if read() threw
+		fun close()
+	}
+
+	interface Callback {
+		// result is null if the producer failed or the format is not supported
+		fun onTrackScanned(index: Int, done: Int, total: Int, result: Result?)
+	}
+
+	data class Result(
+		val loudness: LoudnessMeter.Result
+	) {
+		// gain in dB to reach REFERENCE_LOUDNESS, null for silent tracks
+		val gain: Float?
+			get() = if (loudness.integratedLoudness.isFinite())
+				REFERENCE_LOUDNESS - loudness.integratedLoudness else null
+		// largest of true and sample peak, linear
+		val peak: Float
+			get() = maxOf(loudness.truePeak, loudness.samplePeak)
+	}
+
+	private var ptr: Long
+	private var started = false
+	init {
+		AdaptiveDynamicRangeCompression.loadLib()
+		try {
+			ptr = create(producers.size)
+		} catch (e: Throwable) {
+			throw IllegalStateException("create failed", e)
+		}
+		if (ptr == 0L) {
+			throw IllegalStateException("create failed: NULL")
+		}
+	}
+	private external fun create(count: Int): Long
+	private external fun startNative(ptr: Long, threadCount: Int): Boolean
+	private external fun cancelNative(ptr: Long)
+	private external fun joinNative(ptr: Long)
+	private external fun releaseNative(ptr: Long)
+
+	// called from native when a scan thread starts on a track, so that native code only holds
+	// references to the producers currently being scanned
+	private fun producerAt(index: Int): PcmProducer = producers[index]
+
+	// called from native, on a scan thread (not main thread!)
+	private fun onTrackDone(index: Int, done: Int, success: Boolean, integratedLoudness: Float,
+	                        loudnessRange: Float, truePeak: Float, samplePeak: Float) {
+		callback.onTrackScanned(index, done, producers.size, if (success) Result(
+			LoudnessMeter.Result(integratedLoudness, loudnessRange, truePeak, samplePeak)
+		) else null)
+	}
+
+	// threadCount 0 uses one thread per big core
+	fun start(threadCount: Int = 0) {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before start()")
+		}
+		if (started) {
+			throw IllegalStateException("called start() twice")
+		}
+		val ret = try {
+			startNative(ptr, threadCount)
+		} catch (e: Throwable) {
+			throw IllegalStateException("startNative failed", e)
+		}
+		if (!ret) {
+			throw IllegalStateException("startNative failed, see logcat")
+		}
+		started = true
+	}
+	// stops after the tracks currently being scanned, without calling the callback for them
+	fun cancel() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before cancel()")
+		}
+		cancelNative(ptr)
+	}
+	// blocks until all tracks are done or the scan was cancelled. don't call from the callback
+	fun await() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() before await()")
+		}
+		joinNative(ptr)
+	}
+	// cancels and waits for the scan threads, if still running
+	fun release() {
+		if (ptr == 0L) {
+			throw IllegalStateException("called release() already")
+		}
+		try {
+			releaseNative(ptr)
+		} catch (e: Throwable) {
+			throw IllegalStateException("releaseNative failed", e)
+		}
+		ptr = 0L
+	}
+}
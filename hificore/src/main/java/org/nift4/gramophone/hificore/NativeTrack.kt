@@ -36,7 +36,10 @@ import android.os.PersistableBundle
 import androidx.annotation.RequiresApi
 import androidx.core.content.getSystemService
 import androidx.media3.common.util.Log
+import java.io.File
+import java.lang.invoke.VarHandle
 import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 /*
  * Exposes most of the API surface of AudioTrack.cpp, with one minor exceptions:
@@ -68,6 +71,69 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
             SyncWithCallback(5) // user calls write(), track calls onCanWriteMoreData()
         }
 
+        /**
+         * Counters for write() and queue() calls with arrays. [copiedWrites] counts the times the VM
+         * handed out a copy instead of pinning the array, which should stay 0 on ART. [stagedWrites]
+         * counts blocking writes, which always go through a native staging buffer.
+         */
+        data class ArrayWriteStats(val writes: Long, val copiedWrites: Long, val stagedWrites: Long)
+
+        enum class LatencyStat(val id: Int) {
+            MoreDataInterval(0), // time between onMoreData() callbacks
+            MoreDataJitter(1), // how far that is off from the audio duration of the previous callback
+            Write(2), // time spent in write(), including the writer thread
+            Obtain(3) // time spent in obtainBuffer(), including the writer thread
+        }
+
+        /**
+         * Summary of one [LatencyStat] histogram, all in microseconds. Percentiles are accurate to 12.5%.
+         */
+        data class LatencyStats(val count: Long, val meanUs: Long, val maxUs: Long, val p50Us: Long,
+                                val p90Us: Long, val p99Us: Long, val p999Us: Long)
+
+        enum class SchedThread(val id: Int) {
+            Callback(0), // the track's callback thread, which calls onMoreData() etc
+            Writer(1) // see startWriterThread()
+        }
+
+        // clusters are told apart by maximum core frequency. if all cores are the same, all of these
+        // are equivalent to Any
+        enum class CpuCluster(val id: Int) {
+            Any(0),
+            Little(1), // slowest cores
+            Big(2), // all cores except the slowest ones
+            Prime(3) // fastest cores
+        }
+
+        /**
+         * Scheduling a thread actually got. [policy] is the Linux policy (0 is SCHED_OTHER, 1 is
+         * SCHED_FIFO, with SCHED_RESET_ON_FORK or'ed in), [rtPriority] only matters for real-time
+         * policies and [nice] only for SCHED_OTHER. [cpus] has one bit per allowed core.
+         */
+        data class ThreadScheduling(val tid: Int, val policy: Int, val rtPriority: Int, val nice: Int,
+                                    val cpus: Long)
+
+        // bits for queryState(), the native side uses the bit indices
+        const val QUERY_SAMPLE_RATE = 1 shl 0
+        const val QUERY_ORIGINAL_SAMPLE_RATE = 1 shl 1
+        const val QUERY_POSITION = 1 shl 2
+        const val QUERY_BUFFER_POSITION = 1 shl 3
+        const val QUERY_MARKER_POSITION = 1 shl 4
+        const val QUERY_POSITION_UPDATE_PERIOD = 1 shl 5
+        const val QUERY_OUTPUT = 1 shl 6
+        const val QUERY_UNDERRUN_FRAMES = 1 shl 7
+        const val QUERY_BUFFER_DURATION_US = 1 shl 8
+        const val QUERY_STOPPED = 1 shl 9
+        const val QUERY_HAS_STARTED = 1 shl 10
+        const val QUERY_SELECTED_DEVICE = 1 shl 11
+        const val QUERY_PLAYBACK_RATE = 1 shl 12
+        const val QUERY_ALL = (1 shl 13) - 1
+        private const val QUERY_COUNT = 13
+        // the playback rate takes an extra slot after the others, see queryStateInternal
+        private const val QUERY_RESULT_COUNT = QUERY_COUNT + 1
+        private const val STATUS_PAGE_SIZE = 96 // sizeof(status_page)
+        private const val STATUS_READ_ATTEMPTS = 100
+
         data class DirectPlaybackSupport(val normalOffload: Boolean, val gaplessOffload: Boolean,
                                          val directBitstream: Boolean) {
             companion object {
@@ -325,11 +391,28 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
             }
         }
         private external fun getMinFrameCountInternal(streamType: Int, sampleRateInHz: Int): Int
-        private fun prepareForLib() {
+        @Volatile private var symbolCacheInited = false
+        private fun prepareForLib(context: Context? = null) {
             if (!AudioTrackHiddenApi.canLoadLib())
                 throw NativeTrackException("this device is banned")
             if (!AudioTrackHiddenApi.libLoaded)
                 throw NativeTrackException("lib isn't loaded but device isn't banned")
+            if (context != null && !symbolCacheInited) {
+                // code cache is cleared on app updates, which may come with different symbols to probe
+                try {
+                    initSymbolCacheInternal(File(context.codeCacheDir, "hificore_symbols").path,
+                        Build.FINGERPRINT)
+                } catch (t: Throwable) {
+                    throw NativeTrackException("initSymbolCacheInternal() failed", t)
+                }
+                try {
+                    initStructOffsetsInternal(File(context.codeCacheDir, "hificore_offsets").path,
+                        Build.FINGERPRINT)
+                } catch (t: Throwable) {
+                    throw NativeTrackException("initStructOffsetsInternal() failed", t)
+                }
+                symbolCacheInited = true
+            }
             if (!try {
                     initDlsym()
                 } catch (t: Throwable) {
@@ -383,6 +466,27 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
         private external fun isOffloadSupported(sampleRate: Int, format: Int, channelMask: Int, bitRate: Int,
                                                 bitWidth: Int, offloadBufferSize: Int): Int
         private external fun initDlsym(): Boolean
+        private external fun initSymbolCacheInternal(path: String, fingerprint: String)
+        private external fun initStructOffsetsInternal(path: String, fingerprint: String)
+        private external fun getInitStatsInternal(out: LongArray)
+
+        /**
+         * Cost of loading the system libraries and resolving their symbols, measured on the first track
+         * creation in this process. [skippedProbes] counts lookups of optional symbols which were avoided
+         * because a previous run (with the same build, see [cacheValid]) found them missing.
+         */
+        data class InitStats(val initLibNs: Long, val dlsymNs: Long, val skippedProbes: Long,
+                             val failedProbes: Long, val cacheValid: Boolean)
+
+        fun initStats(): InitStats {
+            val out = LongArray(5)
+            try {
+                getInitStatsInternal(out)
+            } catch (t: Throwable) {
+                throw NativeTrackException("failed to get init stats", t)
+            }
+            return InitStats(out[0], out[1], out[2], out[3], out[4] != 0L)
+        }
         fun forTest(context: Context): NativeTrack {
             return NativeTrack(
                 context,
@@ -420,6 +524,11 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     private val transferMode: TransferMode
     private var sessionId: Int
     private var cachedBuffer: ByteBuffer?
+    private var writerThreadStarted = false
+    private var pullModeStarted = false
+    private var pullListener: PullListener? = null
+    private var statusPage: ByteBuffer? = null
+    @Volatile private var statusFence = 0
     val ptr: Long
     @Volatile var myState: State
     // proxy limitations: a lot of fields not initialized (mSampleRate, mAudioFormat, mOffloaded, ...) which can
@@ -459,7 +568,7 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
             throw IllegalArgumentException("contentId cannot be negative (did you mean to use null?)")
         if (contentId == 0 && syncId == null)
             throw IllegalArgumentException("CONTENT_ID_NONE with no syncId (did you mean to use null?)")
-        prepareForLib()
+        prepareForLib(context)
         audioManager = context.getSystemService<AudioManager>()!!
         ptr = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.S) {
             val ats = context.attributionSource
@@ -608,6 +717,7 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
             throw IllegalStateException("state is $myState already")
         myState = State.RELEASED
         cachedBuffer = null
+        statusPage = null
         if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.R && codecListener != null) {
             proxy!!.removeOnCodecFormatChangedListener(codecListener)
         }
@@ -618,15 +728,35 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
         dtor(ptr)
     }
 
-    fun dump(): String {
+    /**
+     * AudioTrack::dump output. With [latencyStats], the histograms of [latencyStats] are appended after it, which
+     * doesn't disturb the *FromDump parsers as they only look at the first lines.
+     */
+    fun dump(latencyStats: Boolean = false): String {
         if (myState == State.RELEASED)
             throw IllegalStateException("state is $myState")
         return try {
-            AudioTrackHiddenApi.dumpInternal(getRealPtr(ptr))
+            val dump = AudioTrackHiddenApi.dumpInternal(getRealPtr(ptr))
+            if (latencyStats) dump + dumpLatencyStatsInternal(ptr) else dump
         } catch (t: Throwable) {
             throw NativeTrackException("failed to dump", t)
         }
     }
+    private external fun dumpLatencyStatsInternal(ptr: Long): String
+
+    /** See [AudioTrackHiddenApi.dumpFields] */
+    fun dumpFields(into: LongArray = LongArray(AudioTrackHiddenApi.DUMP_FIELD_COUNT)): LongArray {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val ret = try {
+            AudioTrackHiddenApi.dumpFieldsInternal(getRealPtr(ptr), into)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to dump", t)
+        }
+        if (!ret)
+            throw NativeTrackException("failed to dump, check prior logs")
+        return into
+    }
 
     fun state(): Int {
         if (myState != State.ALIVE)
@@ -1013,15 +1143,19 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
             throw IllegalStateException("state is $myState")
         val speedPitch = FloatArray(2)
         val ret = getPlaybackRateInternal(ptr, speedPitch)
-        val stretchForVoice = (ret shr 32).toInt()
-        val fallbackMode = ret.toInt()
-        return PlaybackRate(speedPitch[0], speedPitch[1],
+        return playbackRateOf(speedPitch[0], speedPitch[1], ret)
+    }
+    // modes = stretch mode << 32 | fallback mode
+    private fun playbackRateOf(speed: Float, pitch: Float, modes: Long): PlaybackRate {
+        val stretchForVoice = (modes shr 32).toInt()
+        val fallbackMode = modes.toInt()
+        return PlaybackRate(speed, pitch,
             stretchForVoice == 1, when (fallbackMode) {
                 -1 -> StretchFallbackMode.AUDIO_TIMESTRETCH_FALLBACK_CUT_REPEAT
                 0 -> StretchFallbackMode.AUDIO_TIMESTRETCH_FALLBACK_DEFAULT
                 1 -> StretchFallbackMode.AUDIO_TIMESTRETCH_FALLBACK_MUTE
                 2 -> StretchFallbackMode.AUDIO_TIMESTRETCH_FALLBACK_FAIL
-                else -> throw IllegalArgumentException("timestretch $ret")
+                else -> throw IllegalArgumentException("timestretch $modes")
             })
     }
     @RequiresApi(Build.VERSION_CODES.M)
@@ -1280,6 +1414,8 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     fun obtainBufferWithNonContig(requestedFrames: Long, waitCount: Int): Pair<ByteBuffer, Long> {
         if (myState != State.ALIVE)
             throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
         val nc = LongArray(1)
         val ret = try {
             obtainBufferInternal(ptr, frameSize(), waitCount, nc, requestedFrames)
@@ -1294,6 +1430,8 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     fun obtainBuffer(requestedFrames: Long, waitCount: Int): ByteBuffer {
         if (myState != State.ALIVE)
             throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
         val ret = try {
             obtainBufferInternal(ptr, frameSize(), waitCount, null, requestedFrames)
         } catch (t: Throwable) {
@@ -1319,9 +1457,45 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     }
     private external fun releaseBufferInternal(ptr: Long, frameSize: Int, buf: ByteBuffer, limit: Int)
 
+    /**
+     * Same as [obtainBuffer], copying from [buf] and [releaseBuffer] in a loop, but in one native call. This also
+     * fills the part of the track's buffer which wraps around. Only the first obtain waits for [waitCount], so
+     * this may copy less than requested. Returns the amount of bytes copied, which is a multiple of the frame size.
+     * Doesn't change the position of [buf].
+     */
+    fun obtainFillRelease(buf: ByteBuffer, offset: Int?, size: Int?, waitCount: Int): Long {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
+        if (!buf.isDirect)
+            throw IllegalArgumentException("buffer must be direct")
+        val start = offset ?: buf.position()
+        val length = size ?: (buf.limit() - start)
+        if (start < 0 || length < 0 || start.toLong() + length > buf.capacity())
+            throw IllegalArgumentException("offset $start and size $length out of bounds for $buf")
+        val ret = try {
+            obtainFillReleaseInternal(ptr, frameSize(), buf, start, length, waitCount)
+        } catch (t: Throwable) {
+            throw NativeTrackException("obtainFillRelease($buf) failed", t)
+        }
+        if (ret == -32L) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("obtainFillRelease($buf) failed, track died")
+        }
+        if (ret < 0) {
+            throw NativeTrackException("obtainFillRelease($buf) failed: $ret")
+        }
+        return ret
+    }
+    private external fun obtainFillReleaseInternal(ptr: Long, frameSize: Int, buf: ByteBuffer, offset: Int,
+                                                   size: Int, waitCount: Int): Long
+
     fun write(buf: ByteBuffer, offset: Int?, size: Int?, blocking: Boolean): Long {
         if (myState != State.ALIVE)
             throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
         if (!buf.isDirect) {
             return write(buf.array(), buf.arrayOffset() + (offset ?: buf.position()),
                 size ?: (buf.limit() - (offset ?: buf.position())), blocking)
@@ -1345,6 +1519,8 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     fun write(buf: ByteArray, offset: Int, size: Int?, blocking: Boolean): Long {
         if (myState != State.ALIVE)
             throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
         // TODO replicate blockUntilOffloadDrain()
         val ret = try {
             writeInternal(ptr, buf, offset, size ?: buf.size, blocking)
@@ -1363,6 +1539,8 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     fun write(buf: FloatArray, offset: Int, size: Int?, blocking: Boolean): Long {
         if (myState != State.ALIVE)
             throw IllegalStateException("state is $myState")
+        if (writerThreadStarted)
+            throw IllegalStateException("writer thread is started, use queue() instead")
         // TODO assert format is float
         // TODO replicate blockUntilOffloadDrain()
         val ret = try {
@@ -1386,6 +1564,477 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     private external fun writeInternal(ptr: Long, buf: ByteArray, offset: Int, size: Int, blocking: Boolean): Long
     private external fun writeInternal(ptr: Long, buf: FloatArray, offset: Int, size: Int, blocking: Boolean): Long
 
+    fun arrayWriteStats(): ArrayWriteStats {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val out = LongArray(3)
+        try {
+            getArrayWriteStatsInternal(ptr, out)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to get array write stats", t)
+        }
+        return ArrayWriteStats(out[0], out[1], out[2])
+    }
+    private external fun getArrayWriteStatsInternal(ptr: Long, out: LongArray)
+
+    /**
+     * Starts a native thread which writes to this track from a ring buffer of [capacityBytes] (rounded
+     * up to a power of two), so that the thread calling [queue] never blocks on the track and doesn't
+     * need to be on time for every write. Only for [TransferMode.Sync], [TransferMode.SyncWithCallback]
+     * and [TransferMode.Obtain]; write() and obtainBuffer() can't be used anymore afterwards. [flush]
+     * drops queued data too, [pause] and [stop] don't. The thread is stopped by [release]. See
+     * [startPullMode] for [TransferMode.Callback].
+     */
+    fun startWriterThread(capacityBytes: Int) {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (writerThreadStarted || pullModeStarted)
+            throw IllegalStateException("writer thread or pull mode already started")
+        val ret = try {
+            startWriterThreadInternal(ptr, capacityBytes, frameSize())
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to start writer thread", t)
+        }
+        if (!ret) {
+            throw NativeTrackException("failed to start writer thread, check prior logs")
+        }
+        writerThreadStarted = true
+    }
+    private external fun startWriterThreadInternal(ptr: Long, capacity: Int, frameSize: Int): Boolean
+
+    /** Enqueues as much as fits into the ring buffer without blocking, returns the amount of bytes enqueued */
+    fun queue(buf: ByteBuffer, offset: Int?, size: Int?): Long {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (!writerThreadStarted && !pullModeStarted)
+            throw IllegalStateException("neither writer thread nor pull mode are started")
+        if (!buf.isDirect) {
+            return queue(buf.array(), buf.arrayOffset() + (offset ?: buf.position()),
+                size ?: (buf.limit() - (offset ?: buf.position())))
+        }
+        val start = offset ?: buf.position()
+        val length = size ?: (buf.limit() - start)
+        if (start < 0 || length < 0 || start.toLong() + length > buf.capacity())
+            throw IllegalArgumentException("offset $start and size $length out of bounds for $buf")
+        val ret = try {
+            queueInternal(ptr, buf, start, length)
+        } catch (t: Throwable) {
+            throw NativeTrackException("queue($buf) failed", t)
+        }
+        if (ret == -32L) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("queue($buf) failed, track died")
+        }
+        if (ret < 0) {
+            throw NativeTrackException("queue($buf) failed: $ret")
+        }
+        return ret
+    }
+    fun queue(buf: ByteArray, offset: Int, size: Int?): Long {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (!writerThreadStarted && !pullModeStarted)
+            throw IllegalStateException("neither writer thread nor pull mode are started")
+        val length = size ?: (buf.size - offset)
+        if (offset < 0 || length < 0 || offset.toLong() + length > buf.size)
+            throw IllegalArgumentException("offset $offset and size $length out of bounds for ${buf.size}")
+        val ret = try {
+            queueInternal(ptr, buf, offset, length)
+        } catch (t: Throwable) {
+            throw NativeTrackException("queue(${buf.size}) failed", t)
+        }
+        if (ret == -32L) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("queue(${buf.size}) failed, track died")
+        }
+        if (ret < 0) {
+            throw NativeTrackException("queue(${buf.size}) failed: $ret")
+        }
+        return ret
+    }
+    private external fun queueInternal(ptr: Long, buf: ByteBuffer, offset: Int, size: Int): Long
+    private external fun queueInternal(ptr: Long, buf: ByteArray, offset: Int, size: Int): Long
+
+    /** Bytes in the ring buffer which the writer thread didn't write to the track yet */
+    fun queuedBytes(): Long {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        if (!writerThreadStarted && !pullModeStarted)
+            throw IllegalStateException("neither writer thread nor pull mode are started")
+        val ret = try {
+            queuedBytesInternal(ptr)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to get queued bytes", t)
+        }
+        if (ret < 0)
+            throw NativeTrackException("failed to get queued bytes, no ring buffer")
+        return ret
+    }
+    private external fun queuedBytesInternal(ptr: Long): Long
+
+    /**
+     * In [TransferMode.Callback], [Callback.onMoreData] normally gets a new ByteBuffer over the track's
+     * memory for every callback. With staged callbacks enabled, it instead always gets the same buffer
+     * (with position 0 and limit set to the requested size), which is copied into the track afterwards.
+     * This trades a small memcpy for not allocating a Java object per callback.
+     */
+    fun setStagedCallbacks(enabled: Boolean) {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        try {
+            setStagedCallbacksInternal(ptr, enabled)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to set staged callbacks", t)
+        }
+    }
+    private external fun setStagedCallbacksInternal(ptr: Long, enabled: Boolean)
+
+    /**
+     * Snapshot of the status page, see [startStatusPage]. Status fields hold the native status code
+     * of the respective query (0 is success). Reuse one instance to avoid allocating on every poll.
+     */
+    class Status {
+        var updateTimeNs = 0L // CLOCK_MONOTONIC, like System.nanoTime()
+        var positionStatus = 0
+        var position = 0U // same as getPosition()
+        var timestampStatus = 0
+        var timestampPosition = 0L // same as getTimestamp(LongArray)
+        var timestampNs = 0L
+        var underrunFrames = 0L
+        var pendingDurationMs = 0L // -1 if unavailable
+        var queuedBytes = 0L // -1 if neither writer thread nor pull mode are started
+        var routedDeviceId = 0
+        var died = false
+    }
+
+    /**
+     * Starts a native thread which refreshes a status page every [periodMs] with the state that is usually
+     * polled (position, timestamp, underruns, fill level and routed device), so that [readStatus] can read
+     * it without any JNI transition. The thread is stopped by [release].
+     */
+    fun startStatusPage(periodMs: Int) {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (statusPage != null)
+            throw IllegalStateException("status page already started")
+        // allocated here rather than natively, so that a readStatus() racing with release() never
+        // reads freed memory. ART aligns direct buffers to 8 bytes, which the native side checks.
+        val page = ByteBuffer.allocateDirect(STATUS_PAGE_SIZE).order(ByteOrder.nativeOrder())
+        val ret = try {
+            startStatusPageInternal(ptr, page, periodMs)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to start status page", t)
+        }
+        if (!ret)
+            throw NativeTrackException("failed to start status page, check prior logs")
+        statusPage = page
+    }
+    private external fun startStatusPageInternal(ptr: Long, page: ByteBuffer, periodMs: Int): Boolean
+
+    // keeps the loads of the status page in order (the native side uses a seqlock)
+    private fun loadFence() {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+            VarHandle.loadLoadFence()
+        } else {
+            // the volatile store (release) keeps the loads before it above it, and the volatile
+            // load (acquire) which can't move above the store keeps the loads after it below it
+            statusFence = 0
+            @Suppress("UNUSED_VARIABLE") val unused = statusFence
+        }
+    }
+
+    /** Reads a consistent snapshot of the status page into [into], see [startStatusPage] */
+    fun readStatus(into: Status): Status {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val page = statusPage ?: throw IllegalStateException("status page isn't started")
+        // the writer only holds the page for a memcpy, so this only fails if it was preempted
+        // in the middle of one, over and over again
+        repeat(STATUS_READ_ATTEMPTS) {
+            val seq = page.getInt(0)
+            if ((seq and 1) != 0) {
+                Thread.yield()
+                return@repeat // being written right now
+            }
+            loadFence()
+            into.updateTimeNs = page.getLong(8)
+            into.positionStatus = page.getLong(16).toInt()
+            into.position = page.getLong(24).toUInt()
+            into.timestampStatus = page.getLong(32).toInt()
+            into.timestampPosition = page.getLong(40)
+            into.timestampNs = page.getLong(48)
+            into.underrunFrames = page.getLong(56)
+            into.pendingDurationMs = page.getLong(64)
+            into.queuedBytes = page.getLong(72)
+            into.routedDeviceId = page.getLong(80).toInt()
+            into.died = page.getLong(88) != 0L
+            loadFence()
+            if (page.getInt(0) == seq)
+                return into
+        }
+        throw NativeTrackException("status page didn't settle after $STATUS_READ_ATTEMPTS attempts")
+    }
+
+    /**
+     * Result of [queryState]. Queries which weren't requested, failed, or aren't available on this
+     * Android version are null. Reuse one instance to avoid allocating the result array every time.
+     */
+    class StateSnapshot {
+        internal val raw = LongArray(QUERY_RESULT_COUNT)
+        var sampleRate: UInt? = null
+        var originalSampleRate: UInt? = null
+        var position: UInt? = null
+        var bufferPosition: UInt? = null
+        var markerPosition: UInt? = null
+        var positionUpdatePeriod: UInt? = null
+        var output: Int? = null
+        var underrunFrames: UInt? = null
+        var bufferDurationInUs: ULong? = null
+        var stopped: Boolean? = null
+        var hasStarted: Boolean? = null
+        var selectedDeviceId: Int? = null // 0 if none is selected
+        var playbackRate: PlaybackRate? = null
+    }
+
+    /**
+     * Runs all getters selected by [mask] (a combination of the QUERY_* constants) with a single JNI
+     * transition, for callers that need many of them at once. Results match the respective getters.
+     */
+    fun queryState(mask: Int, into: StateSnapshot = StateSnapshot()): StateSnapshot {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val ret = try {
+            queryStateInternal(ptr, mask, into.raw)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to query state", t)
+        }
+        if (ret == -32) {
+            // the values are still good, like with the single getters
+            myState = State.DEAD_OBJECT
+        } else if (ret != 0) {
+            throw NativeTrackException("queryState($mask) failed: $ret")
+        }
+        val raw = into.raw
+        fun value(bit: Int, index: Int) =
+            if ((mask and bit) != 0 && raw[index] != Long.MIN_VALUE) raw[index] else null
+        // status << 32 | data, see getPosition()
+        fun combo(bit: Int, index: Int) = value(bit, index)?.let {
+            if ((it ushr 32) == 0L) (it and 0xffffffffL).toUInt() else null
+        }
+        into.sampleRate = value(QUERY_SAMPLE_RATE, 0)?.toInt()?.toUInt()
+        into.originalSampleRate = value(QUERY_ORIGINAL_SAMPLE_RATE, 1)?.toInt()?.toUInt()
+        into.position = combo(QUERY_POSITION, 2)
+        into.bufferPosition = combo(QUERY_BUFFER_POSITION, 3)
+        into.markerPosition = combo(QUERY_MARKER_POSITION, 4)
+        into.positionUpdatePeriod = combo(QUERY_POSITION_UPDATE_PERIOD, 5)
+        into.output = value(QUERY_OUTPUT, 6)?.toInt()
+        into.underrunFrames = value(QUERY_UNDERRUN_FRAMES, 7)?.toUInt()
+        into.bufferDurationInUs = value(QUERY_BUFFER_DURATION_US, 8)?.let { if (it < 0) null else it.toULong() }
+        into.stopped = value(QUERY_STOPPED, 9)?.let { it != 0L }
+        into.hasStarted = value(QUERY_HAS_STARTED, 10)?.let { it != 0L }
+        into.selectedDeviceId = value(QUERY_SELECTED_DEVICE, 11)?.toInt()
+        into.playbackRate = value(QUERY_PLAYBACK_RATE, 12)?.let {
+            playbackRateOf(Float.fromBits((it ushr 32).toInt()), Float.fromBits(it.toInt()),
+                raw[QUERY_COUNT])
+        }
+        return into
+    }
+    private external fun queryStateInternal(ptr: Long, mask: Int, out: LongArray): Int
+
+    interface PullListener {
+        // called on a native thread (not main thread, not callback thread) when less than half of
+        // the ring buffer is filled. may be called again before anything was queued.
+        fun onDataNeeded(queuedBytes: Long)
+    }
+
+    /**
+     * Serves [Callback.onMoreData] in native code from a ring buffer of [capacityBytes] (rounded up
+     * to a power of two) which is filled with [queue], so that no Java code runs on the callback thread.
+     * For float tracks, the data can be processed on the way with [setPullGain], [setPullCompressor] and
+     * [setPullLimiter]. [listener] is told asynchronously when more data should be queued. Only for
+     * [TransferMode.Callback], and must be called before [start].
+     */
+    fun startPullMode(capacityBytes: Int, listener: PullListener?) {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (writerThreadStarted || pullModeStarted)
+            throw IllegalStateException("writer thread or pull mode already started")
+        pullListener = listener
+        val ret = try {
+            startPullModeInternal(ptr, capacityBytes, frameSize(), if (format() == 0x5U) channelCount() else 0)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to start pull mode", t)
+        }
+        if (!ret) {
+            throw NativeTrackException("failed to start pull mode, check prior logs")
+        }
+        pullModeStarted = true
+    }
+    private external fun startPullModeInternal(ptr: Long, capacity: Int, frameSize: Int, floatChannelCount: Int): Boolean
+
+    private fun checkPullProcessing() {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        if (!pullModeStarted)
+            throw IllegalStateException("pull mode isn't started")
+        if (format() != 0x5U)
+            throw IllegalStateException("pull mode processing needs a float track")
+    }
+
+    /** Linear gain, ramped over one callback buffer when changed */
+    fun setPullGain(gain: Float) {
+        checkPullProcessing()
+        val ret = try {
+            setPullGainInternal(ptr, gain)
+        } catch (t: Throwable) {
+            throw NativeTrackException("setPullGain($gain) failed", t)
+        }
+        if (ret == -32) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("setPullGain($gain) failed, track died")
+        }
+    }
+    private external fun setPullGainInternal(ptr: Long, gain: Float): Int
+
+    /**
+     * Runs [drc] after the gain, with the parameters of [AdaptiveDynamicRangeCompression.compress]. Pass
+     * null to remove it. [drc] must stay alive and must not be re-initialized until it is removed again.
+     */
+    fun setPullCompressor(drc: AdaptiveDynamicRangeCompression?, inputAmp: Float = 1f,
+                          kneeThresholdLog: Float = 0f, postAmp: Float = 1f) {
+        checkPullProcessing()
+        if (drc != null && (drc.ptr == 0L || !drc.inited))
+            throw IllegalArgumentException("compressor is released or not initialized")
+        val ret = try {
+            setPullCompressorInternal(ptr, drc?.ptr ?: 0L, inputAmp, kneeThresholdLog, postAmp)
+        } catch (t: Throwable) {
+            throw NativeTrackException("setPullCompressor($drc) failed", t)
+        }
+        if (ret == -32) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("setPullCompressor($drc) failed, track died")
+        }
+    }
+    private external fun setPullCompressorInternal(ptr: Long, drcPtr: Long, inputAmp: Float,
+                                                   kneeThresholdLog: Float, postAmp: Float): Int
+
+    /**
+     * Runs [limiter] last. Pass null to remove it. [limiter] must be initialized with the channel
+     * count and sample rate of this track, and must stay alive and must not be re-initialized
+     * until it is removed again.
+     */
+    fun setPullLimiter(limiter: LookaheadLimiter?) {
+        checkPullProcessing()
+        if (limiter != null) {
+            if (limiter.ptr == 0L || !limiter.inited)
+                throw IllegalArgumentException("limiter is released or not initialized")
+            val sampleRate = if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.M)
+                getOriginalSampleRate() else getSampleRate()
+            if (limiter.channelCount != channelCount() || limiter.samplingRate != sampleRate.toInt())
+                throw IllegalArgumentException("limiter is for ${limiter.channelCount} channels at " +
+                        "${limiter.samplingRate}Hz, but the track has ${channelCount()} at ${sampleRate}Hz")
+        }
+        val ret = try {
+            setPullLimiterInternal(ptr, limiter?.ptr ?: 0L)
+        } catch (t: Throwable) {
+            throw NativeTrackException("setPullLimiter($limiter) failed", t)
+        }
+        if (ret == -32) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("setPullLimiter($limiter) failed, track died")
+        }
+        if (ret != 0) {
+            throw NativeTrackException("setPullLimiter($limiter) failed: $ret")
+        }
+    }
+    private external fun setPullLimiterInternal(ptr: Long, limiterPtr: Long): Int
+
+    /** Callbacks which could not be filled completely because the ring buffer ran dry */
+    fun pullUnderruns(): Long {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        if (!pullModeStarted)
+            throw IllegalStateException("pull mode isn't started")
+        val ret = try {
+            getPullUnderrunsInternal(ptr)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to get pull underruns", t)
+        }
+        if (ret == -32L) {
+            myState = State.DEAD_OBJECT
+            throw NativeTrackException("failed to get pull underruns, track died")
+        }
+        return ret
+    }
+    private external fun getPullUnderrunsInternal(ptr: Long): Long
+
+    /**
+     * Timing of the calls that usually precede an underrun, recorded since creation or [resetLatencyStats].
+     */
+    fun latencyStats(): Map<LatencyStat, LatencyStats> {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val out = LongArray(LatencyStat.entries.size * 7)
+        try {
+            getLatencyStatsInternal(ptr, out)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to get latency stats", t)
+        }
+        return LatencyStat.entries.associateWith {
+            val i = it.id * 7
+            LatencyStats(out[i], out[i + 1], out[i + 2], out[i + 3], out[i + 4], out[i + 5], out[i + 6])
+        }
+    }
+    private external fun getLatencyStatsInternal(ptr: Long, out: LongArray)
+
+    fun resetLatencyStats() {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        try {
+            resetLatencyStatsInternal(ptr)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to reset latency stats", t)
+        }
+    }
+    private external fun resetLatencyStatsInternal(ptr: Long)
+
+    /**
+     * Requests SCHED_FIFO at [fifoPriority] for [thread] (or SCHED_OTHER with [nice] if [fifoPriority] is 0 or
+     * the system doesn't allow real-time scheduling, which is the normal case for apps) and pins it to [cluster].
+     * If the thread isn't running yet, the request is applied once it starts. Failures are only logged, use
+     * [getThreadScheduling] to see what the thread actually got.
+     */
+    fun setThreadScheduling(thread: SchedThread, fifoPriority: Int, nice: Int, cluster: CpuCluster) {
+        if (myState != State.ALIVE)
+            throw IllegalStateException("state is $myState")
+        val ret = try {
+            setThreadSchedulingInternal(ptr, thread.id, fifoPriority, nice, cluster.id)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to set thread scheduling", t)
+        }
+        if (!ret)
+            throw IllegalArgumentException("setThreadScheduling($thread, $fifoPriority, $nice, $cluster) " +
+                    "failed, check prior logs")
+    }
+    private external fun setThreadSchedulingInternal(ptr: Long, thread: Int, fifoPriority: Int, nice: Int,
+                                                     cluster: Int): Boolean
+
+    /** Returns null if [thread] didn't run yet */
+    fun getThreadScheduling(thread: SchedThread): ThreadScheduling? {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        val out = LongArray(5)
+        val ret = try {
+            getThreadSchedulingInternal(ptr, thread.id, out)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to get thread scheduling", t)
+        }
+        if (!ret)
+            return null
+        return ThreadScheduling(out[0].toInt(), out[1].toInt(), out[2].toInt(), out[3].toInt(), out[4])
+    }
+    private external fun getThreadSchedulingInternal(ptr: Long, thread: Int, out: LongArray): Boolean
+
     fun channelCount(): Int {
         return Integer.bitCount(channelMask().toInt())
     }
@@ -1561,6 +2210,27 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
     @RequiresApi(Build.VERSION_CODES.N)
     private external fun pendingDurationInternal(ptr: Long, location: Int): Long
 
+    /**
+     * Checks whether the track died, i.e. because audioserver restarted. [myState] only changes once a call
+     * fails with DEAD_OBJECT, so this is for tracks which sat idle. Tracks which may reconnect are restored
+     * instead, and aren't dead afterwards.
+     */
+    fun probeDead(): Boolean {
+        if (myState == State.RELEASED)
+            throw IllegalStateException("state is $myState")
+        if (myState == State.DEAD_OBJECT)
+            return true
+        val dead = try {
+            isDeadInternal(ptr)
+        } catch (t: Throwable) {
+            throw NativeTrackException("failed to check if dead", t)
+        }
+        if (dead)
+            myState = State.DEAD_OBJECT
+        return dead
+    }
+    private external fun isDeadInternal(ptr: Long): Boolean
+
     @RequiresApi(Build.VERSION_CODES.O)
     fun hasStarted(): Boolean {
         if (myState == State.RELEASED)
@@ -1653,6 +2323,20 @@ class NativeTrack(context: Context, attributes: AudioAttributes, streamType: Int
         }
         return 0 // amount of bytes written
     }
+    // called from native, on pull notifier thread (not main thread, not callback thread!)
+    private fun onPullDataNeeded(queuedBytes: Long) {
+        pullListener?.onDataNeeded(queuedBytes)
+    }
+    // called from native, on callback thread (not main thread!)
+    // buffer is the same object on every call, see setStagedCallbacks()
+    private fun onMoreDataStaged(frameCount: Long, buffer: ByteBuffer, size: Int): Long {
+        cb?.let {
+            buffer.clear()
+            buffer.limit(size)
+            return it.onMoreData(frameCount, buffer)
+        }
+        return 0 // amount of bytes written
+    }
     // called from native, on callback thread (not main thread!)
     private fun onCanWriteMoreData(frameCount: Long, sizeBytes: Long) {
         cb?.onCanWriteMoreData(frameCount, sizeBytes)
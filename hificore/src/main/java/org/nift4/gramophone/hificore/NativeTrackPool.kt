@@ -0,0 +1,167 @@
+package org.nift4.gramophone.hificore
+
+import android.content.Context
+import android.media.AudioAttributes
+import android.media.AudioManager
+import androidx.media3.common.util.Log
+import java.util.concurrent.ExecutorService
+import java.util.concurrent.Executors
+import java.util.concurrent.Future
+import java.util.concurrent.TimeUnit
+import java.util.concurrent.TimeoutException
+
+/**
+ * Creates tracks for the configuration that will likely be needed next (i.e. the one of the next
+ * queue item) on a background thread, so that switching formats doesn't have to wait for
+ * AudioFlinger to create the track. [acquire] then just hands over the finished [NativeTrack],
+ * whose [NativeTrack.cb] can be set as usual.
+ *
+ * Idle tracks hold a slot on their output and a session id, so only up to [capacity] are kept,
+ * the oldest ones are released first. Shared memory tracks can't be pooled.
+ */
+class NativeTrackPool(context: Context, private val capacity: Int = 1) {
+	companion object {
+		private const val TAG = "NativeTrackPool"
+	}
+
+	// everything NativeTrack's constructor needs, except for the context and shared memory
+	data class Config(
+		val attributes: AudioAttributes,
+		val streamType: Int,
+		val sampleRate: Int,
+		val format: UInt,
+		val channelMask: UInt,
+		val frameCount: Int? = null,
+		val trackFlags: Int = 0,
+		val maxRequiredSpeed: Float = 1.0f,
+		val selectedDeviceId: Int? = null,
+		val bitRate: Int = 0,
+		val durationUs: Long = 0,
+		val hasVideo: Boolean = false,
+		val smallBuf: Boolean = false,
+		val isStreaming: Boolean = false,
+		val offloadBufferSize: Int = 0,
+		val notificationFrames: Int = 0,
+		val doNotReconnect: Boolean = false,
+		val transferMode: NativeTrack.Companion.TransferMode,
+		val encapsulationMode: Int = NativeTrack.ENCAPSULATION_MODE_NONE
+	) {
+		init {
+			if (transferMode == NativeTrack.Companion.TransferMode.Shared)
+				throw IllegalArgumentException("shared memory tracks can't be pooled")
+		}
+
+		fun create(context: Context) = NativeTrack(context, attributes, streamType, sampleRate, format,
+			channelMask, frameCount, trackFlags, AudioManager.AUDIO_SESSION_ID_GENERATE, maxRequiredSpeed,
+			selectedDeviceId, bitRate, durationUs, hasVideo, smallBuf, isStreaming, offloadBufferSize,
+			notificationFrames, doNotReconnect, transferMode, null, null, encapsulationMode, null)
+	}
+
+	private val context = context.applicationContext
+	private val executor: ExecutorService = Executors.newSingleThreadExecutor { Thread(it, TAG) }
+	// oldest first, guarded by itself
+	private val tracks = LinkedHashMap<Config, Future<NativeTrack?>>()
+	private var released = false
+
+	init {
+		if (capacity < 1)
+			throw IllegalArgumentException("capacity must be at least 1")
+	}
+
+	/**
+	 * Starts creating a track for [config] in the background, unless there already is one.
+	 */
+	fun prewarm(config: Config) {
+		val evicted = synchronized(tracks) {
+			if (released)
+				throw IllegalStateException("pool is released")
+			if (tracks.containsKey(config))
+				return
+			val evicted = mutableListOf<Future<NativeTrack?>>()
+			while (tracks.size >= capacity) {
+				val oldest = tracks.keys.first()
+				evicted.add(tracks.remove(oldest)!!)
+			}
+			tracks[config] = executor.submit<NativeTrack?> {
+				try {
+					config.create(context)
+				} catch (e: Exception) {
+					Log.w(TAG, "failed to prewarm track for $config", e)
+					null
+				}
+			}
+			evicted
+		}
+		evicted.forEach { releaseLater(it) }
+	}
+
+	/**
+	 * Takes the track for [config] out of the pool, or returns null if there is none (the caller should
+	 * then create one the usual way). If the track is still being created, waits up to [timeoutMs] for it.
+	 */
+	fun acquire(config: Config, timeoutMs: Long = 0): NativeTrack? {
+		val future = synchronized(tracks) {
+			if (released)
+				throw IllegalStateException("pool is released")
+			val future = tracks[config] ?: return null
+			if (!future.isDone && timeoutMs <= 0)
+				return null // let it finish, maybe the next acquire() comes later
+			tracks.remove(config)
+			future
+		}
+		val track = try {
+			future.get(timeoutMs.coerceAtLeast(0), TimeUnit.MILLISECONDS)
+		} catch (_: TimeoutException) {
+			releaseLater(future)
+			return null
+		} catch (e: Exception) {
+			Log.w(TAG, "prewarming track for $config failed", e)
+			return null
+		} ?: return null
+		val dead = try {
+			track.probeDead()
+		} catch (e: NativeTrack.NativeTrackException) {
+			Log.w(TAG, "failed to check pooled track for $config", e)
+			true
+		}
+		if (dead) {
+			// the track died while it was idle, i.e. because audioserver restarted
+			track.release()
+			return null
+		}
+		return track
+	}
+
+	/** Releases all idle tracks and stops the background thread */
+	fun release() {
+		synchronized(tracks) {
+			if (released)
+				return
+			released = true
+			tracks.values.forEach { releaseLater(it) }
+			tracks.clear()
+			// under the lock, so that releaseLater() knows whether it can still use the executor
+			executor.shutdown()
+		}
+	}
+
+	private fun releaseLater(future: Future<NativeTrack?>) {
+		synchronized(tracks) {
+			if (!executor.isShutdown) {
+				// runs after the creation, as the executor is single threaded
+				executor.execute { releaseNow(future) }
+				return
+			}
+		}
+		// the pool was released meanwhile, the creation still finishes as shutdown() lets it run
+		releaseNow(future)
+	}
+
+	private fun releaseNow(future: Future<NativeTrack?>) {
+		try {
+			future.get()?.release()
+		} catch (e: Exception) {
+			Log.w(TAG, "failed to release pooled track", e)
+		}
+	}
+}
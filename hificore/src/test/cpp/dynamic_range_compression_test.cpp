@@ -0,0 +1,136 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Bounds the error of the block-rate envelope (block_size > 1) against the per-frame path.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "compressor/dynamic_range_compression.h"
+
+namespace {
+
+// ReplayGainUtil.TAU_ATTACK, TAU_RELEASE and RATIO
+constexpr float kTauAttack = 0.0014f;
+constexpr float kTauRelease = 0.093f;
+constexpr float kRatio = 2.f;
+constexpr float kKneeThresholdDb = -6.f;
+constexpr size_t kChannels = 2;
+// frames per Compress() call, deliberately not a multiple of the block sizes
+constexpr size_t kBufferFrames = 1000;
+
+struct Deviation {
+	float louderDb = 0.f; // block path louder than the per-frame path
+	float quieterDb = 0.f; // block path quieter than the per-frame path
+};
+
+std::vector<float> compress(const std::vector<float>& in, float sampleRate, size_t blockSize,
+                            float inputAmp) {
+	le_fx::AdaptiveDynamicRangeCompression drc;
+	drc.Initialize(sampleRate, kTauAttack, kTauRelease, kRatio, blockSize);
+	std::vector<float> buffer = in;
+	const size_t frames = in.size() / kChannels;
+	for (size_t i = 0; i < frames; i += kBufferFrames) {
+		const size_t n = std::min(kBufferFrames, frames - i);
+		drc.Compress(kChannels, inputAmp, kKneeThresholdDb, 1.f, buffer.data() + i * kChannels,
+		             buffer.data() + i * kChannels, n);
+	}
+	return buffer;
+}
+
+// Compares the gain applied by both paths on every sample which is loud enough for the ratio
+// to be meaningful.
+Deviation compare(const std::vector<float>& in, float sampleRate, size_t blockSize,
+                  float inputAmp) {
+	const auto frame = compress(in, sampleRate, 1, inputAmp);
+	const auto block = compress(in, sampleRate, blockSize, inputAmp);
+	Deviation d;
+	for (size_t i = 0; i < in.size(); ++i) {
+		if (std::abs(in[i]) < 1e-3f || std::abs(frame[i]) < 1e-6f)
+			continue;
+		const float db = 20.f * std::log10(block[i] / frame[i]);
+		d.louderDb = std::max(d.louderDb, db);
+		d.quieterDb = std::max(d.quieterDb, -db);
+	}
+	return d;
+}
+
+std::vector<float> generate(float sampleRate, float seconds, const std::function<float(size_t)>& f) {
+	std::vector<float> out(static_cast<size_t>(sampleRate * seconds) * kChannels);
+	for (size_t i = 0; i < out.size() / kChannels; ++i) {
+		for (size_t c = 0; c < kChannels; ++c) {
+			out[i * kChannels + c] = f(i);
+		}
+	}
+	return out;
+}
+
+// A quiet sine which steps up to full scale at an odd offset, and back down after 0.3s.
+std::vector<float> step(float sampleRate) {
+	const size_t up = static_cast<size_t>(0.2f * sampleRate) + 7;
+	const size_t down = up + static_cast<size_t>(0.3f * sampleRate);
+	return generate(sampleRate, 0.8f, [=](size_t i) {
+		const float amp = (i >= up && i < down) ? 1.f : 0.05f;
+		return amp * std::sin(2.f * static_cast<float>(M_PI) * 997.f * static_cast<float>(i) / sampleRate);
+	});
+}
+
+// Full scale clicks every 0.1s on a quiet sine, at varying positions within the blocks.
+std::vector<float> impulses(float sampleRate) {
+	const size_t period = static_cast<size_t>(0.1f * sampleRate) + 13;
+	return generate(sampleRate, 1.f, [=](size_t i) {
+		if (i % period == 0)
+			return 1.f;
+		return 0.05f * std::sin(2.f * static_cast<float>(M_PI) * 441.f * static_cast<float>(i) / sampleRate);
+	});
+}
+
+struct Case {
+	size_t blockSize;
+	// measured maxima for these signals, plus a margin for compiler and platform differences
+	float maxLouderDb;
+	float maxQuieterDb;
+};
+
+}  // namespace
+
+class DynamicRangeCompressionBlockTest : public ::testing::TestWithParam<float> {};
+
+TEST_P(DynamicRangeCompressionBlockTest, StepAndImpulseDeviation) {
+	const float sampleRate = GetParam();
+	// The block path attenuates the whole block for a transient in it, so it may be a lot
+	// quieter right in front of one. Louder is only possible from the linear interpolation
+	// during the attack, which is below 0.03dB.
+	for (const Case& c : { Case { 16, 0.05f, 3.f }, Case { 32, 0.05f, 5.f },
+	                       Case { 64, 0.05f, 7.f } }) {
+		for (const float inputAmp : { 1.f, 4.f }) {
+			SCOPED_TRACE(testing::Message() << "rate " << sampleRate << " block " << c.blockSize
+			                                << " input amp " << inputAmp);
+			const Deviation s = compare(step(sampleRate), sampleRate, c.blockSize, inputAmp);
+			EXPECT_LE(s.louderDb, c.maxLouderDb) << "step";
+			EXPECT_LE(s.quieterDb, c.maxQuieterDb) << "step";
+			const Deviation p = compare(impulses(sampleRate), sampleRate, c.blockSize, inputAmp);
+			EXPECT_LE(p.louderDb, c.maxLouderDb) << "impulses";
+			EXPECT_LE(p.quieterDb, c.maxQuieterDb) << "impulses";
+		}
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(SampleRates, DynamicRangeCompressionBlockTest,
+                         ::testing::Values(44100.f, 96000.f, 192000.f));
@@ -0,0 +1,38 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_TEST_LOG_MACROS_H
+#define GRAMOPHONE_TEST_LOG_MACROS_H
+
+// Host stand-in for the NDK header, so that DSP sources can be built into the host tests.
+
+#include <cstdio>
+
+#define GRAMOPHONE_TEST_LOG(level, ...) \
+    (fprintf(stderr, "%s %s: ", level, LOG_TAG), fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+
+#ifndef LOG_TAG
+#define LOG_TAG ""
+#endif
+
+#define ALOGE(...) GRAMOPHONE_TEST_LOG("E", __VA_ARGS__)
+#define ALOGW(...) GRAMOPHONE_TEST_LOG("W", __VA_ARGS__)
+#define ALOGI(...) GRAMOPHONE_TEST_LOG("I", __VA_ARGS__)
+#define ALOGD(...) ((void) 0)
+#define ALOGV(...) ((void) 0)
+
+#endif //GRAMOPHONE_TEST_LOG_MACROS_H
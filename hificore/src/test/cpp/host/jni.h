@@ -0,0 +1,50 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_TEST_JNI_H
+#define GRAMOPHONE_TEST_JNI_H
+
+// Host stand-in for <jni.h>. The tests call the DSP classes directly, so this only has to let
+// the JNI glue in the same sources compile; none of it is ever called.
+
+#include <cstdint>
+
+#define JNIEXPORT
+#define JNICALL
+
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef uint8_t jboolean;
+typedef float jfloat;
+typedef jint jsize;
+
+class _jobject {};
+class _jarray : public _jobject {};
+class _jfloatArray : public _jarray {};
+typedef _jobject* jobject;
+typedef _jarray* jarray;
+typedef _jfloatArray* jfloatArray;
+
+struct _JNIEnv {
+	void* GetDirectBufferAddress(jobject) { return nullptr; }
+	jsize GetArrayLength(jarray) { return 0; }
+	void GetFloatArrayRegion(jfloatArray, jsize, jsize, jfloat*) {}
+	void SetFloatArrayRegion(jfloatArray, jsize, jsize, const jfloat*) {}
+};
+typedef _JNIEnv JNIEnv;
+
+#endif //GRAMOPHONE_TEST_JNI_H
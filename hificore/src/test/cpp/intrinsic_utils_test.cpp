@@ -0,0 +1,258 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compares the hardware vector paths of intrinsic_utils.h (vector_hw_t, i.e. SSE / AVX / NEON,
+// depending on the flags this file is built with) against the scalar internal_array_t path.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+#include "compressor/dynamic_range_compression.h"
+#include "compressor/intrinsic_utils.h"
+#include "compressor/true_peak_detector.h"
+#include "test_utils.h"
+
+using namespace android::audio_utils::intrinsics;
+
+namespace {
+
+// Element-wise ops do the same IEEE operation per lane as the scalar loop, so they should be
+// exact. One ulp is allowed for targets which contract vmla into a fused multiply-add.
+constexpr int64_t kElementwiseUlp = 1;
+// The polynomial of vfast_exp2 / vfast_log2 is evaluated the same way in both paths.
+constexpr int64_t kFastMathUlp = 1;
+// Horizontal sums associate differently, so their error is bounded relative to sum(|x|).
+constexpr float kReductionEpsilon = 4 * std::numeric_limits<float>::epsilon();
+
+template <size_t N>
+struct Types {
+	using V = vector_hw_t<float, N>;
+	using S = internal_array_t<float, N>;
+};
+
+template <typename T>
+class IntrinsicUtilsTest : public ::testing::Test {};
+
+// the sizes with a direct register type, a composite of them, and their remainders
+using Sizes = ::testing::Types<
+		std::integral_constant<size_t, 1>, std::integral_constant<size_t, 2>,
+		std::integral_constant<size_t, 3>, std::integral_constant<size_t, 4>,
+		std::integral_constant<size_t, 5>, std::integral_constant<size_t, 6>,
+		std::integral_constant<size_t, 7>, std::integral_constant<size_t, 8>,
+		std::integral_constant<size_t, 9>, std::integral_constant<size_t, 12>,
+		std::integral_constant<size_t, 15>, std::integral_constant<size_t, 16>,
+		std::integral_constant<size_t, 17>, std::integral_constant<size_t, 24>,
+		std::integral_constant<size_t, 28>, std::integral_constant<size_t, 31>,
+		std::integral_constant<size_t, 32>>;
+TYPED_TEST_SUITE(IntrinsicUtilsTest, Sizes);
+
+constexpr int kIterations = 200;
+
+// Random values of mixed magnitude and sign, with some exact zeros of both signs.
+template <size_t N>
+void fill(std::mt19937& rng, float (&out)[N]) {
+	std::uniform_real_distribution<float> mantissa(-1.f, 1.f);
+	std::uniform_int_distribution<int> exponent(-20, 20);
+	std::uniform_int_distribution<int> special(0, 15);
+	for (auto& x : out) {
+		switch (special(rng)) {
+			case 0: x = 0.f; break;
+			case 1: x = -0.f; break;
+			default: x = std::ldexp(mantissa(rng), exponent(rng)); break;
+		}
+	}
+}
+
+template <typename T, size_t N>
+void store(float (&out)[N], const T& v) {
+	vst1(out, v);
+}
+
+template <size_t N>
+void expectUlp(const float (&expected)[N], const float (&actual)[N], int64_t ulp, const char* op) {
+	for (size_t i = 0; i < N; ++i) {
+		EXPECT_LE(gramophone_test::ulpDistance(expected[i], actual[i]), ulp)
+				<< op << " lane " << i << " of " << N << ": scalar " << expected[i]
+				<< " vector " << actual[i];
+	}
+}
+
+// Runs f on the vector and on the scalar type and compares the stored results lane by lane.
+#define EXPECT_VEC_EQ(ulp, op, ...) \
+	do { \
+		float expected_[N]; \
+		float actual_[N]; \
+		{ using T = S; auto& a = sa; auto& b = sb; auto& c = sc; \
+		  (void) a; (void) b; (void) c; store(expected_, (__VA_ARGS__)); } \
+		{ using T = V; auto& a = va; auto& b = vb; auto& c = vc; \
+		  (void) a; (void) b; (void) c; store(actual_, (__VA_ARGS__)); } \
+		expectUlp(expected_, actual_, ulp, op); \
+	} while (false)
+
+}  // namespace
+
+TYPED_TEST(IntrinsicUtilsTest, LoadStoreRoundTrip) {
+	constexpr size_t N = TypeParam::value;
+	using V = typename Types<N>::V;
+	std::mt19937 rng(N);
+	float in[N];
+	float out[N];
+	for (int i = 0; i < kIterations; ++i) {
+		fill(rng, in);
+		store(out, vld1<V>(in));
+		expectUlp(in, out, 0, "vld1/vst1");
+		store(out, V(vld1<internal_array_t<float, N>>(in)));
+		expectUlp(in, out, 0, "internal_array_t conversion");
+	}
+}
+
+TYPED_TEST(IntrinsicUtilsTest, ElementWise) {
+	constexpr size_t N = TypeParam::value;
+	using V = typename Types<N>::V;
+	using S = typename Types<N>::S;
+	std::mt19937 rng(100 + N);
+	std::uniform_real_distribution<float> scalar(-4.f, 4.f);
+	float a_[N], b_[N], c_[N];
+	for (int i = 0; i < kIterations; ++i) {
+		fill(rng, a_);
+		fill(rng, b_);
+		fill(rng, c_);
+		const float f = scalar(rng);
+		const float lo = -std::abs(f);
+		const float hi = std::abs(f);
+		const S sa = vld1<S>(a_), sb = vld1<S>(b_), sc = vld1<S>(c_);
+		const V va = vld1<V>(a_), vb = vld1<V>(b_), vc = vld1<V>(c_);
+		EXPECT_VEC_EQ(0, "vdupn", vdupn<T>(f));
+		EXPECT_VEC_EQ(0, "vabs", vabs(a));
+		EXPECT_VEC_EQ(0, "vneg", vneg(a));
+		EXPECT_VEC_EQ(0, "vadd", vadd(a, b));
+		EXPECT_VEC_EQ(0, "vsub", vsub(a, b));
+		EXPECT_VEC_EQ(0, "vmul", vmul(a, b));
+		EXPECT_VEC_EQ(0, "vmul scalar", vmul(a, f));
+		EXPECT_VEC_EQ(0, "vmul scalar first", vmul(f, a));
+		EXPECT_VEC_EQ(0, "vmax", vmax(a, b));
+		EXPECT_VEC_EQ(0, "vmax scalar", vmax(a, f));
+		EXPECT_VEC_EQ(0, "vmin", vmin(a, b));
+		EXPECT_VEC_EQ(0, "vmin scalar", vmin(a, f));
+		EXPECT_VEC_EQ(0, "vclamp", vclamp(a, lo, hi));
+		EXPECT_VEC_EQ(kElementwiseUlp, "vmla", vmla(a, b, c));
+		EXPECT_VEC_EQ(kElementwiseUlp, "vmla scalar", vmla(a, b, f));
+		EXPECT_VEC_EQ(kElementwiseUlp, "vmla scalar middle", vmla(a, f, c));
+	}
+}
+
+TYPED_TEST(IntrinsicUtilsTest, Reductions) {
+	constexpr size_t N = TypeParam::value;
+	using V = typename Types<N>::V;
+	using S = typename Types<N>::S;
+	std::mt19937 rng(200 + N);
+	float a_[N];
+	for (int i = 0; i < kIterations; ++i) {
+		fill(rng, a_);
+		const S sa = vld1<S>(a_);
+		const V va = vld1<V>(a_);
+		// max and min select one of the inputs, so the order doesn't matter
+		EXPECT_EQ(gramophone_test::ulpDistance(vmaxv(sa), vmaxv(va)), 0) << "vmaxv";
+		EXPECT_EQ(gramophone_test::ulpDistance(vminv(sa), vminv(va)), 0) << "vminv";
+		float magnitude = 0.f;
+		for (float x : a_) magnitude += std::abs(x);
+		EXPECT_LE(std::abs(vaddv(sa) - vaddv(va)), kReductionEpsilon * N * magnitude) << "vaddv";
+	}
+}
+
+TYPED_TEST(IntrinsicUtilsTest, FastExp2Log2) {
+	constexpr size_t N = TypeParam::value;
+	using V = typename Types<N>::V;
+	using S = typename Types<N>::S;
+	std::mt19937 rng(300 + N);
+	// covers the clamped range of vfast_exp2 on both sides, and normal inputs of vfast_log2
+	std::uniform_real_distribution<float> exponent(-140.f, 140.f);
+	std::uniform_real_distribution<float> log_argument(-120.f, 120.f);
+	float a_[N], b_[N], c_[N] = {};
+	for (int i = 0; i < kIterations; ++i) {
+		for (size_t j = 0; j < N; ++j) {
+			a_[j] = exponent(rng);
+			b_[j] = std::exp2(log_argument(rng));
+		}
+		const S sa = vld1<S>(a_), sb = vld1<S>(b_), sc = vld1<S>(c_);
+		const V va = vld1<V>(a_), vb = vld1<V>(b_), vc = vld1<V>(c_);
+		EXPECT_VEC_EQ(kFastMathUlp, "vfast_exp2", vfast_exp2(a));
+		EXPECT_VEC_EQ(kFastMathUlp, "vfast_log2", vfast_log2(b));
+	}
+}
+
+TYPED_TEST(IntrinsicUtilsTest, TruePeakDetector) {
+	constexpr size_t N = TypeParam::value;
+	if constexpr (N <= le_fx::TruePeakDetector::kMaxChannels) {
+		using V = typename Types<N>::V;
+		using S = typename Types<N>::S;
+		std::mt19937 rng(400 + N);
+		std::uniform_real_distribution<float> sample(-1.f, 1.f);
+		le_fx::TruePeakDetector scalar;
+		le_fx::TruePeakDetector vector;
+		scalar.Reset();
+		vector.Reset();
+		float frame[N];
+		for (int i = 0; i < 1000; ++i) {
+			for (auto& x : frame) x = sample(rng);
+			const float expected = scalar.Next(vld1<S>(frame));
+			const float actual = vector.Next(vld1<V>(frame));
+			// 12 taps of magnitude <= 1 on samples of magnitude <= 1
+			EXPECT_LE(std::abs(expected - actual), 12 * kReductionEpsilon) << "frame " << i;
+		}
+	}
+}
+
+// ApplyGain (dynamic_range_compression.cpp) uses vector_hw_t for ramps and the widest vector
+// for constant gains, compare both against a plain loop.
+TYPED_TEST(IntrinsicUtilsTest, ApplyGain) {
+	constexpr size_t N = TypeParam::value;
+	if constexpr (N <= 28) {
+		constexpr size_t kFrames = 67; // not a multiple of any vector width
+		std::mt19937 rng(500 + N);
+		std::uniform_real_distribution<float> gain(0.f, 4.f);
+		std::vector<float> in(N * kFrames);
+		std::vector<float> out(N * kFrames);
+		std::uniform_real_distribution<float> sample(-1.f, 1.f);
+		for (auto& x : in) x = sample(rng);
+		float from[N], to[N];
+		for (size_t c = 0; c < N; ++c) {
+			from[c] = gain(rng);
+			to[c] = gain(rng);
+		}
+		ASSERT_TRUE(le_fx::ApplyGain(N, from, to, in.data(), out.data(), kFrames));
+		for (size_t i = 0; i < kFrames; ++i) {
+			for (size_t c = 0; c < N; ++c) {
+				const float step = (to[c] - from[c]) * (1.f / static_cast<float>(kFrames));
+				const float expected = in[i * N + c] * (from[c] + step * static_cast<float>(i));
+				EXPECT_LE(gramophone_test::ulpDistance(expected, out[i * N + c]), kElementwiseUlp)
+						<< "ramp frame " << i << " channel " << c;
+			}
+		}
+		const float constant[N] = { 0.75f };
+		std::fill(std::begin(from), std::end(from), constant[0]);
+		std::fill(std::begin(to), std::end(to), constant[0]);
+		ASSERT_TRUE(le_fx::ApplyGain(N, from, to, in.data(), out.data(), kFrames));
+		for (size_t i = 0; i < N * kFrames; ++i) {
+			EXPECT_EQ(out[i], in[i] * constant[0]) << "constant sample " << i;
+		}
+	}
+}
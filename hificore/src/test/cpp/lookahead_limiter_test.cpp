@@ -0,0 +1,178 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks the sliding window maximum of the limiter against a brute-force one, and that the gain
+// alone (before the final clamp) keeps the delayed signal below the ceiling, also between the
+// samples with true peak limiting.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "compressor/lookahead_limiter.h"
+
+namespace {
+
+constexpr float kCeilingDb = -1.f;
+constexpr float kTauRelease = 0.05f;
+// the average of the gains is accumulated in double, so only the final float cast rounds
+constexpr float kCeilingTolerance = 1e-6f;
+// the gain changes within the 12 frames the true peak is interpolated from
+constexpr float kTruePeakToleranceDb = 0.05f;
+
+struct Signal {
+	std::string name;
+	std::function<float(size_t, float)> f; // frame, sample rate
+};
+
+// Mostly falling peaks, where the deque holds a full window of entries, plus noise.
+std::vector<Signal> signals() {
+	return {
+			{ "40Hz sine", [](size_t i, float rate) {
+				return 2.f * std::sin(2.f * static_cast<float>(M_PI) * 40.f * static_cast<float>(i) / rate);
+			} },
+			{ "falling sawtooth", [](size_t i, float) {
+				return 2.f * (1.f - static_cast<float>(i % 700) / 700.f);
+			} },
+			{ "decaying bursts", [](size_t i, float rate) {
+				const float t = static_cast<float>(i % 4801) / rate;
+				return 4.f * std::exp(-t * 30.f) * ((i & 1) ? 1.f : -1.f);
+			} },
+			{ "noise", [](size_t i, float) {
+				// a hash of the frame index, so that every call sees the same noise
+				uint32_t h = static_cast<uint32_t>(i) * 2654435761u;
+				h ^= h >> 15;
+				h *= 2246822519u;
+				h ^= h >> 13;
+				return 3.f * (static_cast<float>(h) / 2147483648.f - 1.f);
+			} },
+	};
+}
+
+std::vector<float> generate(const Signal& s, float rate, size_t frames) {
+	std::vector<float> out(frames);
+	for (size_t i = 0; i < frames; ++i) {
+		out[i] = s.f(i, rate);
+	}
+	return out;
+}
+
+struct Config {
+	float sampleRate;
+	float lookahead;
+};
+
+}  // namespace
+
+class LookaheadLimiterTest : public ::testing::TestWithParam<Config> {};
+
+TEST_P(LookaheadLimiterTest, WindowPeakMatchesBruteForce) {
+	const Config c = GetParam();
+	for (const Signal& s : signals()) {
+		SCOPED_TRACE(s.name);
+		le_fx::LookaheadLimiter limiter;
+		ASSERT_TRUE(limiter.Initialize(c.sampleRate, 1, c.lookahead, kTauRelease, kCeilingDb));
+		const size_t window = limiter.GetLatency() + 1;
+		const auto x = generate(s, c.sampleRate, static_cast<size_t>(c.sampleRate));
+		size_t mismatches = 0;
+		for (size_t i = 0; i < x.size(); ++i) {
+			limiter.NextGain(std::abs(x[i]));
+			float expected = 0.f;
+			for (size_t j = i + 1 > window ? i + 1 - window : 0; j <= i; ++j) {
+				expected = std::max(expected, std::abs(x[j]));
+			}
+			if (limiter.GetWindowPeak() != expected && mismatches++ == 0) {
+				ADD_FAILURE() << "first mismatch at frame " << i << ": " << limiter.GetWindowPeak()
+				              << " instead of " << expected;
+			}
+		}
+		EXPECT_EQ(mismatches, 0u);
+	}
+}
+
+TEST_P(LookaheadLimiterTest, GainKeepsOutputBelowCeiling) {
+	const Config c = GetParam();
+	const float ceiling = std::pow(10.f, kCeilingDb / 20.f);
+	for (const Signal& s : signals()) {
+		SCOPED_TRACE(s.name);
+		le_fx::LookaheadLimiter limiter;
+		ASSERT_TRUE(limiter.Initialize(c.sampleRate, 1, c.lookahead, kTauRelease, kCeilingDb));
+		const size_t delay = limiter.GetLatency();
+		const auto x = generate(s, c.sampleRate, static_cast<size_t>(c.sampleRate));
+		float worst = 0.f;
+		for (size_t i = 0; i < x.size(); ++i) {
+			const float gain = limiter.NextGain(std::abs(x[i]));
+			const float delayed = i >= delay ? x[i - delay] : 0.f;
+			worst = std::max(worst, std::abs(delayed * gain));
+		}
+		EXPECT_LE(worst, ceiling * (1.f + kCeilingTolerance));
+	}
+}
+
+// Process() clamps, so this only checks that it agrees with NextGain() on the same signal.
+TEST_P(LookaheadLimiterTest, ProcessMatchesNextGain) {
+	const Config c = GetParam();
+	const Signal s = signals()[0];
+	const auto x = generate(s, c.sampleRate, static_cast<size_t>(c.sampleRate) / 4);
+	le_fx::LookaheadLimiter a, b;
+	ASSERT_TRUE(a.Initialize(c.sampleRate, 1, c.lookahead, kTauRelease, kCeilingDb));
+	ASSERT_TRUE(b.Initialize(c.sampleRate, 1, c.lookahead, kTauRelease, kCeilingDb));
+	std::vector<float> out(x.size());
+	a.Process(x.data(), out.data(), x.size());
+	const size_t delay = b.GetLatency();
+	for (size_t i = 0; i < x.size(); ++i) {
+		const float gain = b.NextGain(std::abs(x[i]));
+		const float delayed = i >= delay ? x[i - delay] : 0.f;
+		EXPECT_NEAR(out[i], delayed * gain, 1e-6f) << "frame " << i;
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(Lookaheads, LookaheadLimiterTest,
+                         ::testing::Values(Config { 48000.f, 0.001f }, Config { 48000.f, 0.005f },
+                                           Config { 44100.f, 0.0023f }));
+
+// The fs/4 sine at 45 degrees has its true peak between the samples, about 3dB above them. The
+// bursts start suddenly, so a late true peak reading would not be covered by the gain yet.
+TEST_P(LookaheadLimiterTest, TruePeakStaysBelowCeiling) {
+	const Config c = GetParam();
+	const float ceiling = std::pow(10.f, kCeilingDb / 20.f);
+	const size_t frames = static_cast<size_t>(c.sampleRate) / 2;
+	std::vector<float> x(frames * 2);
+	for (size_t i = 0; i < frames; ++i) {
+		const float amp = (i / 997) % 2 ? 2.f : 0.01f;
+		const float phase = static_cast<float>(M_PI) * (static_cast<float>(i) / 2.f + 0.25f);
+		x[i * 2] = x[i * 2 + 1] = amp * std::sin(phase);
+	}
+	le_fx::LookaheadLimiter limiter;
+	ASSERT_TRUE(limiter.Initialize(c.sampleRate, 2, c.lookahead, kTauRelease, kCeilingDb));
+	const size_t latency = limiter.GetLatency();
+	limiter.SetTruePeak(true);
+	EXPECT_EQ(limiter.GetLatency(), latency + le_fx::TruePeakDetector::kDelay);
+	std::vector<float> out(x.size());
+	limiter.Process(x.data(), out.data(), frames);
+	using namespace android::audio_utils::intrinsics;
+	le_fx::TruePeakDetector detector;
+	detector.Reset();
+	float worst = 0.f;
+	for (size_t i = 0; i < frames; ++i) {
+		worst = std::max(worst, detector.Next(vld1<vector_hw_t<float, 2>>(out.data() + i * 2)));
+	}
+	EXPECT_LE(20.f * std::log10(worst / ceiling), kTruePeakToleranceDb);
+}
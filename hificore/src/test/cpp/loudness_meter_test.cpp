@@ -0,0 +1,128 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The stereo 1kHz sine cases of EBU Tech 3341 (integrated loudness, gating) and Tech 3342
+// (loudness range), synthesized instead of read from the reference files.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "compressor/loudness_meter.h"
+
+namespace {
+
+// tolerances given by Tech 3341 and 3342
+constexpr float kIntegratedTolerance = 0.1f;
+constexpr float kRangeTolerance = 1.f;
+constexpr size_t kChannels = 2;
+// frames per Process() call, deliberately not a multiple of the 100ms sub-block
+constexpr size_t kBufferFrames = 1234;
+
+struct Segment {
+	float seconds;
+	float dbfs; // peak level of the sine in each channel
+};
+
+void measure(le_fx::LoudnessMeter& meter, float sampleRate, const std::vector<Segment>& segments) {
+	EXPECT_TRUE(meter.Initialize(sampleRate, kChannels));
+	std::vector<float> buffer(kBufferFrames * kChannels);
+	size_t frame = 0; // keeps the phase continuous across segments
+	for (const Segment& s : segments) {
+		const float amp = std::pow(10.f, s.dbfs / 20.f);
+		size_t left = static_cast<size_t>(std::lround(s.seconds * sampleRate));
+		while (left > 0) {
+			const size_t n = std::min(left, kBufferFrames);
+			for (size_t i = 0; i < n; ++i, ++frame) {
+				const double phase = 2.0 * M_PI * 1000.0 * static_cast<double>(frame) / sampleRate;
+				buffer[i * kChannels] = buffer[i * kChannels + 1] =
+						amp * static_cast<float>(std::sin(phase));
+			}
+			meter.Process(buffer.data(), n);
+			left -= n;
+		}
+	}
+}
+
+float integrated(float sampleRate, const std::vector<Segment>& segments) {
+	le_fx::LoudnessMeter meter;
+	measure(meter, sampleRate, segments);
+	return meter.GetIntegratedLoudness();
+}
+
+float range(float sampleRate, const std::vector<Segment>& segments) {
+	le_fx::LoudnessMeter meter;
+	measure(meter, sampleRate, segments);
+	return meter.GetLoudnessRange();
+}
+
+}  // namespace
+
+class LoudnessMeterTest : public ::testing::TestWithParam<float> {};
+
+TEST_P(LoudnessMeterTest, Tech3341Integrated) {
+	const float rate = GetParam();
+	// case 1 and 2: a steady sine reads its level
+	EXPECT_NEAR(integrated(rate, { { 20.f, -23.f } }), -23.f, kIntegratedTolerance);
+	EXPECT_NEAR(integrated(rate, { { 20.f, -33.f } }), -33.f, kIntegratedTolerance);
+	// case 3: the quiet parts are below the relative gate
+	EXPECT_NEAR(integrated(rate, { { 10.f, -36.f }, { 60.f, -23.f }, { 10.f, -36.f } }),
+	            -23.f, kIntegratedTolerance);
+	// case 4: and the very quiet ones below the absolute gate
+	EXPECT_NEAR(integrated(rate, { { 10.f, -72.f }, { 10.f, -36.f }, { 60.f, -23.f },
+	                               { 10.f, -36.f }, { 10.f, -72.f } }),
+	            -23.f, kIntegratedTolerance);
+	// case 5: everything is above the relative gate and averaged by energy
+	EXPECT_NEAR(integrated(rate, { { 20.f, -26.f }, { 20.1f, -20.f }, { 20.f, -26.f } }),
+	            -23.f, kIntegratedTolerance);
+}
+
+TEST_P(LoudnessMeterTest, Tech3342Range) {
+	const float rate = GetParam();
+	EXPECT_NEAR(range(rate, { { 20.f, -20.f }, { 20.f, -30.f } }), 10.f, kRangeTolerance);
+	EXPECT_NEAR(range(rate, { { 20.f, -20.f }, { 20.f, -15.f } }), 5.f, kRangeTolerance);
+	// the -40 part is more than 20 LU below the -20 part, but not below the relative gate
+	// of the mean of both
+	EXPECT_NEAR(range(rate, { { 20.f, -40.f }, { 20.f, -20.f } }), 20.f, kRangeTolerance);
+	EXPECT_NEAR(range(rate, { { 20.f, -50.f }, { 20.f, -35.f }, { 20.f, -20.f },
+	                          { 20.f, -35.f }, { 20.f, -50.f } }),
+	            15.f, kRangeTolerance);
+}
+
+TEST_P(LoudnessMeterTest, EmptyAndSilent) {
+	const float rate = GetParam();
+	le_fx::LoudnessMeter meter;
+	ASSERT_TRUE(meter.Initialize(rate, kChannels));
+	EXPECT_EQ(meter.GetIntegratedLoudness(), -HUGE_VALF);
+	EXPECT_EQ(meter.GetLoudnessRange(), 0.f);
+	// below the absolute gate
+	EXPECT_EQ(integrated(rate, { { 5.f, -80.f } }), -HUGE_VALF);
+	// shorter than one short-term block
+	EXPECT_EQ(range(rate, { { 2.5f, -20.f } }), 0.f);
+}
+
+TEST_P(LoudnessMeterTest, Peaks) {
+	const float rate = GetParam();
+	le_fx::LoudnessMeter meter;
+	measure(meter, rate, { { 1.f, -6.f } });
+	const float amp = std::pow(10.f, -6.f / 20.f);
+	EXPECT_NEAR(meter.GetSamplePeak(), amp, amp * 1e-3f);
+	// a 1kHz sine has no notable inter-sample overs at these rates
+	EXPECT_NEAR(meter.GetTruePeak(), amp, amp * 0.01f);
+}
+
+INSTANTIATE_TEST_SUITE_P(SampleRates, LoudnessMeterTest, ::testing::Values(44100.f, 48000.f));
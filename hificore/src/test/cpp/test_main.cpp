@@ -0,0 +1,45 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Built without the instruction set flags of the test variant, so that it can check whether
+// this CPU may run the rest of the binary at all.
+
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <unistd.h>
+
+// see SKIP_RETURN_CODE in CMakeLists.txt
+#define SKIP_EXIT_CODE 77
+
+// Runs before the static initializers of the tests, which may already use the instructions.
+__attribute__((constructor(101))) static void checkCpu() {
+#if defined(GRAMOPHONE_TEST_ISA) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports(GRAMOPHONE_TEST_ISA)) {
+		fprintf(stderr, "this CPU doesn't support %s, skipping\n", GRAMOPHONE_TEST_ISA);
+		_exit(SKIP_EXIT_CODE);
+	}
+#endif
+}
+
+int main(int argc, char** argv) {
+#ifdef GRAMOPHONE_TEST_ISA
+	printf("instruction set: %s\n", GRAMOPHONE_TEST_ISA);
+#endif
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
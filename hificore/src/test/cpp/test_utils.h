@@ -0,0 +1,44 @@
+/*
+ *     Copyright (C) 2025 nift4
+ *
+ *     Gramophone is free software: you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation, either version 3 of the License, or
+ *     (at your option) any later version.
+ *
+ *     Gramophone is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GRAMOPHONE_TEST_UTILS_H
+#define GRAMOPHONE_TEST_UTILS_H
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+namespace gramophone_test {
+
+// Number of representable floats between a and b. Zeros of either sign are equal, two NaNs
+// are equal, and a NaN is infinitely far from everything else.
+inline int64_t ulpDistance(float a, float b) {
+	if (std::isnan(a) || std::isnan(b))
+		return std::isnan(a) && std::isnan(b) ? 0 : std::numeric_limits<int64_t>::max();
+	// map the sign-magnitude encoding onto a monotonic integer line
+	auto ordered = [](float x) -> int64_t {
+		const auto bits = static_cast<int64_t>(std::bit_cast<int32_t>(x));
+		return bits < 0 ? std::numeric_limits<int32_t>::min() - bits : bits;
+	};
+	const int64_t d = ordered(a) - ordered(b);
+	return d < 0 ? -d : d;
+}
+
+}  // namespace gramophone_test
+
+#endif //GRAMOPHONE_TEST_UTILS_H